@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "mem.c"
+#include "str_list.c"
+#include "arena.c"
+#include "histogram.c"
+#include "stats.c"
+#include "error.c"
+#include "trace.c"
+#include "xml.c"
+#include "xpath.c"
+
+/* The expressions wb evaluates on listing and image pages */
+static const char *XPATH_IMAGE_PAGE_URL = "//div[contains(@class,'thumb')]/div[@class='wrapper']/a[@target='_blank']/@href";
+static const char *XPATH_IMAGE_URL = "//img[contains(@class,'wall')]/@src";
+
+/* Thumbnails on the benchmarked listing page */
+#define LISTING_THUMBS 60
+
+/* Not measured, pages are read from fixtures */
+char *net_get_response(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies) {
+	return NULL;
+}
+
+/* A page and an expression to evaluate on it */
+struct parse_case {
+	char *data;
+	const char *expression;
+};
+
+/* Builds a listing page with LISTING_THUMBS thumbnails */
+char *
+build_listing() {
+	char *fixture, *thumb, *thumb_end, *listing;
+	size_t head_length, thumb_length;
+	int i;
+
+	fixture = bench_read_fixture("listing.html");
+	thumb = strstr(fixture, "<!-- thumb -->");
+	thumb_end = strstr(fixture, "<!-- /thumb -->");
+	head_length = thumb - fixture;
+	thumb_length = thumb_end - thumb;
+
+	listing = (char *) malloc(strlen(fixture) + thumb_length * LISTING_THUMBS);
+	memcpy(listing, fixture, head_length);
+	for (i = 0; i < LISTING_THUMBS; i++) {
+		memcpy(listing + head_length + i * thumb_length, thumb, thumb_length);
+	}
+	strcpy(listing + head_length + LISTING_THUMBS * thumb_length, thumb_end);
+
+	free(fixture);
+	return listing;
+}
+
+void
+bench_convert(void *arg) {
+	free(convert_html_to_xml((const char *) arg));
+}
+
+void
+bench_parse_doc(void *arg) {
+	xmlFreeDoc(xmlParseDoc(BAD_CAST arg));
+}
+
+void
+bench_parse_pooled(void *arg) {
+	xmlFreeDoc(xpath_parse_doc((const char *) arg));
+}
+
+void
+bench_eval(void *arg) {
+	struct parse_case *parse_case = (struct parse_case *) arg;
+
+	wb_list_free(xpath_eval_expr(parse_case->data, parse_case->expression, NULL));
+}
+
+/**
+ * Parses the pages, evaluates XPath on them and frees them with
+ * the libxml2 arena of --xml-arena. The xpath_eval_expr cases of
+ * main() do the same on the heap.
+ *
+ * @return 0 on success, 1 otherwise.
+ */
+int
+bench_arena() {
+	struct parse_case listing, detail;
+	char *html;
+
+	if (xpath_enable_arena() != 0) {
+		fprintf(stderr, "unable to set up the libxml2 arena\n");
+		return 1;
+	}
+	xpath_init();
+
+	html = build_listing();
+	listing.data = convert_html_to_xml(html);
+	listing.expression = XPATH_IMAGE_PAGE_URL;
+	free(html);
+	html = bench_read_fixture("detail.html");
+	detail.data = convert_html_to_xml(html);
+	detail.expression = XPATH_IMAGE_URL;
+	free(html);
+	if (listing.data == NULL || detail.data == NULL) {
+		fprintf(stderr, "unable to convert the fixtures to XML\n");
+		return 1;
+	}
+
+	bench_run("xpath_eval_expr_arena/listing", bench_eval, &listing);
+	bench_run("xpath_eval_expr_arena/detail", bench_eval, &detail);
+
+	free(listing.data);
+	free(detail.data);
+	xpath_cleanup();
+	return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+	struct parse_case listing, detail;
+	char *login;
+	pid_t pid;
+	int status;
+
+	/* The arena hooks must be in place before libxml2 allocates
+	   anything, so the arena cases run in a process of their own */
+	fflush(stdout);
+	pid = fork();
+	if (pid == -1) {
+		fprintf(stderr, "unable to run the arena benchmarks\n");
+		return 1;
+	}
+	if (pid == 0) {
+		exit(bench_arena());
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return 1;
+	}
+
+	xpath_init();
+
+	listing.data = build_listing();
+	listing.expression = XPATH_IMAGE_PAGE_URL;
+	detail.data = bench_read_fixture("detail.html");
+	detail.expression = XPATH_IMAGE_URL;
+	login = bench_read_fixture("login.html");
+
+	bench_run("convert_html_to_xml/listing", bench_convert, listing.data);
+	bench_run("convert_html_to_xml/detail", bench_convert, detail.data);
+	bench_run("convert_html_to_xml/login", bench_convert, login);
+
+	/* XPath is evaluated on the converted pages */
+	listing.data = convert_html_to_xml(listing.data);
+	detail.data = convert_html_to_xml(detail.data);
+	if (listing.data == NULL || detail.data == NULL) {
+		fprintf(stderr, "unable to convert the fixtures to XML\n");
+		return 1;
+	}
+
+	/* A new parser context for every page, and the thread's reused one */
+	bench_run("xmlParseDoc/listing", bench_parse_doc, listing.data);
+	bench_run("xmlParseDoc/detail", bench_parse_doc, detail.data);
+	bench_run("xpath_parse_doc/listing", bench_parse_pooled, listing.data);
+	bench_run("xpath_parse_doc/detail", bench_parse_pooled, detail.data);
+
+	bench_run("xpath_eval_expr/listing", bench_eval, &listing);
+	bench_run("xpath_eval_expr/detail", bench_eval, &detail);
+
+	free(listing.data);
+	free(detail.data);
+	free(login);
+	xpath_cleanup();
+	return 0;
+}
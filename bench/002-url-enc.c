@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "url_enc.c"
+
+void
+bench_url_encode(void *arg) {
+	free(url_encode((const char *) arg));
+}
+
+int
+main(int argc, char *argv[]) {
+	bench_run("url_encode/plain", bench_url_encode, "mountainsunset1920");
+	bench_run("url_encode/query", bench_url_encode, "snowy mountains & \"lakes\" at 50% / dusk?");
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "types.h"
+#include "query.c"
+
+/* Builds the query and the URL of one listing page */
+void
+bench_generate_query(void *arg) {
+	struct wb_query *query;
+	char *page_url;
+
+	query = wb_generate_query((struct options *) arg);
+	page_url = (char *) malloc(wb_query_page_url_size(query));
+	wb_query_page_url(query, 1200, page_url);
+	free(page_url);
+	wb_query_free(query);
+}
+
+int
+main(int argc, char *argv[]) {
+	struct options options;
+
+	memset(&options, 0, sizeof(options));
+	options.images = 200;
+	options.images_per_page = 60;
+	options.query = "mountains";
+	options.color = -1;
+	options.collection_id = -1;
+	options.res_x = 1920;
+	options.res_y = 1080;
+	options.res_opt = WB_RES_AT_LEAST;
+	options.purity = WB_PURITY_SFW | WB_PURITY_SKETCHY;
+	options.boards = WB_BOARD_ALL;
+	options.sort_by = WB_SORT_RELEVANCE;
+	options.sort_order = WB_SORT_DESCENDING;
+	bench_run("wb_generate_query/search", bench_generate_query, &options);
+
+	options.query = NULL;
+	options.toplist = WB_TOPLIST_1W;
+	bench_run("wb_generate_query/toplist", bench_generate_query, &options);
+	return 0;
+}
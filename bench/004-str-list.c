@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "mem.c"
+#include "str_list.c"
+
+/* Image URLs in a list, like a large query */
+#define LIST_LENGTH 1000
+
+static const char *IMAGE_URL = "http://wallpapers.wallbase.cc/rozne/wallpaper-2741823.jpg";
+
+/* Keeps results from being optimized away */
+static volatile int length_sink;
+
+void
+bench_append(void *arg) {
+	struct wb_str_list *list = NULL;
+	int i;
+
+	for (i = 0; i < LIST_LENGTH; i++) {
+		list = wb_list_append(list, IMAGE_URL);
+	}
+	wb_list_free(list);
+}
+
+void
+bench_prepend(void *arg) {
+	struct wb_str_list *list = NULL;
+	int i;
+
+	for (i = 0; i < LIST_LENGTH; i++) {
+		list = wb_list_prepend(list, IMAGE_URL);
+	}
+	wb_list_free(list);
+}
+
+void
+bench_length(void *arg) {
+	length_sink = wb_list_length((struct wb_str_list *) arg);
+}
+
+int
+main(int argc, char *argv[]) {
+	struct wb_str_list *list = NULL;
+	int i;
+
+	bench_run("wb_list_append/1000", bench_append, NULL);
+	bench_run("wb_list_prepend/1000", bench_prepend, NULL);
+
+	for (i = 0; i < LIST_LENGTH; i++) {
+		list = wb_list_prepend(list, IMAGE_URL);
+	}
+	bench_run("wb_list_length/1000", bench_length, list);
+	wb_list_free(list);
+	return 0;
+}
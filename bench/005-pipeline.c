@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "replay.h"
+
+/* The wb binary built by the top level make */
+#define PIPELINE_WB "../bin/wb"
+
+/* Runs of every configuration */
+#define PIPELINE_RUNS 3
+
+/* Images the replayed query has */
+#define PIPELINE_IMAGES 2000
+
+/* Configurations: images wanted and parse jobs */
+static const int PIPELINE_CONFIGS[][2] = {
+	{20, 1}, {200, 1}, {200, 4}, {1000, 4}
+};
+
+#define PIPELINE_CONFIG_COUNT (sizeof(PIPELINE_CONFIGS) / sizeof(PIPELINE_CONFIGS[0]))
+
+/**
+ * Runs wb once against the replay server.
+ *
+ * @param base_url - the replay server
+ * @param images - images to get
+ * @param jobs - parse jobs
+ * @param usage - where to store the CPU time wb used
+ * @return the number of image URLs wb printed, -1 if it failed.
+ */
+int
+pipeline_run_wb(const char *base_url, int images, int jobs, struct rusage *usage) {
+	char images_arg[16], jobs_arg[16];
+	char line[512];
+	int pipe_fds[2];
+	int count, status;
+	FILE *out;
+	pid_t pid;
+
+	snprintf(images_arg, sizeof(images_arg), "%d", images);
+	snprintf(jobs_arg, sizeof(jobs_arg), "%d", jobs);
+
+	if (pipe(pipe_fds) != 0) {
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		dup2(pipe_fds[1], STDOUT_FILENO);
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		execl(PIPELINE_WB, PIPELINE_WB, "--base-url", base_url, "-n", images_arg,
+			"-j", jobs_arg, (char *) NULL);
+		_exit(127);
+	}
+
+	close(pipe_fds[1]);
+	out = fdopen(pipe_fds[0], "r");
+	count = 0;
+	while (out != NULL && fgets(line, sizeof(line), out) != NULL) {
+		count++;
+	}
+	if (out != NULL) {
+		fclose(out);
+	} else {
+		close(pipe_fds[0]);
+	}
+
+	if (wait4(pid, &status, 0, usage) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+
+	return count;
+}
+
+int
+main(int argc, char *argv[]) {
+	struct replay_server *server;
+	struct rusage usage;
+	unsigned long requests;
+	double start, seconds, cpu;
+	char name[64], extra[160];
+	int images, jobs, count, failed, run;
+	size_t i;
+
+	server = replay_start(BENCH_FIXTURES, PIPELINE_IMAGES);
+	if (server == NULL) {
+		return 1;
+	}
+
+	failed = 0;
+	for (i = 0; i < PIPELINE_CONFIG_COUNT; i++) {
+		images = PIPELINE_CONFIGS[i][0];
+		jobs = PIPELINE_CONFIGS[i][1];
+
+		seconds = 0;
+		cpu = 0;
+		requests = replay_requests(server);
+		for (run = 0; run < PIPELINE_RUNS; run++) {
+			start = bench_now();
+			count = pipeline_run_wb(replay_base_url(server), images, jobs, &usage);
+			seconds += bench_now() - start;
+
+			if (count != images) {
+				fprintf(stderr, "pipeline: wb printed %d of %d images\n", count, images);
+				failed = 1;
+				break;
+			}
+			cpu += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+				+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		}
+		if (run < PIPELINE_RUNS) {
+			continue;
+		}
+
+		/* One op is one image */
+		snprintf(name, sizeof(name), "pipeline/%d-images/%d-jobs", images, jobs);
+		snprintf(extra, sizeof(extra),
+			"\"images_per_second\":%.1f,\"cpu_ns_per_image\":%.1f,\"requests\":%lu",
+			images * PIPELINE_RUNS / seconds, cpu * 1e9 / (images * PIPELINE_RUNS),
+			(replay_requests(server) - requests) / PIPELINE_RUNS);
+		bench_report(name, (long) images * PIPELINE_RUNS, seconds, extra);
+	}
+
+	replay_stop(server);
+	return failed;
+}
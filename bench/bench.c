@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "replay.h"
+
+/**
+ * Gets the time of a monotonic clock.
+ *
+ * @return the time in seconds.
+ */
+double
+bench_now() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Reads a recorded page, with @BASE@ and @ID@ left in it.
+ *
+ * @param name - the file name in the fixtures directory
+ * @return the page, exits on error. IMPORTANT: the returned string
+ *   must be freed using free().
+ */
+char *
+bench_read_fixture(const char *name) {
+	char *data = replay_read_fixture(BENCH_FIXTURES, name);
+
+	if (data == NULL) {
+		exit(1);
+	}
+	return data;
+}
+
+/**
+ * Runs an operation until BENCH_MIN_TIME has passed, doubling the
+ * number of runs each round so the clock is read rarely, and
+ * reports the time of a run.
+ *
+ * @param name - the name of the benchmark
+ * @param func - the operation
+ * @param arg - passed to func
+ */
+void
+bench_run(const char *name, bench_func func, void *arg) {
+	double start, seconds;
+	long iterations, i;
+
+	/* Warm up caches and lazily set up state */
+	func(arg);
+
+	for (iterations = 1; ; iterations *= 2) {
+		start = bench_now();
+		for (i = 0; i < iterations; i++) {
+			func(arg);
+		}
+		seconds = bench_now() - start;
+
+		if (seconds >= BENCH_MIN_TIME) {
+			break;
+		}
+	}
+
+	bench_report(name, iterations, seconds, NULL);
+}
+
+/**
+ * Prints the result of a benchmark as one line of JSON, so that
+ * the results of two versions can be compared.
+ *
+ * @param name - the name of the benchmark
+ * @param iterations - the number of runs
+ * @param seconds - how long all of them took
+ * @param extra (optional) - more JSON fields, like "\"images\":200"
+ */
+void
+bench_report(const char *name, long iterations, double seconds, const char *extra) {
+	printf("{\"bench\":\"%s\",\"version\":\"%s\",\"iterations\":%ld,\"seconds\":%.6f,"
+		"\"ns_per_op\":%.1f%s%s}\n", name, VERSION, iterations, seconds,
+		seconds * 1e9 / iterations, extra != NULL ? "," : "", extra != NULL ? extra : "");
+	fflush(stdout);
+}
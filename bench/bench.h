@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_BENCH_H
+#define INCLUDED_WB_BENCH_H
+
+/* Where the recorded pages are, relative to bench/ */
+#define BENCH_FIXTURES "fixtures"
+
+/* Minimum time a benchmark is run for, in seconds */
+#define BENCH_MIN_TIME 0.5
+
+/* Runs the operation being measured once */
+typedef void (*bench_func)(void *arg);
+
+double bench_now();
+char *bench_read_fixture(const char *name);
+void bench_run(const char *name, bench_func func, void *arg);
+void bench_report(const char *name, long iterations, double seconds, const char *extra);
+
+#endif
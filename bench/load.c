@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+#include "replay.h"
+
+/* The wb binary built by the top level make */
+#define LOAD_WB "../bin/wb"
+
+/* Runs of every configuration */
+#define LOAD_RUNS 2
+
+/* Images every run gets, out of the ones the replayed query has */
+#define LOAD_IMAGES 100
+#define LOAD_QUERY_IMAGES 2000
+
+/* Doubling the parse jobs has to make wb at least this much faster,
+   or throughput stopped scaling */
+#define LOAD_SCALING_MIN 1.2
+
+/* The matrix: parse jobs, server latency and bytes added to every
+   page. The jitter is half the latency. */
+static const int LOAD_JOBS[] = {1, 2, 4, 8, 16};
+static const int LOAD_LATENCIES[] = {0, 10, 50};
+static const size_t LOAD_PADDINGS[] = {0, 65536};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+/* What one run of wb did */
+struct load_run {
+	int images;                  /* image URLs printed */
+	double seconds;
+	double cpu;                  /* user and system time, in seconds */
+	long max_rss;                /* in kilobytes */
+	double p50;                  /* request time, in milliseconds */
+	double p99;
+};
+
+/**
+ * Reads the request time percentiles from the stats wb printed.
+ *
+ * @param stats - the stats, rewound
+ * @param run - where to store them
+ */
+void
+load_read_stats(FILE *stats, struct load_run *run) {
+	char line[256];
+	unsigned long count;
+	double total, p95;
+
+	while (fgets(line, sizeof(line), stats) != NULL) {
+		if (strncmp(line, "total ", 6) == 0) {
+			sscanf(line + 6, "%lu %lf %lf %lf %lf", &count, &total, &run->p50, &p95, &run->p99);
+		}
+	}
+}
+
+/**
+ * Runs wb once against the replay server.
+ *
+ * @param base_url - the replay server
+ * @param jobs - parse jobs
+ * @param run - where to store what the run did
+ * @return 0 on success, -1 if wb failed.
+ */
+int
+load_run_wb(const char *base_url, int jobs, struct load_run *run) {
+	char images_arg[16], jobs_arg[16];
+	char line[512];
+	int pipe_fds[2];
+	int status;
+	struct rusage usage;
+	double start;
+	FILE *out, *stats;
+	pid_t pid;
+
+	snprintf(images_arg, sizeof(images_arg), "%d", LOAD_IMAGES);
+	snprintf(jobs_arg, sizeof(jobs_arg), "%d", jobs);
+	memset(run, 0, sizeof(struct load_run));
+
+	stats = tmpfile();
+	if (stats == NULL) {
+		return -1;
+	}
+	if (pipe(pipe_fds) != 0) {
+		fclose(stats);
+		return -1;
+	}
+
+	start = bench_now();
+	pid = fork();
+	if (pid == -1) {
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		fclose(stats);
+		return -1;
+	}
+	if (pid == 0) {
+		dup2(pipe_fds[1], STDOUT_FILENO);
+		dup2(fileno(stats), STDERR_FILENO);
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+		execl(LOAD_WB, LOAD_WB, "--base-url", base_url, "-n", images_arg,
+			"-j", jobs_arg, "--stats", (char *) NULL);
+		_exit(127);
+	}
+
+	close(pipe_fds[1]);
+	out = fdopen(pipe_fds[0], "r");
+	while (out != NULL && fgets(line, sizeof(line), out) != NULL) {
+		run->images++;
+	}
+	if (out != NULL) {
+		fclose(out);
+	} else {
+		close(pipe_fds[0]);
+	}
+
+	if (wait4(pid, &status, 0, &usage) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fclose(stats);
+		return -1;
+	}
+	run->seconds = bench_now() - start;
+	run->cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+		+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	run->max_rss = usage.ru_maxrss;
+
+	rewind(stats);
+	load_read_stats(stats, run);
+	fclose(stats);
+
+	return 0;
+}
+
+/**
+ * Runs one configuration of the matrix and reports it.
+ *
+ * @param server - the replay server, already set up
+ * @param latency - the server latency, for the name
+ * @param padding - the page padding, for the name
+ * @param jobs - parse jobs
+ * @param last_throughput - the images per second with half the
+ *   jobs, 0 if there is no such run. Updated.
+ * @param saturated - set to 1 once throughput stopped scaling
+ * @return 0 on success, -1 if wb failed.
+ */
+int
+load_run_config(struct replay_server *server, int latency, size_t padding, int jobs,
+	double *last_throughput, int *saturated) {
+
+	struct load_run run, total;
+	double throughput, scaling;
+	char name[96], extra[256];
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < LOAD_RUNS; i++) {
+		if (load_run_wb(replay_base_url(server), jobs, &run) != 0 || run.images != LOAD_IMAGES) {
+			fprintf(stderr, "load: wb printed %d of %d images\n", run.images, LOAD_IMAGES);
+			return -1;
+		}
+
+		total.seconds += run.seconds;
+		total.cpu += run.cpu;
+		total.max_rss = (run.max_rss > total.max_rss) ? run.max_rss : total.max_rss;
+		total.p50 = (run.p50 > total.p50) ? run.p50 : total.p50;
+		total.p99 = (run.p99 > total.p99) ? run.p99 : total.p99;
+	}
+
+	throughput = LOAD_IMAGES * LOAD_RUNS / total.seconds;
+	scaling = (*last_throughput > 0) ? throughput / *last_throughput : 0;
+	if (*last_throughput > 0 && scaling < LOAD_SCALING_MIN && !*saturated) {
+		*saturated = 1;
+		fprintf(stderr, "load: throughput stops scaling at %d jobs with %d ms latency and "
+			"%lu bytes of padding\n", jobs, latency, (unsigned long) padding);
+	}
+	*last_throughput = throughput;
+
+	/* One op is one image */
+	snprintf(name, sizeof(name), "load/%d-ms/%lu-padding/%d-jobs", latency,
+		(unsigned long) padding, jobs);
+	snprintf(extra, sizeof(extra),
+		"\"images_per_second\":%.1f,\"cpu_ns_per_image\":%.1f,\"peak_rss_kb\":%ld,"
+		"\"request_p50_ms\":%.2f,\"request_p99_ms\":%.2f,\"scaling\":%.2f,\"saturated\":%s",
+		throughput, total.cpu * 1e9 / (LOAD_IMAGES * LOAD_RUNS), total.max_rss,
+		total.p50, total.p99, scaling, *saturated ? "true" : "false");
+	bench_report(name, (long) LOAD_IMAGES * LOAD_RUNS, total.seconds, extra);
+
+	return 0;
+}
+
+/**
+ * Runs wb against the replay server for every configuration of the
+ * matrix. Every series of configurations with growing parse jobs
+ * flags where throughput stops scaling.
+ */
+int
+main(int argc, char *argv[]) {
+	struct replay_server *server;
+	struct replay_faults faults;
+	double last_throughput;
+	size_t latency, padding, jobs;
+	int saturated, failed;
+
+	server = replay_start(BENCH_FIXTURES, LOAD_QUERY_IMAGES);
+	if (server == NULL) {
+		return 1;
+	}
+
+	failed = 0;
+	for (latency = 0; latency < ARRAY_SIZE(LOAD_LATENCIES); latency++) {
+		memset(&faults, 0, sizeof(faults));
+		faults.latency_ms = LOAD_LATENCIES[latency];
+		faults.jitter_ms = LOAD_LATENCIES[latency] / 2;
+		replay_set_faults(server, &faults);
+
+		for (padding = 0; padding < ARRAY_SIZE(LOAD_PADDINGS); padding++) {
+			replay_set_padding(server, LOAD_PADDINGS[padding]);
+
+			last_throughput = 0;
+			saturated = 0;
+			for (jobs = 0; jobs < ARRAY_SIZE(LOAD_JOBS); jobs++) {
+				if (load_run_config(server, LOAD_LATENCIES[latency], LOAD_PADDINGS[padding],
+					LOAD_JOBS[jobs], &last_throughput, &saturated) != 0) {
+					failed = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	replay_stop(server);
+	return failed;
+}
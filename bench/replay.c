@@ -0,0 +1,961 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "replay.h"
+
+/* Markers in the listing fixture around the thumbnail that is
+   repeated for every image */
+static const char *THUMB_START = "<!-- thumb -->";
+static const char *THUMB_END = "<!-- /thumb -->";
+
+/* Largest request head that is read */
+#define REPLAY_HEAD_MAX 8192
+
+/* Clients connected at the same time */
+#define REPLAY_CLIENTS_MAX 256
+
+/* Thumbnails per page when the request does not say */
+#define REPLAY_THPP_DEFAULT 20
+
+/* Filler that pages are padded with, one paragraph at a time */
+static const char *PADDING = "<p class=\"padding\">Lorem ipsum dolor sit amet, "
+	"consectetur adipiscing elit, sed do eiusmod tempor.</p>\n";
+
+/* Room for the headers a page adds to its response */
+#define REPLAY_HEADERS_MAX 1024
+
+struct replay_server {
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t clients_done;
+	int client_fds[REPLAY_CLIENTS_MAX]; /* -1 where there is no client */
+	int client_count;
+	char base_url[32];
+	int images;                  /* images the query has in total */
+	unsigned long requests;
+	struct replay_faults faults; /* guarded by lock */
+	size_t padding;              /* bytes added to pages, guarded by lock */
+	char *listing_head;          /* the listing fixture before, in and */
+	char *listing_thumb;         /* after the repeated thumbnail */
+	char *listing_tail;
+	char *detail;
+	char *login;
+};
+
+/* A connected client */
+struct replay_client {
+	struct replay_server *server;
+	int fd;
+	int slot;                    /* its place in server->client_fds */
+};
+
+/* A page being built */
+struct replay_page {
+	char *data;
+	size_t length;
+	size_t size;
+};
+
+/**
+ * Reads a fixture.
+ *
+ * @param dir - the fixtures directory
+ * @param name - the file name
+ * @return the contents, NULL on error. IMPORTANT: the returned
+ *   string must be freed using free().
+ */
+char *
+replay_read_fixture(const char *dir, const char *name) {
+	char path[256];
+	char *data;
+	long size;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "replay: unable to open %s\n", path);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	data = (char *) malloc(size + 1);
+	if (data != NULL) {
+		if (fread(data, 1, size, file) != (size_t) size) {
+			free(data);
+			data = NULL;
+		} else {
+			data[size] = '\0';
+		}
+	}
+
+	fclose(file);
+	return data;
+}
+
+/**
+ * Appends a template to a page, replacing @BASE@ with the server's
+ * URL and @ID@ with an image ID.
+ *
+ * @param page - the page
+ * @param template - the template
+ * @param length - the length of the template
+ * @param base_url - the server's URL
+ * @param id - the image ID
+ * @return 0 on success, -1 otherwise.
+ */
+int
+replay_append(struct replay_page *page, const char *template, size_t length,
+	const char *base_url, long id) {
+
+	const char *end = template + length;
+	char id_string[24];
+	const char *value;
+	size_t value_length;
+	char *grown;
+
+	snprintf(id_string, sizeof(id_string), "%ld", id);
+
+	while (template < end) {
+		if (*template == '@' && (size_t) (end - template) >= 6 && memcmp(template, "@BASE@", 6) == 0) {
+			value = base_url;
+			template += 6;
+		} else if (*template == '@' && (size_t) (end - template) >= 4 && memcmp(template, "@ID@", 4) == 0) {
+			value = id_string;
+			template += 4;
+		} else {
+			value = NULL;
+		}
+		value_length = (value != NULL) ? strlen(value) : 1;
+
+		if (page->length + value_length + 1 > page->size) {
+			page->size = (page->size + value_length) * 2 + 1024;
+			grown = (char *) realloc(page->data, page->size);
+			if (grown == NULL) {
+				return -1;
+			}
+			page->data = grown;
+		}
+
+		if (value != NULL) {
+			memcpy(page->data + page->length, value, value_length);
+		} else {
+			page->data[page->length] = *template++;
+		}
+		page->length += value_length;
+	}
+
+	page->data[page->length] = '\0';
+	return 0;
+}
+
+/**
+ * Pads a page with paragraphs at the end of its body.
+ *
+ * @param page - the page
+ * @param bytes - at least how many bytes to add
+ * @return 0 on success, -1 otherwise.
+ */
+int
+replay_pad(struct replay_page *page, size_t bytes) {
+	size_t unit = strlen(PADDING);
+	size_t added = (bytes + unit - 1) / unit * unit;
+	size_t at, i;
+	char *body_end, *grown;
+
+	body_end = (page->data != NULL) ? strstr(page->data, "</body>") : NULL;
+	if (body_end == NULL || added == 0) {
+		return 0;
+	}
+	at = body_end - page->data;
+
+	if (page->length + added + 1 > page->size) {
+		grown = (char *) realloc(page->data, page->length + added + 1);
+		if (grown == NULL) {
+			return -1;
+		}
+		page->data = grown;
+		page->size = page->length + added + 1;
+	}
+
+	memmove(page->data + at + added, page->data + at, page->length - at + 1);
+	for (i = 0; i < added; i += unit) {
+		memcpy(page->data + at + i, PADDING, unit);
+	}
+	page->length += added;
+
+	return 0;
+}
+
+/**
+ * Gets a number after a prefix in a request path.
+ *
+ * @param path - the request path
+ * @param prefix - what comes before the number
+ * @param fallback - the value if there is no such number
+ * @return the number.
+ */
+long
+replay_path_number(const char *path, const char *prefix, long fallback) {
+	const char *start = strstr(path, prefix);
+
+	if (start == NULL) {
+		return fallback;
+	}
+	return strtol(start + strlen(prefix), NULL, 10);
+}
+
+/**
+ * Finds a header of a request.
+ *
+ * @param head - the request line and headers
+ * @param name - the header name, without the ':'
+ * @return the start of the value, which ends at the end of the line,
+ *   NULL if there is no such header.
+ */
+const char *
+replay_header_value(const char *head, const char *name) {
+	size_t name_length = strlen(name);
+	const char *line = strstr(head, "\r\n");
+
+	while (line != NULL) {
+		line += 2;
+		if (strncasecmp(line, name, name_length) == 0 && line[name_length] == ':') {
+			line += name_length + 1;
+			while (*line == ' ' || *line == '\t') {
+				line++;
+			}
+			return line;
+		}
+		line = strstr(line, "\r\n");
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks if a header of a request has the given value.
+ *
+ * @param head - the request line and headers
+ * @param name - the header name, without the ':'
+ * @param value - the value
+ * @return 1 if it does, 0 otherwise.
+ */
+int
+replay_header_is(const char *head, const char *name, const char *value) {
+	const char *found = replay_header_value(head, name);
+	size_t length = strlen(value);
+
+	return found != NULL && strncmp(found, value, length) == 0
+		&& (found[length] == '\r' || found[length] == '\0');
+}
+
+/**
+ * Builds the page a request path is answered with.
+ *
+ * Besides the recorded pages, /redirect?to=PATH redirects to PATH
+ * and /echo answers with the request's method, path and cookies.
+ *
+ * @param server - the server
+ * @param method - the request method
+ * @param path - the request path, with the query string
+ * @param head - the request line and headers
+ * @param page - where to build the page
+ * @param headers - where to store the headers the response needs,
+ *   REPLAY_HEADERS_MAX bytes
+ * @return the HTTP status.
+ */
+int
+replay_build_page(struct replay_server *server, const char *method, const char *path,
+	const char *head, struct replay_page *page, char *headers) {
+
+	long offset, thpp, id;
+	const char *collection_offset, *cookie;
+	char etag[32];
+	int cookie_length;
+
+	headers[0] = '\0';
+
+	if (strncmp(path, "/search/", 8) == 0 || strncmp(path, "/toplist/", 9) == 0
+		|| strncmp(path, "/random/", 8) == 0 || strncmp(path, "/collection/", 12) == 0) {
+
+		/* /collection/<id>/<offset> or /<endpoint>/index/<offset> */
+		if (strncmp(path, "/collection/", 12) == 0) {
+			collection_offset = strchr(path + 12, '/');
+			offset = (collection_offset != NULL) ? strtol(collection_offset + 1, NULL, 10) : 0;
+		} else {
+			offset = replay_path_number(path, "/index/", 0);
+		}
+		thpp = replay_path_number(path, "thpp=", REPLAY_THPP_DEFAULT);
+
+		if (replay_append(page, server->listing_head, strlen(server->listing_head),
+			server->base_url, 0) != 0) {
+			return 500;
+		}
+		for (id = offset + 1; id <= offset + thpp && id <= server->images; id++) {
+			if (replay_append(page, server->listing_thumb, strlen(server->listing_thumb),
+				server->base_url, id) != 0) {
+				return 500;
+			}
+		}
+		return replay_append(page, server->listing_tail, strlen(server->listing_tail),
+			server->base_url, 0) == 0 ? 200 : 500;
+	}
+
+	/* Image pages never change, so their ETag is their ID */
+	if (strncmp(path, "/wallpaper/", 11) == 0) {
+		id = strtol(path + 11, NULL, 10);
+		snprintf(etag, sizeof(etag), "\"%ld\"", id);
+		snprintf(headers, REPLAY_HEADERS_MAX, "ETag: %s\r\n", etag);
+		if (replay_header_is(head, "If-None-Match", etag)) {
+			return 304;
+		}
+		return replay_append(page, server->detail, strlen(server->detail),
+			server->base_url, id) == 0 ? 200 : 500;
+	}
+
+	if (strcmp(path, "/user/login") == 0) {
+		return replay_append(page, server->login, strlen(server->login),
+			server->base_url, 0) == 0 ? 200 : 500;
+	}
+
+	/* A successful login sets the session cookie and redirects home */
+	if (strcmp(path, "/user/do_login") == 0 && strcmp(method, "POST") == 0) {
+		snprintf(headers, REPLAY_HEADERS_MAX,
+			"Set-Cookie: wb_session=replay; Path=/\r\nLocation: %s/\r\n", server->base_url);
+		return 302;
+	}
+
+	if (strncmp(path, "/redirect?to=/", 14) == 0) {
+		snprintf(headers, REPLAY_HEADERS_MAX, "Location: %s%.512s\r\n", server->base_url,
+			path + 13);
+		return 302;
+	}
+
+	if (strcmp(path, "/echo") == 0) {
+		cookie = replay_header_value(head, "Cookie");
+		cookie_length = (cookie != NULL) ? (int) strcspn(cookie, "\r") : 0;
+		if (replay_append(page, method, strlen(method), server->base_url, 0) != 0
+			|| replay_append(page, " ", 1, server->base_url, 0) != 0
+			|| replay_append(page, path, strlen(path), server->base_url, 0) != 0
+			|| replay_append(page, "\nCookie: ", 9, server->base_url, 0) != 0
+			|| replay_append(page, (cookie != NULL) ? cookie : "", cookie_length,
+				server->base_url, 0) != 0) {
+			return 500;
+		}
+		return 200;
+	}
+
+	return 404;
+}
+
+/**
+ * Registers a client so that replay_stop() can cut it off.
+ *
+ * @param client - the client, its slot is set
+ * @return 0 on success, -1 if there are too many clients.
+ */
+int
+replay_client_add(struct replay_client *client) {
+	struct replay_server *server = client->server;
+	int i;
+
+	pthread_mutex_lock(&server->lock);
+	client->slot = -1;
+	for (i = 0; i < REPLAY_CLIENTS_MAX && client->slot == -1; i++) {
+		if (server->client_fds[i] == -1) {
+			server->client_fds[i] = client->fd;
+			server->client_count++;
+			client->slot = i;
+		}
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	return (client->slot != -1) ? 0 : -1;
+}
+
+/**
+ * Closes a client's connection and frees it.
+ *
+ * @param client - the client
+ */
+void
+replay_client_done(struct replay_client *client) {
+	struct replay_server *server = client->server;
+
+	pthread_mutex_lock(&server->lock);
+	server->client_fds[client->slot] = -1;
+	server->client_count--;
+	close(client->fd);
+	pthread_cond_broadcast(&server->clients_done);
+	pthread_mutex_unlock(&server->lock);
+
+	free(client);
+}
+
+/**
+ * Reads a request and drops its body. Bytes of the next request
+ * read with it are kept in the buffer.
+ *
+ * @param fd - the client socket
+ * @param buffer - REPLAY_HEAD_MAX + 1 bytes
+ * @param used - the bytes in buffer, updated
+ * @param method - where to store the method, 8 bytes
+ * @param path - where to store the path, REPLAY_HEAD_MAX bytes
+ * @param head - where to store the request line and headers,
+ *   REPLAY_HEAD_MAX + 1 bytes
+ * @param keep_alive - set to 0 if the client closes the connection
+ *   after the response
+ * @return 0 on success, -1 if the client is gone or sent garbage.
+ */
+int
+replay_read_request(int fd, char *buffer, size_t *used, char *method, char *path,
+	char *head, int *keep_alive) {
+
+	const char *length_header;
+	char *head_end;
+	ssize_t received;
+	long body_length, skip;
+
+	buffer[*used] = '\0';
+	while ((head_end = strstr(buffer, "\r\n\r\n")) == NULL) {
+		if (*used == REPLAY_HEAD_MAX) {
+			return -1;
+		}
+		received = recv(fd, buffer + *used, REPLAY_HEAD_MAX - *used, 0);
+		if (received <= 0) {
+			return -1;
+		}
+		*used += received;
+		buffer[*used] = '\0';
+	}
+	*head_end = '\0';
+	head_end += 4;
+
+	if (sscanf(buffer, "%7s %8191s", method, path) != 2) {
+		return -1;
+	}
+	strcpy(head, buffer);
+	*keep_alive = !replay_header_is(head, "Connection", "close");
+
+	length_header = replay_header_value(head, "Content-Length");
+	body_length = (length_header != NULL) ? strtol(length_header, NULL, 10) : 0;
+
+	*used -= head_end - buffer;
+	memmove(buffer, head_end, *used);
+
+	/* Drop the body, some of which may already be read */
+	while (body_length > 0) {
+		if (*used == 0) {
+			received = recv(fd, buffer, REPLAY_HEAD_MAX, 0);
+			if (received <= 0) {
+				return -1;
+			}
+			*used = received;
+		}
+
+		skip = ((long) *used < body_length) ? (long) *used : body_length;
+		*used -= skip;
+		memmove(buffer, buffer + skip, *used);
+		body_length -= skip;
+	}
+
+	return 0;
+}
+
+/**
+ * Sends all of a buffer.
+ *
+ * @param fd - the client socket
+ * @param data - the buffer
+ * @param length - its length
+ * @return 0 on success, -1 if the client is gone.
+ */
+int
+replay_send(int fd, const char *data, size_t length) {
+	ssize_t sent;
+
+	while (length > 0) {
+		sent = send(fd, data, length, MSG_NOSIGNAL);
+		if (sent <= 0) {
+			return -1;
+		}
+		data += sent;
+		length -= sent;
+	}
+
+	return 0;
+}
+
+/**
+ * Waits for a while.
+ *
+ * @param ms - how long, in milliseconds
+ */
+void
+replay_sleep(int ms) {
+	struct timespec wait;
+
+	wait.tv_sec = ms / 1000;
+	wait.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&wait, &wait) == -1 && errno == EINTR) {
+	}
+}
+
+/**
+ * Sends a body, all at once or a few bytes at a time.
+ *
+ * @param fd - the client socket
+ * @param data - the body
+ * @param length - its length
+ * @param faults - how slowly to send it
+ * @return 0 on success, -1 if the client is gone.
+ */
+int
+replay_send_body(int fd, const char *data, size_t length, const struct replay_faults *faults) {
+	size_t chunk;
+
+	if (faults->drip_bytes == 0) {
+		return replay_send(fd, data, length);
+	}
+
+	while (length > 0) {
+		chunk = (length < faults->drip_bytes) ? length : faults->drip_bytes;
+		if (replay_send(fd, data, chunk) != 0) {
+			return -1;
+		}
+		data += chunk;
+		length -= chunk;
+		if (length > 0 && faults->drip_ms > 0) {
+			replay_sleep(faults->drip_ms);
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Checks if a client accepts gzipped bodies.
+ *
+ * @param head - the request line and headers
+ * @return 1 if it does, 0 otherwise.
+ */
+int
+replay_accepts_gzip(const char *head) {
+	const char *value = replay_header_value(head, "Accept-Encoding");
+	size_t length;
+
+	if (value == NULL) {
+		return 0;
+	}
+
+	for (length = strcspn(value, "\r"); length >= 4; value++, length--) {
+		if (strncasecmp(value, "gzip", 4) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Compresses a page with gzip.
+ *
+ * @param page - the page
+ * @param compressed - where to store the compressed page, its buffer
+ *   is reused
+ * @return 0 on success, -1 otherwise.
+ */
+int
+replay_gzip(const struct replay_page *page, struct replay_page *compressed) {
+	z_stream stream;
+	uLong bound;
+	char *grown;
+	int res;
+
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+		Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+
+	bound = deflateBound(&stream, page->length);
+	if (bound > compressed->size) {
+		grown = (char *) realloc(compressed->data, bound);
+		if (grown == NULL) {
+			deflateEnd(&stream);
+			return -1;
+		}
+		compressed->data = grown;
+		compressed->size = bound;
+	}
+
+	stream.next_in = (Bytef *) page->data;
+	stream.avail_in = page->length;
+	stream.next_out = (Bytef *) compressed->data;
+	stream.avail_out = compressed->size;
+	res = deflate(&stream, Z_FINISH);
+	compressed->length = stream.total_out;
+	deflateEnd(&stream);
+
+	return (res == Z_STREAM_END) ? 0 : -1;
+}
+
+/**
+ * Gets the reason phrase of an HTTP status.
+ *
+ * @param status - the status
+ * @return the reason phrase.
+ */
+const char *
+replay_status_text(int status) {
+	switch (status) {
+		case 200:
+			return "OK";
+		case 302:
+			return "Found";
+		case 304:
+			return "Not Modified";
+		case 404:
+			return "Not Found";
+		case 429:
+			return "Too Many Requests";
+		case 503:
+			return "Service Unavailable";
+		default:
+			return "Internal Server Error";
+	}
+}
+
+/**
+ * Answers the requests of one client until it disconnects. Runs in
+ * its own thread.
+ *
+ * @param arg - the replay_client, freed when done.
+ * @return NULL.
+ */
+void *
+replay_client_run(void *arg) {
+	struct replay_client *client = (struct replay_client *) arg;
+	struct replay_server *server = client->server;
+	struct replay_page page, compressed, *body;
+	struct replay_faults faults;
+	char buffer[REPLAY_HEAD_MAX + 1], head[REPLAY_HEAD_MAX + 1];
+	char method[8], path[REPLAY_HEAD_MAX];
+	char headers[REPLAY_HEADERS_MAX], header[REPLAY_HEADERS_MAX + 256];
+	unsigned long number;
+	size_t padding;
+	unsigned int seed = (unsigned int) client->fd;
+	size_t used = 0;
+	int status, keep_alive, gzipped, delay;
+
+	memset(&page, 0, sizeof(page));
+	memset(&compressed, 0, sizeof(compressed));
+
+	while (replay_read_request(client->fd, buffer, &used, method, path, head, &keep_alive) == 0) {
+		number = __sync_add_and_fetch(&server->requests, 1);
+
+		pthread_mutex_lock(&server->lock);
+		faults = server->faults;
+		padding = server->padding;
+		pthread_mutex_unlock(&server->lock);
+
+		page.length = 0;
+		if (faults.error_every > 0 && number % faults.error_every == 0) {
+			status = faults.error_status;
+			strcpy(headers, "Retry-After: 1\r\n");
+		} else {
+			status = replay_build_page(server, method, path, head, &page, headers);
+		}
+		if (status != 200) {
+			page.length = 0;
+		} else if (replay_pad(&page, padding) != 0) {
+			status = 500;
+			page.length = 0;
+		}
+
+		body = &page;
+		gzipped = 0;
+		if (page.length > 0 && replay_accepts_gzip(head) && replay_gzip(&page, &compressed) == 0) {
+			body = &compressed;
+			gzipped = 1;
+		}
+
+		delay = faults.latency_ms;
+		if (faults.jitter_ms > 0) {
+			delay += rand_r(&seed) % (faults.jitter_ms + 1);
+		}
+		if (delay > 0) {
+			replay_sleep(delay);
+		}
+
+		snprintf(header, sizeof(header),
+			"HTTP/1.1 %d %s\r\nContent-Type: text/html; charset=utf-8\r\n"
+			"Content-Length: %lu\r\n%s%s%s\r\n",
+			status, replay_status_text(status), (unsigned long) body->length,
+			gzipped ? "Content-Encoding: gzip\r\n" : "", headers,
+			keep_alive ? "" : "Connection: close\r\n");
+
+		if (replay_send(client->fd, header, strlen(header)) != 0
+			|| replay_send_body(client->fd, body->data, body->length, &faults) != 0
+			|| !keep_alive) {
+			break;
+		}
+	}
+
+	free(page.data);
+	free(compressed.data);
+	replay_client_done(client);
+	return NULL;
+}
+
+/**
+ * Accepts clients until the server is stopped.
+ *
+ * @param arg - the replay_server.
+ * @return NULL.
+ */
+void *
+replay_accept_run(void *arg) {
+	struct replay_server *server = (struct replay_server *) arg;
+	struct replay_client *client;
+	pthread_t thread;
+	int fd, on = 1;
+
+	for (;;) {
+		fd = accept(server->fd, NULL, NULL);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;
+		}
+
+		/* Headers and bodies are sent separately, do not wait for an ACK
+		   in between */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		client = (struct replay_client *) malloc(sizeof(struct replay_client));
+		if (client == NULL) {
+			close(fd);
+			continue;
+		}
+		client->server = server;
+		client->fd = fd;
+
+		if (replay_client_add(client) != 0) {
+			close(fd);
+			free(client);
+			continue;
+		}
+		if (pthread_create(&thread, NULL, replay_client_run, client) != 0) {
+			replay_client_done(client);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return NULL;
+}
+
+/**
+ * Starts replaying the fixtures on a free loopback port.
+ *
+ * @param fixtures_dir - the directory with listing.html, detail.html
+ *   and login.html
+ * @param images - the number of images the query has, listing pages
+ *   past them are short or empty
+ * @return the server, NULL on error. IMPORTANT: the server must be
+ *   stopped with replay_stop().
+ */
+struct replay_server *
+replay_start(const char *fixtures_dir, int images) {
+	struct replay_server *server;
+	struct sockaddr_in address;
+	socklen_t address_length;
+	char *listing, *thumb_start, *thumb_end;
+	int i;
+
+	server = (struct replay_server *) calloc(1, sizeof(struct replay_server));
+	if (server == NULL) {
+		return NULL;
+	}
+	server->fd = -1;
+	server->images = images;
+	pthread_mutex_init(&server->lock, NULL);
+	pthread_cond_init(&server->clients_done, NULL);
+	for (i = 0; i < REPLAY_CLIENTS_MAX; i++) {
+		server->client_fds[i] = -1;
+	}
+
+	/* Split the listing page around its thumbnail */
+	listing = replay_read_fixture(fixtures_dir, "listing.html");
+	thumb_start = (listing != NULL) ? strstr(listing, THUMB_START) : NULL;
+	thumb_end = (thumb_start != NULL) ? strstr(thumb_start, THUMB_END) : NULL;
+	if (thumb_end != NULL) {
+		server->listing_tail = strdup(thumb_end + strlen(THUMB_END));
+		*thumb_end = '\0';
+		server->listing_thumb = strdup(thumb_start + strlen(THUMB_START));
+		*thumb_start = '\0';
+		server->listing_head = strdup(listing);
+	}
+	free(listing);
+
+	server->detail = replay_read_fixture(fixtures_dir, "detail.html");
+	server->login = replay_read_fixture(fixtures_dir, "login.html");
+	if (server->listing_head == NULL || server->listing_thumb == NULL
+		|| server->listing_tail == NULL || server->detail == NULL || server->login == NULL) {
+
+		replay_stop(server);
+		return NULL;
+	}
+
+	/* Listen on any free port */
+	server->fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	address_length = sizeof(address);
+
+	if (server->fd == -1 || bind(server->fd, (struct sockaddr *) &address, sizeof(address)) == -1
+		|| listen(server->fd, 64) == -1
+		|| getsockname(server->fd, (struct sockaddr *) &address, &address_length) == -1) {
+
+		fprintf(stderr, "replay: unable to listen: %s\n", strerror(errno));
+		replay_stop(server);
+		return NULL;
+	}
+	snprintf(server->base_url, sizeof(server->base_url), "http://127.0.0.1:%d",
+		ntohs(address.sin_port));
+
+	if (pthread_create(&server->thread, NULL, replay_accept_run, server) != 0) {
+		close(server->fd);
+		server->fd = -1;
+		replay_stop(server);
+		return NULL;
+	}
+
+	return server;
+}
+
+/**
+ * Makes a server slow or failing from its next response on.
+ *
+ * @param server - the server
+ * @param faults - how it misbehaves, copied
+ */
+void
+replay_set_faults(struct replay_server *server, const struct replay_faults *faults) {
+	pthread_mutex_lock(&server->lock);
+	server->faults = *faults;
+	pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Makes the pages of a server bigger from its next response on, to
+ * see how page size affects the pipeline.
+ *
+ * @param server - the server
+ * @param bytes - at least how many bytes to add to every page
+ */
+void
+replay_set_padding(struct replay_server *server, size_t bytes) {
+	pthread_mutex_lock(&server->lock);
+	server->padding = bytes;
+	pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * Gets the URL of a server, for --base-url.
+ *
+ * @param server - the server
+ * @return the URL, like http://127.0.0.1:41234.
+ */
+const char *
+replay_base_url(struct replay_server *server) {
+	return server->base_url;
+}
+
+/**
+ * Gets the number of requests a server answered.
+ *
+ * @param server - the server
+ * @return the number of requests.
+ */
+unsigned long
+replay_requests(struct replay_server *server) {
+	return __sync_fetch_and_add(&server->requests, 0);
+}
+
+/**
+ * Stops a server and frees it. Clients that are still connected
+ * are cut off.
+ *
+ * @param server - the server
+ */
+void
+replay_stop(struct replay_server *server) {
+	int i;
+
+	if (server->fd != -1) {
+		shutdown(server->fd, SHUT_RDWR);
+		close(server->fd);
+		pthread_join(server->thread, NULL);
+	}
+
+	/* Wait for the client threads, which use the fixtures */
+	pthread_mutex_lock(&server->lock);
+	for (i = 0; i < REPLAY_CLIENTS_MAX; i++) {
+		if (server->client_fds[i] != -1) {
+			shutdown(server->client_fds[i], SHUT_RDWR);
+		}
+	}
+	while (server->client_count > 0) {
+		pthread_cond_wait(&server->clients_done, &server->lock);
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	pthread_mutex_destroy(&server->lock);
+	pthread_cond_destroy(&server->clients_done);
+	free(server->listing_head);
+	free(server->listing_thumb);
+	free(server->listing_tail);
+	free(server->detail);
+	free(server->login);
+	free(server);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_REPLAY_H
+#define INCLUDED_WB_REPLAY_H
+
+#include <stddef.h>
+
+/* A local HTTP server that replays the recorded wallbase.cc pages in
+   fixtures/. Listing pages get as many thumbnails as they are asked
+   for, numbered from the page offset, and every image page is the
+   recorded one with its own ID. Bodies are gzipped for clients that
+   accept it, image pages can be revalidated with their ETag, and the
+   server can be made slow or failing with replay_set_faults(). */
+struct replay_server;
+
+/* How a server misbehaves, nothing when zeroed */
+struct replay_faults {
+	int latency_ms;              /* wait before every response */
+	int jitter_ms;               /* and up to this much more, at random */
+	int error_status;            /* 429 or 503 for failed requests */
+	int error_every;             /* every Nth request fails, 0 for none */
+	size_t drip_bytes;           /* send bodies this many bytes at a */
+	int drip_ms;                 /* time, with a pause in between */
+};
+
+char *replay_read_fixture(const char *dir, const char *name);
+struct replay_server *replay_start(const char *fixtures_dir, int images);
+void replay_set_faults(struct replay_server *server, const struct replay_faults *faults);
+void replay_set_padding(struct replay_server *server, size_t bytes);
+const char *replay_base_url(struct replay_server *server);
+unsigned long replay_requests(struct replay_server *server);
+void replay_stop(struct replay_server *server);
+
+#endif
@@ -0,0 +1,46 @@
+#!/bin/bash
+#
+# Copyright 2013 Mantas Norvaiša
+# 
+# This file is part of wb.
+# 
+# wb is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# wb is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with wb.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Runs every benchmark and writes their results to the file given as
+# the first argument, one JSON object per line, as well as stdout.
+
+RESULTS=$1
+shift
+
+FAILED=0
+BENCHMARKS=$#
+
+: > "$RESULTS"
+
+for benchfile; do
+	echo "$benchfile" >&2
+	./$benchfile | tee -a "$RESULTS"
+
+	if [ "${PIPESTATUS[0]}" != "0" ]; then
+		FAILED=$(($FAILED + 1))
+	fi
+done
+
+echo >&2
+echo "$BENCHMARKS Benchmark files $FAILED Failures, results in $RESULTS" >&2
+
+if [ "$FAILED" != "0" ]; then
+	exit 1
+fi
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "arena.h"
+#include "mem.h"
+
+/* Alignment of every block handed out by the arena */
+#define WB_ARENA_ALIGN 16
+#define WB_ARENA_ROUND(size) (((size) + WB_ARENA_ALIGN - 1) & ~((size_t) WB_ARENA_ALIGN - 1))
+
+struct wb_arena_chunk {
+	struct wb_arena_chunk *next;
+	size_t size;
+	size_t used;
+};
+
+#define WB_ARENA_CHUNK_HEADER WB_ARENA_ROUND(sizeof(struct wb_arena_chunk))
+
+/*
+ * A bump allocator. Blocks are carved out of large chunks and are
+ * never freed one by one, only all at once with wb_arena_reset().
+ */
+struct wb_arena {
+	struct wb_arena_chunk *chunks;
+	struct wb_arena_chunk *current;
+	size_t chunk_size;
+};
+
+/**
+ * Creates a new, empty arena.
+ *
+ * @param chunk_size - the size of the chunks the arena allocates
+ *   from the system. Blocks bigger than this get a chunk of their
+ *   own.
+ * @return a new arena on success, NULL otherwise. IMPORTANT: the
+ *   returned arena must be freed with wb_arena_free().
+ */
+struct wb_arena *
+wb_arena_new(size_t chunk_size) {
+	struct wb_arena *arena;
+
+	arena = (struct wb_arena *) malloc(sizeof(struct wb_arena));
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	arena->chunks = NULL;
+	arena->current = NULL;
+	arena->chunk_size = WB_ARENA_ROUND(chunk_size);
+
+	return arena;
+}
+
+/**
+ * Allocates a new chunk and appends it to the arena's chunk list.
+ *
+ * @param arena - the arena to add the chunk to
+ * @param size - the usable size of the chunk
+ * @return the new chunk on success, NULL otherwise.
+ */
+struct wb_arena_chunk *
+arena_add_chunk(struct wb_arena *arena, size_t size) {
+	struct wb_arena_chunk *chunk;
+	struct wb_arena_chunk *last;
+
+	chunk = (struct wb_arena_chunk *) wb_mem_malloc(WB_MEM_ARENA, WB_ARENA_CHUNK_HEADER + size);
+	if (chunk == NULL) {
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	if (arena->chunks == NULL) {
+		arena->chunks = chunk;
+	} else {
+		last = (arena->current != NULL) ? arena->current : arena->chunks;
+		while (last->next != NULL) {
+			last = last->next;
+		}
+		last->next = chunk;
+	}
+
+	return chunk;
+}
+
+/**
+ * Allocates a block from the arena. The block is aligned to 16
+ * bytes and stays valid until the arena is reset or freed.
+ *
+ * @param arena - the arena to allocate from
+ * @param size - the size of the block
+ * @return a pointer to the block on success, NULL otherwise.
+ */
+void *
+wb_arena_alloc(struct wb_arena *arena, size_t size) {
+	struct wb_arena_chunk *chunk;
+	void *block;
+
+	size = WB_ARENA_ROUND(size);
+
+	/* Move on through the chunks kept from before the last reset */
+	chunk = arena->current;
+	while (chunk != NULL && chunk->used + size > chunk->size) {
+		chunk = chunk->next;
+	}
+
+	if (chunk == NULL) {
+		chunk = arena_add_chunk(arena,
+			(size > arena->chunk_size) ? size : arena->chunk_size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+	}
+
+	arena->current = chunk;
+	block = (char *) chunk + WB_ARENA_CHUNK_HEADER + chunk->used;
+	chunk->used += size;
+
+	return block;
+}
+
+/**
+ * Releases every block allocated from the arena at once. Chunks of
+ * the standard size are kept for reuse, oversized ones are freed.
+ *
+ * @param arena - the arena to reset
+ */
+void
+wb_arena_reset(struct wb_arena *arena) {
+	struct wb_arena_chunk **link;
+	struct wb_arena_chunk *chunk;
+
+	link = &arena->chunks;
+	while (*link != NULL) {
+		chunk = *link;
+		if (chunk->size > arena->chunk_size) {
+			*link = chunk->next;
+			wb_mem_free(WB_MEM_ARENA, chunk);
+		} else {
+			chunk->used = 0;
+			link = &chunk->next;
+		}
+	}
+
+	arena->current = arena->chunks;
+}
+
+/**
+ * Frees an arena and every block allocated from it.
+ *
+ * @param arena - the arena to free
+ */
+void
+wb_arena_free(struct wb_arena *arena) {
+	struct wb_arena_chunk *chunk;
+	struct wb_arena_chunk *next;
+
+	if (arena == NULL) {
+		return;
+	}
+
+	chunk = arena->chunks;
+	while (chunk != NULL) {
+		next = chunk->next;
+		wb_mem_free(WB_MEM_ARENA, chunk);
+		chunk = next;
+	}
+
+	free(arena);
+}
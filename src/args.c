@@ -70,28 +70,75 @@ static const char *BUG_ADDRESS = "<mntnorv+bugs at gmail dot com>";
 static const char *LONG_HELP = "\
   -a, --aspect=ASPECT        Search for images with this aspect ratio\n\
   -A, --anime, --manga       Search in the Anime / Manga board\n\
+      --base-url=URL         Send requests to URL instead of wallbase.cc, like\n\
+                             a mirror or a server replaying recorded pages\n\
+      --batch=FILE           Run every line of FILE as a separate query, all\n\
+                             in one process. Lines hold options like the\n\
+                             command line, which sets their defaults.\n\
   -c, --color=COLOR          Search for images containing this color\n\
+      --checkpoint=FILE      Journal the listing pages and images done in FILE\n\
+                             as the run goes, so that it can be resumed\n\
+      --deadline=MS          Print the image URLs found in MS milliseconds and\n\
+                             stop, marking the result as partial if it is cut\n\
+                             short\n\
+      --fast-scan            Look for the image URL in the raw HTML of image\n\
+                             pages before parsing them with tidy\n\
   -G, --general              Search in the Wallpapers / General board\n\
   -H, --high-res             Search in the High Resolution board\n\
+      --index=FILE           Record the size, purity, board, color, tags and\n\
+                             favorites of every image found in FILE\n\
+  -j, --jobs=COUNT           Number of pages to download and parse in parallel\n\
+                             (defaults to the number of CPUs)\n\
   -K, --sketchy              Search for sketchy images\n\
+      --merge                Combine the outputs of --shard runs, given as\n\
+                             FILE arguments, into one list in query order\n\
+                             without duplicates\n\
+      --metrics=FILE         Keep request and parse latency histograms and\n\
+                             write them to FILE in the Prometheus text format\n\
+                             after every --watch or --serve query and at exit\n\
   -n, --images=COUNT         Number of images to download\n\
   -N, --nsfw                 Search for NSFW images (requires wallbase.cc login\n\
                              information)\n\
   -o, --collection=ID        Search for images in the specified collection\n\
+      --offline              Answer the query from the --index file instead of\n\
+                             wallbase.cc\n\
   -p, --password=PASSWORD    wallbase.cc password, required for NSFW content\n\
   -P, --show-progress        Show progress information (off by default)\n\
   -q, --query=STRING         Search for images related to this string\n\
   -r, --resolution=RES       Search for images with at least or exactly this\n\
                              resolution\n\
+      --resume               Resume the run journaled in the --checkpoint file\n\
+                             instead of starting over\n\
   -R, --random               Get randomly sorted images. Purity, board,\n\
                              resolution and aspect ratio filters can all be used\n\
                              with this option.\n\
   -s, --sort=SORT            Specify the sort order\n\
+      --serve=SOCKET         Run as a daemon that answers queries sent to the\n\
+                             Unix socket SOCKET, one line of options each\n\
+      --shard=K/N            Get only every Nth listing page, starting with the\n\
+                             Kth, and print each image URL after its position\n\
+                             in the whole query. See --merge.\n\
   -S, --sfw                  Search for SFW images\n\
+      --stats                Print the count, total and p50/p95/p99 times of\n\
+                             every request and parse phase, byte, cache and\n\
+                             allocation counts, and the memory of curl, tidy,\n\
+                             libxml2 and wb to stderr at exit\n\
+      --stream               Print every image URL as soon as it is found and\n\
+                             hold only a few pages at a time, for very large\n\
+                             --images counts\n\
   -t, --toplist=INTERVAL     Get the top images in the specified time interval\n\
+      --trace=FILE           Write a span for every request, parse and lookup\n\
+                             to FILE, in the Chrome trace event format\n\
   -u, --username=USERNAME    wallbase.cc username, required for NSFW content\n\
+  -v, --verbose              Print what is being done to stderr, like the\n\
+                             planned listing page requests\n\
   -h, --help                 Give this help list\n\
       --usage                Give a short usage message\n\
+      --watch=INTERVAL       Keep running and check for new images every\n\
+                             INTERVAL seconds (or minutes or hours with an 'm'\n\
+                             or 'h' suffix). Only new image URLs are printed.\n\
+      --xml-arena            Allocate libxml2 memory for each page from a\n\
+                             per-thread arena, released in one shot\n\
   -V, --version              Print program version\n\
 \n\
 Mandatory or optional arguments to long options are also mandatory or optional\n\
@@ -101,10 +148,12 @@ for any corresponding short options.";
  * Formats
  **************************************************/
 
-static const char *FORMAT_SHORT_USAGE = "Usage: %s [OPTION...]";
+static const char *FORMAT_SHORT_USAGE = "Usage: %s [OPTION...]\n  or:  %s --merge FILE...";
 static const char *FORMAT_LONG_USAGE = "\
-Usage: %s [-AGHKNPRShV] [-a ASPECT] [-c COLOR] [-n COUNT] [-o ID] [-p PASSWORD]\n\
-            [-q STRING] [-r RES] [-s SORT] [-t INTERVAL] [-u USERNAME]\n";
+Usage: %s [-AGHKNPRShvV] [-a ASPECT] [-c COLOR] [-j COUNT] [-n COUNT] [-o ID]\n\
+            [-p PASSWORD] [-q STRING] [-r RES] [-s SORT] [-t INTERVAL]\n\
+            [-u USERNAME]\n\
+  or:  %s --merge FILE...\n";
 
 static const char *FORMAT_SHORT_HELP = "Try '%s --help' or '%s --usage' for more information.";
 
@@ -118,11 +167,12 @@ There is NO WARRANTY, to the extent permitted by law.\n";
  * getopt specific vars
  **************************************************/
 
-static const char *GETOPT_SHORT_OPTIONS = "a:c:n:o:p:q:r:s:t:u:AGHKNPRShV";
+static const char *GETOPT_SHORT_OPTIONS = "a:c:j:n:o:p:q:r:s:t:u:AGHKNPRShvV";
 static struct option GETOPT_LONG_OPTIONS[] = {
 	/* Options with arguments */
 	{"aspect",        required_argument, 0, 'a'},
 	{"color",         required_argument, 0, 'c'},
+	{"jobs",          required_argument, 0, 'j'},
 	{"images",        required_argument, 0, 'n'},
 	{"collection",    required_argument, 0, 'o'},
 	{"password",      required_argument, 0, 'p'},
@@ -142,11 +192,29 @@ static struct option GETOPT_LONG_OPTIONS[] = {
 	{"show-progress", no_argument,       0, 'P'},
 	{"random",        no_argument,       0, 'R'},
 	{"sfw",           no_argument,       0, 'S'},
+	{"verbose",       no_argument,       0, 'v'},
 	{"help",          no_argument,       0, 'h'},
 	{"version",       no_argument,       0, 'V'},
 
 	/* Long-only options */
 	{"usage",         no_argument,       0, WB_KEY_USAGE},
+	{"batch",         required_argument, 0, WB_KEY_BATCH},
+	{"serve",         required_argument, 0, WB_KEY_SERVE},
+	{"watch",         required_argument, 0, WB_KEY_WATCH},
+	{"index",         required_argument, 0, WB_KEY_INDEX},
+	{"offline",       no_argument,       0, WB_KEY_OFFLINE},
+	{"checkpoint",    required_argument, 0, WB_KEY_CHECKPOINT},
+	{"resume",        no_argument,       0, WB_KEY_RESUME},
+	{"shard",         required_argument, 0, WB_KEY_SHARD},
+	{"merge",         no_argument,       0, WB_KEY_MERGE},
+	{"stats",         no_argument,       0, WB_KEY_STATS},
+	{"trace",         required_argument, 0, WB_KEY_TRACE},
+	{"metrics",       required_argument, 0, WB_KEY_METRICS},
+	{"base-url",      required_argument, 0, WB_KEY_BASE_URL},
+	{"stream",        no_argument,       0, WB_KEY_STREAM},
+	{"deadline",      required_argument, 0, WB_KEY_DEADLINE},
+	{"fast-scan",     no_argument,       0, WB_KEY_FAST_SCAN},
+	{"xml-arena",     no_argument,       0, WB_KEY_XML_ARENA},
 	{0}
 };
 
@@ -171,7 +239,7 @@ invalid_arg_error(char *name, char *arg) {
  */
 void
 print_full_help() {
-	printf(FORMAT_SHORT_USAGE, APP_INVOKE_NAME);
+	printf(FORMAT_SHORT_USAGE, APP_INVOKE_NAME, APP_INVOKE_NAME);
 	printf("\n%s\n\n%s\n\n", ABOUT, LONG_HELP);
 	printf("Report bugs to %s\n", BUG_ADDRESS);
 }
@@ -181,7 +249,7 @@ print_full_help() {
  */
 void
 print_full_usage() {
-	printf(FORMAT_LONG_USAGE, APP_INVOKE_NAME);
+	printf(FORMAT_LONG_USAGE, APP_INVOKE_NAME, APP_INVOKE_NAME);
 }
 
 /**
@@ -327,6 +395,162 @@ parse_image_number(char *arg, struct options *options) {
 	return 0;
 }
 
+/**
+ * Parses the number of parse jobs from a string.
+ *
+ * @param arg - a string containing a number. The number must
+ *   be greater than 0.
+ * @param options - a pointer to an options struct.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+parse_jobs_number(char *arg, struct options *options) {
+	int num;
+	char *num_end;
+
+	num = strtol(arg, &num_end, 10);
+	if (arg + strlen(arg) != num_end || num <= 0) {
+		return -1;
+	} else {
+		options->jobs = num;
+	}
+
+	return 0;
+}
+
+/**
+ * Parses the deadline of the run from a string.
+ *
+ * @param arg - a string containing a number of milliseconds. The
+ *   number must be greater than 0.
+ * @param options - a pointer to an options struct.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+parse_deadline(char *arg, struct options *options) {
+	int num;
+	char *num_end;
+
+	num = strtol(arg, &num_end, 10);
+	if (arg + strlen(arg) != num_end || num <= 0) {
+		return -1;
+	} else {
+		options->deadline_ms = num;
+	}
+
+	return 0;
+}
+
+/**
+ * Parses the watch interval from a string.
+ *
+ * @param arg - a string containing a number of seconds greater
+ *   than 0, optionally followed by 's', 'm' or 'h' for seconds,
+ *   minutes or hours.
+ * @param options - a pointer to an options struct.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+parse_watch_interval(char *arg, struct options *options) {
+	int num;
+	char *num_end;
+
+	num = strtol(arg, &num_end, 10);
+	if (num_end == arg || num <= 0) {
+		return -1;
+	}
+
+	if (*num_end == 'm') {
+		num *= 60;
+		num_end++;
+	} else if (*num_end == 'h') {
+		num *= 60 * 60;
+		num_end++;
+	} else if (*num_end == 's') {
+		num_end++;
+	}
+
+	if (*num_end != '\0') {
+		return -1;
+	}
+
+	options->watch_interval = num;
+	return 0;
+}
+
+/**
+ * Parses the shard of a query to get from a string.
+ *
+ * @param arg - a string containing a shard. Format <number>/<number>,
+ *   the shard from 1 up to the number of shards.
+ * @param options - a pointer to an options struct.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+parse_shard(char *arg, struct options *options) {
+	int index, count;
+	char *temp_arg, *num_end;
+
+	temp_arg = arg;
+
+	/* Try to read the shard */
+	index = strtol(temp_arg, &num_end, 10);
+	if (num_end == temp_arg || index <= 0) {
+		return -1;
+	} else {
+		temp_arg = num_end;
+	}
+
+	/* Check if there's a '/' between the numbers */
+	if (temp_arg[0] != '/') {
+		return -1;
+	} else {
+		temp_arg++;
+	}
+
+	/* Try to read the number of shards */
+	count = strtol(temp_arg, &num_end, 10);
+	if (temp_arg + strlen(temp_arg) != num_end || count < index) {
+		return -1;
+	}
+
+	options->shard_index = index - 1;
+	options->shard_count = count;
+	return 0;
+}
+
+/**
+ * Parses the URL requests are sent to instead of wallbase.cc.
+ *
+ * @param arg - an http:// or https:// URL without a path, like
+ *   http://127.0.0.1:8080. A trailing '/' is removed.
+ * @param options - a pointer to an options struct.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+parse_base_url(char *arg, struct options *options) {
+	size_t length;
+	char *host;
+
+	if (strncmp(arg, "http://", 7) != 0 && strncmp(arg, "https://", 8) != 0) {
+		return -1;
+	}
+
+	length = strlen(arg);
+	if (arg[length - 1] == '/') {
+		arg[--length] = '\0';
+	}
+
+	/* Only a host and a port, paths are wallbase.cc's */
+	host = strstr(arg, "//") + 2;
+	if (length > WB_BASE_URL_MAX || *host == '\0' || strchr(host, '/') != NULL) {
+		return -1;
+	}
+
+	options->base_url = arg;
+	return 0;
+}
+
 /**
  * Parses a resolution from a string.
  *
@@ -464,6 +688,12 @@ parse_opt(int key, char *arg, struct options *options) {
 				return -1;
 			}
 			break;
+		case 'j': /* number of parse jobs */
+			if (parse_jobs_number(arg, options) == -1) {
+				invalid_arg_error("number of jobs", arg);
+				return -1;
+			}
+			break;
 		case 'n': /* number of images */
 			if (parse_image_number(arg, options) == -1) {
 				invalid_arg_error("number of images", arg);
@@ -512,6 +742,9 @@ parse_opt(int key, char *arg, struct options *options) {
 		case 'R':
 			options->flags |= WB_FLAG_RANDOM;
 			break;
+		case 'v':
+			options->flags |= WB_FLAG_VERBOSE;
+			break;
 		case 'S': /* SFW */
 			options->purity |= WB_PURITY_SFW;
 			break;
@@ -531,6 +764,72 @@ parse_opt(int key, char *arg, struct options *options) {
 			options->boards |= WB_BOARD_HIGHRES;
 			break;
 
+		/* Long-only options */
+
+		case WB_KEY_BATCH:
+			options->batch_file = arg;
+			break;
+		case WB_KEY_SERVE:
+			options->serve_socket = arg;
+			break;
+		case WB_KEY_WATCH:
+			if (parse_watch_interval(arg, options) == -1) {
+				invalid_arg_error("watch interval", arg);
+				return -1;
+			}
+			break;
+		case WB_KEY_INDEX:
+			options->index_file = arg;
+			break;
+		case WB_KEY_OFFLINE:
+			options->flags |= WB_FLAG_OFFLINE;
+			break;
+		case WB_KEY_CHECKPOINT:
+			options->checkpoint_file = arg;
+			break;
+		case WB_KEY_RESUME:
+			options->flags |= WB_FLAG_RESUME;
+			break;
+		case WB_KEY_SHARD:
+			if (parse_shard(arg, options) == -1) {
+				invalid_arg_error("shard", arg);
+				return -1;
+			}
+			break;
+		case WB_KEY_MERGE:
+			options->flags |= WB_FLAG_MERGE;
+			break;
+		case WB_KEY_STATS:
+			options->flags |= WB_FLAG_STATS;
+			break;
+		case WB_KEY_TRACE:
+			options->trace_file = arg;
+			break;
+		case WB_KEY_METRICS:
+			options->metrics_file = arg;
+			break;
+		case WB_KEY_BASE_URL:
+			if (parse_base_url(arg, options) == -1) {
+				invalid_arg_error("base URL", arg);
+				return -1;
+			}
+			break;
+		case WB_KEY_STREAM:
+			options->stream = 1;
+			break;
+		case WB_KEY_DEADLINE:
+			if (parse_deadline(arg, options) == -1) {
+				invalid_arg_error("deadline", arg);
+				return -1;
+			}
+			break;
+		case WB_KEY_FAST_SCAN:
+			options->fast_scan = 1;
+			break;
+		case WB_KEY_XML_ARENA:
+			options->flags |= WB_FLAG_XML_ARENA;
+			break;
+
 		/* Help, usage, errors */
 
 		case 'h': /* help */
@@ -552,6 +851,34 @@ parse_opt(int key, char *arg, struct options *options) {
 	return 0;
 }
 
+/**
+ * Parses a list of options, like the ones in a batch file line,
+ * without exiting on errors. getopt's state is reset first, so it
+ * can be called more than once.
+ *
+ * @param argc - argument count
+ * @param argv - array of arguments, argv[0] is not parsed
+ * @param options - the option structure
+ * @return 0 on success, -1 if an option was invalid or the help,
+ *   usage or version was printed.
+ */
+int
+wb_parse_arg_list(int argc, char *argv[], struct options *options) {
+	int key, option_index;
+
+	optind = 0;
+
+	while ((key = getopt_long(argc, argv, GETOPT_SHORT_OPTIONS,
+		GETOPT_LONG_OPTIONS, &option_index)) != -1) {
+
+		if (parse_opt(key, optarg, options) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Parses all command line options.
  *
@@ -563,17 +890,11 @@ parse_opt(int key, char *arg, struct options *options) {
  */
 void
 wb_parse_args(int argc, char *argv[], struct options *options) {
-	int key, option_index;
-
 	/* Set app invoke name */
 	APP_INVOKE_NAME = basename(argv[0]);
 
 	/* Parse args */
-	while ((key = getopt_long(argc, argv, GETOPT_SHORT_OPTIONS,
-		GETOPT_LONG_OPTIONS, &option_index)) != -1) {
-
-		if (parse_opt(key, optarg, options) != 0) {
-			exit(1);
-		}
+	if (wb_parse_arg_list(argc, argv, options) != 0) {
+		exit(1);
 	}
 }
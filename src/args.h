@@ -22,6 +22,7 @@
 
 #include "types.h"
 
+int wb_parse_arg_list(int argc, char *argv[], struct options *options);
 void wb_parse_args(int argc, char *argv[], struct options *options);
 
 #endif
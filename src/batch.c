@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "types.h"
+#include "args.h"
+#include "batch.h"
+#include "error.h"
+#include "str_list.h"
+
+/* argv[0] of batch queries, never parsed */
+static char *BATCH_ARGV0 = "wb";
+
+/**
+ * Splits a batch file line into arguments, in place. Arguments are
+ * separated by whitespace. Single and double quotes group
+ * whitespace into an argument, a backslash outside single quotes
+ * escapes the next character.
+ *
+ * @param line - the line to split. It is modified and the arguments
+ *   point into it.
+ * @param argv - where to store the arguments, argv[0] is set to
+ *   "wb". Must have room for strlen(line) / 2 + 3 pointers.
+ * @return the number of arguments including argv[0], or -1 if a
+ *   quote is not closed.
+ */
+int
+batch_split_line(char *line, char **argv) {
+	char *read = line;
+	char *write;
+	char quote;
+	int argc = 0;
+
+	argv[argc++] = BATCH_ARGV0;
+
+	for (;;) {
+		while (*read == ' ' || *read == '\t' || *read == '\r' || *read == '\n') {
+			read++;
+		}
+		if (*read == '\0') {
+			break;
+		}
+
+		/* Arguments only shrink, so they are written over the line */
+		argv[argc++] = write = read;
+		quote = '\0';
+
+		while (*read != '\0') {
+			if (quote == '\0' && (*read == ' ' || *read == '\t' || *read == '\r' || *read == '\n')) {
+				read++;
+				break;
+			}
+
+			if (quote == '\0' && (*read == '\'' || *read == '"')) {
+				quote = *read++;
+			} else if (quote != '\0' && *read == quote) {
+				quote = '\0';
+				read++;
+			} else if (quote != '\'' && *read == '\\' && read[1] != '\0') {
+				*write++ = read[1];
+				read += 2;
+			} else {
+				*write++ = *read++;
+			}
+		}
+
+		if (quote != '\0') {
+			return -1;
+		}
+
+		*write = '\0';
+	}
+
+	argv[argc] = NULL;
+
+	return argc;
+}
+
+/**
+ * Checks if a batch file line holds no query.
+ *
+ * @param line - the line
+ * @return 1 if the line is empty or a comment, 0 otherwise.
+ */
+int
+wb_batch_is_blank_line(const char *line) {
+	while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n') {
+		line++;
+	}
+
+	return *line == '\0' || *line == '#';
+}
+
+/**
+ * Parses a batch file line into a query. getopt is not reentrant,
+ * so only one thread may parse at a time.
+ *
+ * @param query - the query to fill in. query->line and query->text
+ *   must be set.
+ * @param defaults - the options the query starts from
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_batch_parse_query(struct wb_batch_query *query, const struct options *defaults) {
+	query->argv = (char **) malloc((strlen(query->text) / 2 + 3) * sizeof(char *));
+	if (query->argv == NULL) {
+		return -1;
+	}
+
+	query->argc = batch_split_line(query->text, query->argv);
+	if (query->argc == -1) {
+		wb_error("batch line %d: unterminated quote", query->line);
+		return -1;
+	}
+
+	query->options = *defaults;
+	query->options.batch_file = NULL;
+	query->options.serve_socket = NULL;
+	query->options.watch_interval = 0;
+
+	if (wb_parse_arg_list(query->argc, query->argv, &query->options) != 0) {
+		wb_error("batch line %d: invalid options", query->line);
+		return -1;
+	}
+
+	if (query->options.batch_file != NULL || query->options.serve_socket != NULL
+		|| query->options.watch_interval != 0 || query->options.checkpoint_file != NULL
+		|| query->options.shard_count != 0 || (query->options.flags & WB_FLAG_MERGE) > 0
+		|| query->options.base_url != defaults->base_url || query->options.stream != 0) {
+		wb_error("batch line %d: --batch, --serve, --watch, --checkpoint, --shard, --merge, --base-url and --stream can not be used here",
+			query->line);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Reads and parses a batch file. Every line that is not empty or a
+ * comment becomes a query.
+ *
+ * @param path - the path of the batch file
+ * @param defaults - the options every query starts from
+ * @return the batch on success, NULL otherwise. IMPORTANT: the
+ *   returned batch must be freed with wb_batch_free().
+ */
+struct wb_batch *
+wb_batch_read(const char *path, const struct options *defaults) {
+	struct wb_batch *batch;
+	struct wb_batch_query *queries, *query;
+	FILE *file;
+	char *line = NULL;
+	size_t line_size = 0;
+	int capacity = 0;
+	int line_number = 0;
+	int failed = 0;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		wb_error("unable to open batch file '%s': %s", path, strerror(errno));
+		return NULL;
+	}
+
+	batch = (struct wb_batch *) calloc(1, sizeof(struct wb_batch));
+	if (batch == NULL) {
+		fclose(file);
+		return NULL;
+	}
+
+	while (getline(&line, &line_size, file) != -1) {
+		line_number++;
+		if (wb_batch_is_blank_line(line)) {
+			continue;
+		}
+
+		if (batch->count == capacity) {
+			capacity = capacity > 0 ? capacity * 2 : 16;
+			queries = (struct wb_batch_query *) realloc(batch->queries,
+				capacity * sizeof(struct wb_batch_query));
+			if (queries == NULL) {
+				failed = 1;
+				break;
+			}
+			batch->queries = queries;
+		}
+
+		query = &batch->queries[batch->count++];
+		memset(query, 0, sizeof(struct wb_batch_query));
+		query->line = line_number;
+		query->text = strdup(line);
+
+		if (query->text == NULL || wb_batch_parse_query(query, defaults) != 0) {
+			failed = 1;
+			break;
+		}
+	}
+
+	free(line);
+
+	/* Every line must be read and parsed */
+	if (failed || ferror(file)) {
+		fclose(file);
+		wb_batch_free(batch);
+		return NULL;
+	}
+	fclose(file);
+
+	return batch;
+}
+
+/**
+ * Frees what a query owns, but not the query itself.
+ *
+ * @param query - the query
+ */
+void
+wb_batch_query_free(struct wb_batch_query *query) {
+	free(query->text);
+	free(query->argv);
+	wb_list_free(query->image_urls);
+}
+
+/**
+ * Frees a batch and the results of its queries.
+ *
+ * @param batch - the batch to free
+ */
+void
+wb_batch_free(struct wb_batch *batch) {
+	int i;
+
+	for (i = 0; i < batch->count; i++) {
+		wb_batch_query_free(&batch->queries[i]);
+	}
+
+	free(batch->queries);
+	free(batch);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_BATCH_H
+#define INCLUDED_WB_BATCH_H
+
+#include "types.h"
+
+/* A query from a batch file */
+struct wb_batch_query {
+	int line;                      /* line number in the batch file */
+	char *text;                    /* the line, arguments point into it */
+	char **argv;
+	int argc;
+	struct options options;
+	struct wb_str_list *image_urls;
+	int failed;
+};
+
+struct wb_batch {
+	struct wb_batch_query *queries;
+	int count;
+};
+
+int wb_batch_is_blank_line(const char *line);
+int wb_batch_parse_query(struct wb_batch_query *query, const struct options *defaults);
+void wb_batch_query_free(struct wb_batch_query *query);
+struct wb_batch *wb_batch_read(const char *path, const struct options *defaults);
+void wb_batch_free(struct wb_batch *batch);
+
+#endif
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "error.h"
+
+/* Journal line types */
+#define JOURNAL_QUERY  'Q'             /* Q <query id> */
+#define JOURNAL_PAGE   'P'             /* P <offset> <image page URL>... */
+#define JOURNAL_IMAGE  'I'             /* I <image page URL> <image URL> */
+
+/**
+ * Compares resumed listing pages by offset.
+ */
+int
+checkpoint_compare_pages(const void *a, const void *b) {
+	const struct wb_checkpoint_page *x = (const struct wb_checkpoint_page *) a;
+	const struct wb_checkpoint_page *y = (const struct wb_checkpoint_page *) b;
+
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * Compares resolved image pages by URL.
+ */
+int
+checkpoint_compare_images(const void *a, const void *b) {
+	const struct wb_checkpoint_image *x = (const struct wb_checkpoint_image *) a;
+	const struct wb_checkpoint_image *y = (const struct wb_checkpoint_image *) b;
+
+	return strcmp(x->page_url, y->page_url);
+}
+
+/**
+ * Splits a journal line into tab separated fields in place.
+ *
+ * @param line - the line, without the line break
+ * @param fields - where to store the fields
+ * @param max - the maximum number of fields
+ * @return the number of fields.
+ */
+int
+checkpoint_split_line(char *line, char **fields, int max) {
+	int count = 0;
+	char *tab;
+
+	while (count < max) {
+		fields[count++] = line;
+		tab = strchr(line, '\t');
+		if (tab == NULL) {
+			break;
+		}
+		*tab = '\0';
+		line = tab + 1;
+	}
+
+	return count;
+}
+
+/**
+ * Reads what an earlier run had done from its journal. Lines are
+ * only used if they are complete, so a run that was killed while
+ * writing a line loses just that line.
+ *
+ * @param checkpoint - the checkpoint to fill in
+ * @param file - the journal
+ * @param query_id - the query the journal must be for
+ * @return 0 on success, -1 if the journal is for a different query
+ *   or could not be read.
+ */
+int
+checkpoint_read_journal(struct wb_checkpoint *checkpoint, FILE *file, const char *query_id) {
+	char *line = NULL;
+	char **fields = NULL;
+	size_t line_size = 0;
+	size_t pages_size = 0, images_size = 0;
+	ssize_t length;
+	int field_count, status, i;
+	void *grown;
+
+	status = 0;
+	while ((length = getline(&line, &line_size, file)) != -1) {
+		if (line[length - 1] != '\n') {
+			break;
+		}
+		line[length - 1] = '\0';
+
+		/* The first line says which query the journal is for */
+		if (line[0] == JOURNAL_QUERY && line[1] == '\t') {
+			if (strcmp(line + 2, query_id) != 0) {
+				status = -1;
+				break;
+			}
+			continue;
+		}
+
+		grown = realloc(fields, (length + 1) * sizeof(char *));
+		if (grown == NULL) {
+			status = -1;
+			break;
+		}
+		fields = (char **) grown;
+		field_count = checkpoint_split_line(line, fields, length + 1);
+
+		if (fields[0][0] == JOURNAL_PAGE && field_count >= 2) {
+			if (checkpoint->page_count == pages_size) {
+				pages_size = (pages_size > 0) ? pages_size * 2 : 64;
+				grown = realloc(checkpoint->pages, pages_size * sizeof(struct wb_checkpoint_page));
+				if (grown == NULL) {
+					status = -1;
+					break;
+				}
+				checkpoint->pages = (struct wb_checkpoint_page *) grown;
+			}
+
+			checkpoint->pages[checkpoint->page_count].offset = atoi(fields[1]);
+			checkpoint->pages[checkpoint->page_count].urls = NULL;
+			for (i = field_count - 1; i >= 2; i--) {
+				checkpoint->pages[checkpoint->page_count].urls = wb_list_prepend(
+					checkpoint->pages[checkpoint->page_count].urls, fields[i]);
+			}
+			checkpoint->page_count++;
+		} else if (fields[0][0] == JOURNAL_IMAGE && field_count == 3) {
+			if (checkpoint->image_count == images_size) {
+				images_size = (images_size > 0) ? images_size * 2 : 256;
+				grown = realloc(checkpoint->images, images_size * sizeof(struct wb_checkpoint_image));
+				if (grown == NULL) {
+					status = -1;
+					break;
+				}
+				checkpoint->images = (struct wb_checkpoint_image *) grown;
+			}
+
+			checkpoint->images[checkpoint->image_count].page_url = strdup(fields[1]);
+			checkpoint->images[checkpoint->image_count].image_url = strdup(fields[2]);
+			checkpoint->image_count++;
+		}
+	}
+
+	free(fields);
+	free(line);
+
+	qsort(checkpoint->pages, checkpoint->page_count, sizeof(struct wb_checkpoint_page),
+		checkpoint_compare_pages);
+	qsort(checkpoint->images, checkpoint->image_count, sizeof(struct wb_checkpoint_image),
+		checkpoint_compare_images);
+
+	return status;
+}
+
+/**
+ * Opens the journal of a run. A new run starts a new journal; a
+ * resumed run first reads what was done and then keeps appending
+ * to the same journal.
+ *
+ * @param path - the path of the journal
+ * @param query_id - identifies the query, so that a journal is not
+ *   resumed by a different one
+ * @param resume - 1 to resume the run in the journal, if there is one
+ * @return the checkpoint on success, NULL otherwise. IMPORTANT: the
+ *   returned checkpoint must be closed with wb_checkpoint_close().
+ */
+struct wb_checkpoint *
+wb_checkpoint_open(const char *path, const char *query_id, int resume) {
+	struct wb_checkpoint *checkpoint;
+	FILE *file = NULL;
+	int last;
+
+	checkpoint = (struct wb_checkpoint *) calloc(1, sizeof(struct wb_checkpoint));
+	if (checkpoint == NULL) {
+		return NULL;
+	}
+
+	if (resume) {
+		file = fopen(path, "r");
+	}
+
+	if (file != NULL) {
+		if (checkpoint_read_journal(checkpoint, file, query_id) != 0) {
+			wb_error("checkpoint %s is for a different query", path);
+			fclose(file);
+			wb_checkpoint_close(checkpoint);
+			return NULL;
+		}
+
+		/* Appended lines must not continue a line cut short */
+		last = '\n';
+		if (fseek(file, -1, SEEK_END) == 0) {
+			last = getc(file);
+		}
+		fclose(file);
+
+		checkpoint->journal = fopen(path, "a");
+		if (checkpoint->journal != NULL && last != '\n') {
+			putc('\n', checkpoint->journal);
+		}
+	} else {
+		checkpoint->journal = fopen(path, "w");
+		if (checkpoint->journal != NULL) {
+			fprintf(checkpoint->journal, "%c\t%s\n", JOURNAL_QUERY, query_id);
+		}
+	}
+
+	if (checkpoint->journal == NULL) {
+		wb_error("unable to open checkpoint %s", path);
+		wb_checkpoint_close(checkpoint);
+		return NULL;
+	}
+
+	return checkpoint;
+}
+
+/**
+ * Finds a listing page an earlier run had parsed.
+ *
+ * @param checkpoint - the checkpoint
+ * @param offset - the offset of the page
+ * @return the page, or NULL if it was not parsed.
+ */
+const struct wb_checkpoint_page *
+wb_checkpoint_find_page(const struct wb_checkpoint *checkpoint, int offset) {
+	struct wb_checkpoint_page key;
+
+	key.offset = offset;
+	return (const struct wb_checkpoint_page *) bsearch(&key, checkpoint->pages,
+		checkpoint->page_count, sizeof(struct wb_checkpoint_page), checkpoint_compare_pages);
+}
+
+/**
+ * Finds the image URL of an image page an earlier run had resolved.
+ *
+ * @param checkpoint - the checkpoint
+ * @param page_url - the URL of the image page
+ * @return the image URL, or NULL if it was not resolved.
+ */
+const char *
+wb_checkpoint_find_image(const struct wb_checkpoint *checkpoint, const char *page_url) {
+	struct wb_checkpoint_image key, *image;
+
+	key.page_url = (char *) page_url;
+	image = (struct wb_checkpoint_image *) bsearch(&key, checkpoint->images,
+		checkpoint->image_count, sizeof(struct wb_checkpoint_image), checkpoint_compare_images);
+
+	return (image != NULL) ? image->image_url : NULL;
+}
+
+/**
+ * Journals a parsed listing page. It is written out with the next
+ * wb_checkpoint_sync().
+ *
+ * @param checkpoint - the checkpoint
+ * @param offset - the offset of the page
+ * @param urls - the image page URLs on the page
+ */
+void
+wb_checkpoint_add_page(struct wb_checkpoint *checkpoint, int offset, struct wb_str_list *urls) {
+	fprintf(checkpoint->journal, "%c\t%d", JOURNAL_PAGE, offset);
+	for (; urls != NULL; urls = urls->next) {
+		fprintf(checkpoint->journal, "\t%s", urls->str);
+	}
+	putc('\n', checkpoint->journal);
+}
+
+/**
+ * Journals a resolved image page. It is written out with the next
+ * wb_checkpoint_sync().
+ *
+ * @param checkpoint - the checkpoint
+ * @param page_url - the URL of the image page
+ * @param image_url - the URL of its image
+ */
+void
+wb_checkpoint_add_image(struct wb_checkpoint *checkpoint, const char *page_url, const char *image_url) {
+	fprintf(checkpoint->journal, "%c\t%s\t%s\n", JOURNAL_IMAGE, page_url, image_url);
+}
+
+/**
+ * Writes everything journaled so far to disk.
+ *
+ * @param checkpoint - the checkpoint
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_checkpoint_sync(struct wb_checkpoint *checkpoint) {
+	if (fflush(checkpoint->journal) != 0 || fsync(fileno(checkpoint->journal)) != 0) {
+		wb_error("unable to write checkpoint");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes out and closes a checkpoint's journal and frees it.
+ *
+ * @param checkpoint - the checkpoint to close
+ */
+void
+wb_checkpoint_close(struct wb_checkpoint *checkpoint) {
+	size_t i;
+
+	if (checkpoint == NULL) {
+		return;
+	}
+
+	if (checkpoint->journal != NULL) {
+		wb_checkpoint_sync(checkpoint);
+		fclose(checkpoint->journal);
+	}
+
+	for (i = 0; i < checkpoint->page_count; i++) {
+		wb_list_free(checkpoint->pages[i].urls);
+	}
+	free(checkpoint->pages);
+
+	for (i = 0; i < checkpoint->image_count; i++) {
+		free(checkpoint->images[i].page_url);
+		free(checkpoint->images[i].image_url);
+	}
+	free(checkpoint->images);
+
+	free(checkpoint);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_CHECKPOINT_H
+#define INCLUDED_WB_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "str_list.h"
+
+/* A listing page that was already parsed */
+struct wb_checkpoint_page {
+	int offset;
+	struct wb_str_list *urls;      /* its image page URLs */
+};
+
+/* An image page that was already resolved */
+struct wb_checkpoint_image {
+	char *page_url;
+	char *image_url;
+};
+
+/* The journal of a run and what an earlier run had done */
+struct wb_checkpoint {
+	FILE *journal;
+	struct wb_checkpoint_page *pages;   /* sorted by offset */
+	size_t page_count;
+	struct wb_checkpoint_image *images; /* sorted by page_url */
+	size_t image_count;
+};
+
+struct wb_checkpoint *wb_checkpoint_open(const char *path, const char *query_id, int resume);
+const struct wb_checkpoint_page *wb_checkpoint_find_page(const struct wb_checkpoint *checkpoint, int offset);
+const char *wb_checkpoint_find_image(const struct wb_checkpoint *checkpoint, const char *page_url);
+void wb_checkpoint_add_page(struct wb_checkpoint *checkpoint, int offset, struct wb_str_list *urls);
+void wb_checkpoint_add_image(struct wb_checkpoint *checkpoint, const char *page_url, const char *image_url);
+int wb_checkpoint_sync(struct wb_checkpoint *checkpoint);
+void wb_checkpoint_close(struct wb_checkpoint *checkpoint);
+
+#endif
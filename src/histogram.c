@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "histogram.h"
+
+/**
+ * Finds the bucket of a value.
+ *
+ * @param value - the value
+ * @return the index of the bucket. Values past the last bucket are
+ *   put in it.
+ */
+int
+wb_histogram_bucket(unsigned long value) {
+	int half = WB_HISTOGRAM_SUB_BUCKETS / 2;
+	int shift, bucket;
+
+	if (value < WB_HISTOGRAM_SUB_BUCKETS) {
+		return (int) value;
+	}
+
+	/* The shift that leaves value in [half, WB_HISTOGRAM_SUB_BUCKETS) */
+	shift = (int) (sizeof(unsigned long) * 8) - __builtin_clzl(value) - 6;
+	bucket = WB_HISTOGRAM_SUB_BUCKETS + (shift - 1) * half + (int) (value >> shift) - half;
+
+	return bucket < WB_HISTOGRAM_BUCKETS ? bucket : WB_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * Finds the largest value of a bucket.
+ *
+ * @param bucket - the index of the bucket
+ * @return the largest value that is put in the bucket.
+ */
+unsigned long
+wb_histogram_bucket_max(int bucket) {
+	int half = WB_HISTOGRAM_SUB_BUCKETS / 2;
+	unsigned long sub;
+	int shift;
+
+	if (bucket < WB_HISTOGRAM_SUB_BUCKETS) {
+		return (unsigned long) bucket;
+	}
+
+	shift = (bucket - WB_HISTOGRAM_SUB_BUCKETS) / half + 1;
+	sub = (unsigned long) ((bucket - WB_HISTOGRAM_SUB_BUCKETS) % half + half);
+
+	return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * Records a value.
+ *
+ * @param histogram - the histogram
+ * @param value - the value
+ */
+void
+wb_histogram_record(struct wb_histogram *histogram, unsigned long value) {
+	__sync_fetch_and_add(&histogram->counts[wb_histogram_bucket(value)], 1);
+	__sync_fetch_and_add(&histogram->sum, value);
+	__sync_fetch_and_add(&histogram->count, 1);
+}
+
+/**
+ * Counts the recorded values up to a value, to within the precision
+ * of the buckets. A bucket is counted if all of its values are up to
+ * value.
+ *
+ * @param histogram - the histogram
+ * @param value - the largest value to count
+ * @return the number of values.
+ */
+unsigned long
+wb_histogram_count_upto(struct wb_histogram *histogram, unsigned long value) {
+	unsigned long count = 0;
+	int i;
+
+	for (i = 0; i < WB_HISTOGRAM_BUCKETS && wb_histogram_bucket_max(i) <= value; i++) {
+		count += __sync_fetch_and_add(&histogram->counts[i], 0);
+	}
+
+	return count;
+}
+
+/**
+ * Finds a percentile of the recorded values by nearest rank, to
+ * within the precision of the buckets.
+ *
+ * @param histogram - the histogram
+ * @param percentile - the percentile, from 1 to 100
+ * @return the middle of the bucket the percentile is in, 0 if
+ *   nothing was recorded.
+ */
+unsigned long
+wb_histogram_percentile(struct wb_histogram *histogram, int percentile) {
+	unsigned long count, rank, upto = 0, low = 0;
+	int i;
+
+	count = __sync_fetch_and_add(&histogram->count, 0);
+	if (count == 0) {
+		return 0;
+	}
+	rank = (percentile * count + 99) / 100;
+
+	for (i = 0; i < WB_HISTOGRAM_BUCKETS - 1; i++) {
+		upto += __sync_fetch_and_add(&histogram->counts[i], 0);
+		if (upto >= rank) {
+			break;
+		}
+		low = wb_histogram_bucket_max(i) + 1;
+	}
+
+	return low + (wb_histogram_bucket_max(i) - low) / 2;
+}
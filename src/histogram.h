@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_HISTOGRAM_H
+#define INCLUDED_WB_HISTOGRAM_H
+
+/* Histogram buckets. Values below WB_HISTOGRAM_SUB_BUCKETS get a
+   bucket each, every power of two above that is split into
+   WB_HISTOGRAM_SUB_BUCKETS / 2 buckets, which keeps every value
+   within about 3% of its bucket. 1024 buckets cover 19 hours in
+   microseconds. */
+#define WB_HISTOGRAM_SUB_BUCKETS 64
+#define WB_HISTOGRAM_BUCKETS     1024
+
+/* A fixed size HDR style histogram of microseconds. Recording is
+   lock-free, so any thread can record into it at any time. */
+struct wb_histogram {
+	unsigned long counts[WB_HISTOGRAM_BUCKETS];
+	unsigned long count;
+	unsigned long sum;
+};
+
+int wb_histogram_bucket(unsigned long value);
+unsigned long wb_histogram_bucket_max(int bucket);
+void wb_histogram_record(struct wb_histogram *histogram, unsigned long value);
+unsigned long wb_histogram_count_upto(struct wb_histogram *histogram, unsigned long value);
+unsigned long wb_histogram_percentile(struct wb_histogram *histogram, int percentile);
+
+#endif
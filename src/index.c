@@ -0,0 +1,942 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "error.h"
+
+/* Fields of an index file line */
+#define INDEX_FIELDS 10
+
+/* How far an entry's aspect ratio may be from the one searched for,
+   in thousandths */
+#define INDEX_ASPECT_TOLERANCE 10
+
+/* Maximum number of key ranges a query reads candidates from */
+#define INDEX_RANGES_MAX 9
+
+/* Length of toplist intervals in seconds, indexed by WB_TOPLIST_* */
+static const long TOPLIST_SECONDS[] = {
+	0,
+	86400,          /* WB_TOPLIST_1D */
+	3 * 86400,      /* WB_TOPLIST_3D */
+	7 * 86400,      /* WB_TOPLIST_1W */
+	14 * 86400,     /* WB_TOPLIST_2W */
+	30 * 86400,     /* WB_TOPLIST_1M */
+	60 * 86400,     /* WB_TOPLIST_2M */
+	90 * 86400,     /* WB_TOPLIST_3M */
+	0               /* WB_TOPLIST_ALL_TIME */
+};
+
+/* Lines appended by different threads must not interleave */
+static pthread_mutex_t append_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A slot of the table that finds repeated IDs while loading */
+struct index_id_slot {
+	unsigned int id;
+	unsigned int entry;            /* entry number plus one, 0 if empty */
+};
+
+/* A run of secondary index keys */
+struct index_range {
+	const struct wb_index_key *keys;
+	size_t count;
+};
+
+/* Candidate entries of a query */
+struct index_candidates {
+	struct index_range ranges[INDEX_RANGES_MAX];
+	int range_count;
+	size_t total;
+	int all;                       /* 1 if every entry is a candidate */
+};
+
+/**
+ * Writes a string to an index file, with tabs and line breaks
+ * replaced by spaces so that it stays one field.
+ *
+ * @param file - the index file
+ * @param str - the string, or NULL for an empty field
+ */
+void
+index_write_string(FILE *file, const char *str) {
+	if (str == NULL) {
+		return;
+	}
+
+	for (; *str != '\0'; str++) {
+		if (*str == '\t' || *str == '\n' || *str == '\r') {
+			putc(' ', file);
+		} else {
+			putc(*str, file);
+		}
+	}
+}
+
+/**
+ * Appends entries to an index file, one tab separated line each:
+ * ID, image URL, width, height, purity, board, color, favorites,
+ * fetch time and tags. An entry that is appended again replaces
+ * the earlier line when the file is loaded.
+ *
+ * @param path - the path of the index file, created if needed
+ * @param entries - the entries to append
+ * @param count - the number of entries
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_index_append(const char *path, const struct wb_index_entry *entries, size_t count) {
+	FILE *file;
+	size_t i;
+	int status;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&append_lock);
+
+	file = fopen(path, "a");
+	if (file == NULL) {
+		pthread_mutex_unlock(&append_lock);
+		wb_error("unable to open index file %s", path);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		fprintf(file, "%u\t", entries[i].id);
+		index_write_string(file, entries[i].image_url);
+		fprintf(file, "\t%u\t%u\t%u\t%u\t%d\t%d\t%ld\t", entries[i].res_x, entries[i].res_y,
+			entries[i].purity, entries[i].board, entries[i].color, entries[i].favorites,
+			(long) entries[i].fetched);
+		index_write_string(file, entries[i].tags);
+		putc('\n', file);
+	}
+
+	status = (fclose(file) == 0) ? 0 : -1;
+	pthread_mutex_unlock(&append_lock);
+
+	if (status != 0) {
+		wb_error("unable to write index file %s", path);
+	}
+
+	return status;
+}
+
+/**
+ * Reads a whole file into memory.
+ *
+ * @param path - the path of the file
+ * @param length - where to store the length of the file
+ * @return the NUL-terminated contents on success, NULL otherwise.
+ *   IMPORTANT: the returned string must be freed using free().
+ */
+char *
+index_read_file(const char *path, size_t *length) {
+	FILE *file;
+	char *data;
+	long size;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0
+		|| fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	data = (char *) malloc(size + 1);
+	if (data == NULL) {
+		fclose(file);
+		return NULL;
+	}
+
+	*length = fread(data, 1, size, file);
+	data[*length] = '\0';
+	fclose(file);
+
+	return data;
+}
+
+/**
+ * Parses an index file line in place. The fields are
+ * NUL-terminated and the entry's strings point into the line.
+ *
+ * @param line - the line, without the line break
+ * @param entry - where to store the entry
+ * @return 0 on success, -1 if the line is malformed.
+ */
+int
+index_parse_line(char *line, struct wb_index_entry *entry) {
+	char *fields[INDEX_FIELDS];
+	char *tab;
+	int i;
+
+	fields[0] = line;
+	for (i = 1; i < INDEX_FIELDS; i++) {
+		tab = strchr(fields[i - 1], '\t');
+		if (tab == NULL) {
+			return -1;
+		}
+		*tab = '\0';
+		fields[i] = tab + 1;
+	}
+
+	entry->id = (unsigned int) strtoul(fields[0], NULL, 10);
+	entry->image_url = fields[1];
+	entry->res_x = (unsigned short) strtoul(fields[2], NULL, 10);
+	entry->res_y = (unsigned short) strtoul(fields[3], NULL, 10);
+	entry->purity = (unsigned char) strtoul(fields[4], NULL, 10);
+	entry->board = (unsigned char) strtoul(fields[5], NULL, 10);
+	entry->color = (int) strtol(fields[6], NULL, 10);
+	entry->favorites = (int) strtol(fields[7], NULL, 10);
+	entry->fetched = (time_t) strtol(fields[8], NULL, 10);
+	entry->tags = fields[9];
+
+	if (entry->id == 0 || entry->image_url[0] == '\0') {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Finds the next word of a tag string. Words are separated by
+ * commas and whitespace.
+ *
+ * @param pos - the position to search from, moved past the word
+ * @param length - where to store the length of the word
+ * @return the start of the word, or NULL if there are no more words.
+ */
+const char *
+index_next_word(const char **pos, size_t *length) {
+	const char *str = *pos;
+	const char *word;
+
+	while (*str == ',' || *str == ' ' || *str == '\t') {
+		str++;
+	}
+	if (*str == '\0') {
+		*pos = str;
+		return NULL;
+	}
+
+	word = str;
+	while (*str != '\0' && *str != ',' && *str != ' ' && *str != '\t') {
+		str++;
+	}
+
+	*length = str - word;
+	*pos = str;
+	return word;
+}
+
+/**
+ * Lowercases an ASCII character.
+ */
+char
+index_lower(char c) {
+	if (c >= 'A' && c <= 'Z') {
+		return c - 'A' + 'a';
+	}
+	return c;
+}
+
+/**
+ * Hashes a word case-insensitively with FNV-1a.
+ *
+ * @param word - the word
+ * @param length - the length of the word
+ * @return the hash.
+ */
+unsigned int
+index_hash_word(const char *word, size_t length) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char) index_lower(word[i]);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Checks if a tag string contains a word, case-insensitively.
+ *
+ * @param tags - the tag string
+ * @param word - the word
+ * @param length - the length of the word
+ * @return 1 if it does, 0 otherwise.
+ */
+int
+index_has_word(const char *tags, const char *word, size_t length) {
+	const char *tag;
+	size_t tag_length, i;
+
+	while ((tag = index_next_word(&tags, &tag_length)) != NULL) {
+		if (tag_length != length) {
+			continue;
+		}
+		for (i = 0; i < length; i++) {
+			if (index_lower(tag[i]) != index_lower(word[i])) {
+				break;
+			}
+		}
+		if (i == length) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Get the aspect ratio key of a resolution, in thousandths.
+ */
+unsigned int
+index_aspect_key(unsigned int res_x, unsigned int res_y) {
+	if (res_y == 0) {
+		return 0;
+	}
+	return (unsigned int) ((res_x * 1000.0) / res_y + 0.5);
+}
+
+/**
+ * Sorts secondary index keys with two 16 bit radix passes. The
+ * sort is stable, so keys added in entry order stay in entry order
+ * for equal keys.
+ *
+ * @param keys - the keys to sort
+ * @return 0 on success, -1 otherwise.
+ */
+int
+index_sort_keys(struct wb_index_keys *keys) {
+	struct wb_index_key *temp, *from, *to, *swap;
+	size_t *counts;
+	size_t i, sum, count;
+	int shift;
+
+	temp = (struct wb_index_key *) malloc(keys->count * sizeof(struct wb_index_key) + 1);
+	counts = (size_t *) malloc(65536 * sizeof(size_t));
+	if (temp == NULL || counts == NULL) {
+		free(temp);
+		free(counts);
+		return -1;
+	}
+
+	from = keys->keys;
+	to = temp;
+	for (shift = 0; shift < 32; shift += 16) {
+		memset(counts, 0, 65536 * sizeof(size_t));
+		for (i = 0; i < keys->count; i++) {
+			counts[(from[i].key >> shift) & 0xFFFF]++;
+		}
+
+		sum = 0;
+		for (i = 0; i < 65536; i++) {
+			count = counts[i];
+			counts[i] = sum;
+			sum += count;
+		}
+
+		for (i = 0; i < keys->count; i++) {
+			to[counts[(from[i].key >> shift) & 0xFFFF]++] = from[i];
+		}
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	/* After an even number of passes the keys are back in place */
+	free(temp);
+	free(counts);
+
+	return 0;
+}
+
+/**
+ * Builds the secondary indexes of a loaded index.
+ *
+ * @param index - the index
+ * @return 0 on success, -1 otherwise.
+ */
+int
+index_build_keys(struct wb_index *index) {
+	struct wb_index_keys *all[] = {
+		&index->by_resolution, &index->by_aspect, &index->by_color,
+		&index->by_class, &index->by_tag
+	};
+	struct wb_index_entry *entry;
+	const char *tags, *word;
+	size_t word_length, words, i, j, k;
+
+	/* Count tag words first, an entry can have any number of them */
+	words = 0;
+	for (i = 0; i < index->count; i++) {
+		tags = index->entries[i].tags;
+		while (index_next_word(&tags, &word_length) != NULL) {
+			words++;
+		}
+	}
+
+	for (k = 0; k < ARR_SIZE(all); k++) {
+		all[k]->count = 0;
+		all[k]->keys = (struct wb_index_key *) malloc(
+			((all[k] == &index->by_tag) ? words : index->count) * sizeof(struct wb_index_key) + 1);
+		if (all[k]->keys == NULL) {
+			return -1;
+		}
+	}
+
+	for (i = 0; i < index->count; i++) {
+		entry = &index->entries[i];
+
+		if (entry->res_x > 0 && entry->res_y > 0) {
+			index->by_resolution.keys[index->by_resolution.count].key =
+				(unsigned int) entry->res_x << 16 | entry->res_y;
+			index->by_resolution.keys[index->by_resolution.count++].entry = i;
+
+			index->by_aspect.keys[index->by_aspect.count].key =
+				index_aspect_key(entry->res_x, entry->res_y);
+			index->by_aspect.keys[index->by_aspect.count++].entry = i;
+		}
+
+		if (entry->color >= 0) {
+			index->by_color.keys[index->by_color.count].key = entry->color;
+			index->by_color.keys[index->by_color.count++].entry = i;
+		}
+
+		index->by_class.keys[index->by_class.count].key =
+			(unsigned int) entry->purity << 8 | entry->board;
+		index->by_class.keys[index->by_class.count++].entry = i;
+
+		tags = entry->tags;
+		while ((word = index_next_word(&tags, &word_length)) != NULL) {
+			index->by_tag.keys[index->by_tag.count].key = index_hash_word(word, word_length);
+			index->by_tag.keys[index->by_tag.count++].entry = i;
+		}
+	}
+
+	for (k = 0; k < ARR_SIZE(all); k++) {
+		if (index_sort_keys(all[k]) != 0) {
+			return -1;
+		}
+	}
+
+	/* An entry is listed once per tag word, however often it has it */
+	j = 0;
+	for (i = 0; i < index->by_tag.count; i++) {
+		if (j > 0 && index->by_tag.keys[j - 1].key == index->by_tag.keys[i].key
+			&& index->by_tag.keys[j - 1].entry == index->by_tag.keys[i].entry) {
+			continue;
+		}
+		index->by_tag.keys[j++] = index->by_tag.keys[i];
+	}
+	index->by_tag.count = j;
+
+	return 0;
+}
+
+/**
+ * Loads an index file and builds its secondary indexes. When an
+ * ID is in the file more than once, its last line is used.
+ *
+ * @param path - the path of the index file
+ * @return the index on success, NULL otherwise. IMPORTANT: the
+ *   returned index must be freed with wb_index_free().
+ */
+struct wb_index *
+wb_index_load(const char *path) {
+	struct wb_index *index;
+	struct wb_index_entry entry;
+	struct index_id_slot *slots;
+	size_t length, lines, capacity, slot;
+	char *line, *line_end;
+
+	index = (struct wb_index *) calloc(1, sizeof(struct wb_index));
+	if (index == NULL) {
+		return NULL;
+	}
+
+	index->data = index_read_file(path, &length);
+	if (index->data == NULL) {
+		wb_error("unable to read index file %s", path);
+		free(index);
+		return NULL;
+	}
+
+	lines = 0;
+	line = index->data;
+	while ((line = memchr(line, '\n', index->data + length - line)) != NULL) {
+		lines++;
+		line++;
+	}
+
+	capacity = 64;
+	while (capacity < lines * 2) {
+		capacity *= 2;
+	}
+
+	index->entries = (struct wb_index_entry *) malloc((lines + 1) * sizeof(struct wb_index_entry));
+	slots = (struct index_id_slot *) calloc(capacity, sizeof(struct index_id_slot));
+	if (index->entries == NULL || slots == NULL) {
+		free(slots);
+		wb_index_free(index);
+		return NULL;
+	}
+
+	line = index->data;
+	while (*line != '\0') {
+		line_end = strchr(line, '\n');
+		if (line_end != NULL) {
+			*line_end = '\0';
+		}
+
+		if (index_parse_line(line, &entry) == 0) {
+			slot = (entry.id * 2654435761u) & (capacity - 1);
+			while (slots[slot].entry != 0 && slots[slot].id != entry.id) {
+				slot = (slot + 1) & (capacity - 1);
+			}
+
+			if (slots[slot].entry == 0) {
+				index->entries[index->count] = entry;
+				slots[slot].id = entry.id;
+				slots[slot].entry = ++index->count;
+			} else {
+				index->entries[slots[slot].entry - 1] = entry;
+			}
+		}
+
+		if (line_end == NULL) {
+			break;
+		}
+		line = line_end + 1;
+	}
+	free(slots);
+
+	if (index_build_keys(index) != 0) {
+		wb_index_free(index);
+		return NULL;
+	}
+
+	return index;
+}
+
+/**
+ * Finds the keys in a secondary index between two values.
+ *
+ * @param keys - the secondary index
+ * @param low - the lowest key value
+ * @param high - the highest key value
+ * @param range - where to store the keys found
+ * @return the number of keys found.
+ */
+size_t
+index_find_range(const struct wb_index_keys *keys, unsigned int low,
+	unsigned int high, struct index_range *range) {
+
+	size_t first, last, lo, hi, mid;
+
+	/* First key >= low */
+	lo = 0;
+	hi = keys->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (keys->keys[mid].key < low) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	first = lo;
+
+	/* First key > high */
+	hi = keys->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (keys->keys[mid].key <= high) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	last = lo;
+
+	range->keys = keys->keys + first;
+	range->count = last - first;
+
+	return range->count;
+}
+
+/**
+ * Replaces a query's candidates if a different set of ranges has
+ * fewer of them.
+ *
+ * @param best - the candidates so far
+ * @param ranges - the other ranges
+ * @param range_count - the number of other ranges
+ */
+void
+index_pick_candidates(struct index_candidates *best,
+	const struct index_range *ranges, int range_count) {
+
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < range_count; i++) {
+		total += ranges[i].count;
+	}
+
+	if (best->all || total < best->total) {
+		memcpy(best->ranges, ranges, range_count * sizeof(struct index_range));
+		best->range_count = range_count;
+		best->total = total;
+		best->all = 0;
+	}
+}
+
+/**
+ * Chooses the secondary index with the fewest candidates for a
+ * query. Every candidate must still be checked against the whole
+ * query.
+ *
+ * @param index - the index
+ * @param options - the query
+ * @param words - the words of the query string
+ * @param word_count - the number of words
+ * @param candidates - where to store the candidates
+ */
+void
+index_find_candidates(const struct wb_index *index, const struct options *options,
+	const struct wb_str_view *words, int word_count, struct index_candidates *candidates) {
+
+	struct index_range ranges[INDEX_RANGES_MAX];
+	unsigned int key, purity, boards;
+	int range_count, p, b, i;
+
+	candidates->range_count = 0;
+	candidates->total = index->count;
+	candidates->all = 1;
+
+	if (options->res_x > 0 && options->res_y > 0) {
+		key = (unsigned int) options->res_x << 16 | options->res_y;
+		if (options->res_opt == WB_RES_EXACTLY) {
+			index_find_range(&index->by_resolution, key, key, &ranges[0]);
+		} else {
+			index_find_range(&index->by_resolution, key & 0xFFFF0000, 0xFFFFFFFF, &ranges[0]);
+		}
+		index_pick_candidates(candidates, ranges, 1);
+	}
+
+	if (options->aspect_ratio > 0) {
+		key = (unsigned int) (options->aspect_ratio * 1000 + 0.5);
+		index_find_range(&index->by_aspect, (key > INDEX_ASPECT_TOLERANCE) ?
+			key - INDEX_ASPECT_TOLERANCE : 0, key + INDEX_ASPECT_TOLERANCE, &ranges[0]);
+		index_pick_candidates(candidates, ranges, 1);
+	}
+
+	if (options->color >= 0) {
+		index_find_range(&index->by_color, options->color, options->color, &ranges[0]);
+		index_pick_candidates(candidates, ranges, 1);
+	}
+
+	purity = options->purity & WB_PURITY_ALL;
+	boards = options->boards & WB_BOARD_ALL;
+	if ((purity != 0 && purity != WB_PURITY_ALL) || (boards != 0 && boards != WB_BOARD_ALL)) {
+		purity = (purity != 0) ? purity : WB_PURITY_ALL;
+		boards = (boards != 0) ? boards : WB_BOARD_ALL;
+
+		range_count = 0;
+		for (p = WB_PURITY_SFW; p <= WB_PURITY_NSFW; p <<= 1) {
+			for (b = WB_BOARD_GENERAL; b <= WB_BOARD_HIGHRES; b <<= 1) {
+				if ((purity & p) && (boards & b)) {
+					key = (unsigned int) p << 8 | b;
+					index_find_range(&index->by_class, key, key, &ranges[range_count++]);
+				}
+			}
+		}
+		index_pick_candidates(candidates, ranges, range_count);
+	}
+
+	for (i = 0; i < word_count; i++) {
+		key = index_hash_word(words[i].str, words[i].length);
+		index_find_range(&index->by_tag, key, key, &ranges[0]);
+		index_pick_candidates(candidates, ranges, 1);
+	}
+}
+
+/**
+ * Checks if an entry matches a query.
+ *
+ * @param entry - the entry
+ * @param options - the query
+ * @param words - the words of the query string
+ * @param word_count - the number of words
+ * @param since - the oldest fetch time that matches, 0 for any
+ * @return 1 if it matches, 0 otherwise.
+ */
+int
+index_entry_matches(const struct wb_index_entry *entry, const struct options *options,
+	const struct wb_str_view *words, int word_count, time_t since) {
+
+	unsigned int aspect, key;
+	int i;
+
+	if (options->res_x > 0 && options->res_y > 0) {
+		if (options->res_opt == WB_RES_EXACTLY) {
+			if (entry->res_x != options->res_x || entry->res_y != options->res_y) {
+				return 0;
+			}
+		} else if (entry->res_x < options->res_x || entry->res_y < options->res_y) {
+			return 0;
+		}
+	}
+
+	if (options->aspect_ratio > 0) {
+		key = (unsigned int) (options->aspect_ratio * 1000 + 0.5);
+		aspect = index_aspect_key(entry->res_x, entry->res_y);
+		if (aspect + INDEX_ASPECT_TOLERANCE < key || aspect > key + INDEX_ASPECT_TOLERANCE) {
+			return 0;
+		}
+	}
+
+	if (options->color >= 0 && entry->color != options->color) {
+		return 0;
+	}
+
+	if ((options->purity & WB_PURITY_ALL) != 0 && (entry->purity & options->purity) == 0) {
+		return 0;
+	}
+
+	if ((options->boards & WB_BOARD_ALL) != 0 && (entry->board & options->boards) == 0) {
+		return 0;
+	}
+
+	if (since > 0 && entry->fetched < since) {
+		return 0;
+	}
+
+	for (i = 0; i < word_count; i++) {
+		if (!index_has_word(entry->tags, words[i].str, words[i].length)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Compares entries by favorites, most first, then by ID.
+ */
+int
+index_compare_favorites(const void *a, const void *b) {
+	const struct wb_index_entry *x = *(const struct wb_index_entry **) a;
+	const struct wb_index_entry *y = *(const struct wb_index_entry **) b;
+
+	if (x->favorites != y->favorites) {
+		return (x->favorites > y->favorites) ? -1 : 1;
+	}
+	return (x->id < y->id) ? -1 : (x->id > y->id);
+}
+
+/**
+ * Compares entries by fetch time, newest first, then by ID.
+ */
+int
+index_compare_date(const void *a, const void *b) {
+	const struct wb_index_entry *x = *(const struct wb_index_entry **) a;
+	const struct wb_index_entry *y = *(const struct wb_index_entry **) b;
+
+	if (x->fetched != y->fetched) {
+		return (x->fetched > y->fetched) ? -1 : 1;
+	}
+	return (x->id > y->id) ? -1 : (x->id < y->id);
+}
+
+/**
+ * Sorts matching entries the way a query asks for. Entries are
+ * sorted by favorites for toplists and favorites sorts, randomly
+ * for random queries, and newest first otherwise, since views and
+ * relevance are not in the index.
+ *
+ * @param matches - the matching entries
+ * @param count - the number of matching entries
+ * @param options - the query
+ */
+void
+index_sort_matches(const struct wb_index_entry **matches, size_t count,
+	const struct options *options) {
+
+	const struct wb_index_entry *swap;
+	unsigned int seed;
+	size_t i, j;
+
+	if ((options->flags & WB_FLAG_RANDOM) || options->sort_by == WB_SORT_RANDOM) {
+		seed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+		for (i = count; i > 1; i--) {
+			j = rand_r(&seed) % i;
+			swap = matches[i - 1];
+			matches[i - 1] = matches[j];
+			matches[j] = swap;
+		}
+		return;
+	}
+
+	if (options->toplist != WB_TOPLIST_NONE || options->sort_by == WB_SORT_FAVORITES) {
+		qsort(matches, count, sizeof(*matches), index_compare_favorites);
+	} else {
+		qsort(matches, count, sizeof(*matches), index_compare_date);
+	}
+
+	/* Toplists always put the most favorited images first */
+	if (options->sort_order == WB_SORT_ASCENDING && options->toplist == WB_TOPLIST_NONE) {
+		for (i = 0, j = count; i + 1 < j; i++, j--) {
+			swap = matches[i];
+			matches[i] = matches[j - 1];
+			matches[j - 1] = swap;
+		}
+	}
+}
+
+/**
+ * Answers a query from a loaded index instead of wallbase.cc.
+ * Candidates come from the most selective secondary index the
+ * query can use and are then checked against the whole query.
+ * The query string matches entries that have all of its words as
+ * tag words.
+ *
+ * @param index - the index
+ * @param options - the query
+ * @return a wb_str_list of image URLs, NULL if there are none or on
+ *   error. IMPORTANT: the returned list must be freed with
+ *   wb_list_free().
+ */
+struct wb_str_list *
+wb_index_query(const struct wb_index *index, const struct options *options) {
+	struct wb_str_list *image_urls = NULL;
+	const struct wb_index_entry **matches;
+	const struct wb_index_entry *entry;
+	struct index_candidates candidates;
+	struct wb_str_view *words = NULL;
+	const char *pos, *word;
+	size_t length, match_count, i;
+	time_t since;
+	int word_count, r;
+
+	if (options->collection_id != -1) {
+		wb_error("collections are not in the local index");
+		return NULL;
+	}
+
+	/* Split the query string into words */
+	word_count = 0;
+	if (options->query != NULL) {
+		words = (struct wb_str_view *) malloc((strlen(options->query) / 2 + 1)
+			* sizeof(struct wb_str_view));
+		if (words == NULL) {
+			return NULL;
+		}
+
+		pos = options->query;
+		while ((word = index_next_word(&pos, &length)) != NULL) {
+			words[word_count].str = word;
+			words[word_count++].length = length;
+		}
+	}
+
+	since = 0;
+	if (TOPLIST_SECONDS[options->toplist] > 0) {
+		since = time(NULL) - TOPLIST_SECONDS[options->toplist];
+	}
+
+	index_find_candidates(index, options, words, word_count, &candidates);
+
+	matches = (const struct wb_index_entry **) malloc((candidates.total + 1)
+		* sizeof(struct wb_index_entry *));
+	if (matches == NULL) {
+		free(words);
+		return NULL;
+	}
+
+	match_count = 0;
+	if (candidates.all) {
+		for (i = 0; i < index->count; i++) {
+			entry = &index->entries[i];
+			if (index_entry_matches(entry, options, words, word_count, since)) {
+				matches[match_count++] = entry;
+			}
+		}
+	} else {
+		for (r = 0; r < candidates.range_count; r++) {
+			for (i = 0; i < candidates.ranges[r].count; i++) {
+				entry = &index->entries[candidates.ranges[r].keys[i].entry];
+				if (index_entry_matches(entry, options, words, word_count, since)) {
+					matches[match_count++] = entry;
+				}
+			}
+		}
+	}
+	free(words);
+
+	index_sort_matches(matches, match_count, options);
+
+	/* Keep the first images, prepending from the back */
+	if (match_count > (size_t) options->images) {
+		match_count = options->images;
+	}
+	for (i = match_count; i > 0; i--) {
+		image_urls = wb_list_prepend(image_urls, matches[i - 1]->image_url);
+	}
+	free(matches);
+
+	return image_urls;
+}
+
+/**
+ * Frees a loaded index.
+ *
+ * @param index - the index to free
+ */
+void
+wb_index_free(struct wb_index *index) {
+	if (index == NULL) {
+		return;
+	}
+
+	free(index->by_resolution.keys);
+	free(index->by_aspect.keys);
+	free(index->by_color.keys);
+	free(index->by_class.keys);
+	free(index->by_tag.keys);
+	free(index->entries);
+	free(index->data);
+	free(index);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_INDEX_H
+#define INCLUDED_WB_INDEX_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "types.h"
+#include "str_list.h"
+
+/* What is known about one scraped wallpaper */
+struct wb_index_entry {
+	unsigned int id;
+	unsigned short res_x, res_y;
+	unsigned char purity;          /* a WB_PURITY_* flag, 0 if unknown */
+	unsigned char board;           /* a WB_BOARD_* flag, 0 if unknown */
+	int color;                     /* RGB, -1 if unknown */
+	int favorites;
+	time_t fetched;
+	char *image_url;
+	char *tags;                    /* comma separated */
+};
+
+/* A secondary index key, pointing to an entry */
+struct wb_index_key {
+	unsigned int key;
+	unsigned int entry;
+};
+
+/* A secondary index, keys sorted in ascending order */
+struct wb_index_keys {
+	struct wb_index_key *keys;
+	size_t count;
+};
+
+/* An index file loaded into memory */
+struct wb_index {
+	char *data;                    /* the file, entry strings point into it */
+	struct wb_index_entry *entries;
+	size_t count;
+
+	struct wb_index_keys by_resolution; /* res_x << 16 | res_y */
+	struct wb_index_keys by_aspect;     /* thousandths of res_x / res_y */
+	struct wb_index_keys by_color;
+	struct wb_index_keys by_class;      /* purity << 8 | board */
+	struct wb_index_keys by_tag;        /* hash of a lowercase tag word */
+};
+
+int wb_index_append(const char *path, const struct wb_index_entry *entries, size_t count);
+struct wb_index *wb_index_load(const char *path);
+struct wb_str_list *wb_index_query(const struct wb_index *index, const struct options *options);
+void wb_index_free(struct wb_index *index);
+
+#endif
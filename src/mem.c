@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "mem.h"
+
+/* glibc can tell how much of the heap is in use */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define WB_MEM_MALLINFO2
+#endif
+
+/* Names of the subsystems, indexed like the WB_MEM_* subsystems */
+static const char *MEM_SUBSYSTEM_NAMES[] = {
+	"curl", "tidy", "libxml2", "xml arenas", "string lists"
+};
+
+int wb_mem_enabled = 0;
+
+static struct wb_mem_usage mem_usage[WB_MEM_SUBSYSTEMS];
+
+/**
+ * Starts accounting memory. Must be called before the libraries are
+ * initialized, so that their hooks are set up, and before any other
+ * thread is started.
+ */
+void
+wb_mem_enable() {
+	wb_mem_enabled = 1;
+}
+
+/**
+ * Adds to the memory of a subsystem and raises its peak.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param bytes - the bytes allocated, negative for freed ones
+ * @param allocations - the number of allocations made
+ */
+void
+wb_mem_count(int subsystem, long bytes, unsigned long allocations) {
+	struct wb_mem_usage *usage = &mem_usage[subsystem];
+	long current, peak;
+
+	if (!wb_mem_enabled) {
+		return;
+	}
+
+	current = __sync_add_and_fetch(&usage->current, bytes);
+	if (allocations > 0) {
+		__sync_fetch_and_add(&usage->allocations, allocations);
+	}
+
+	peak = usage->peak;
+	while (current > peak && !__sync_bool_compare_and_swap(&usage->peak, peak, current)) {
+		peak = usage->peak;
+	}
+}
+
+/**
+ * Gets how much memory a heap block really takes, which is what is
+ * accounted, so that blocks need no header of their own.
+ *
+ * @param ptr - the block, or NULL
+ * @return the size in bytes, 0 for NULL.
+ */
+size_t
+wb_mem_size(void *ptr) {
+	return (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+}
+
+/**
+ * malloc() that accounts the block to a subsystem.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param size - the size of the block
+ * @return a pointer to the block on success, NULL otherwise.
+ */
+void *
+wb_mem_malloc(int subsystem, size_t size) {
+	void *ptr = malloc(size);
+
+	if (wb_mem_enabled && ptr != NULL) {
+		wb_mem_count(subsystem, wb_mem_size(ptr), 1);
+	}
+	return ptr;
+}
+
+/**
+ * calloc() that accounts the block to a subsystem.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param count - the number of elements
+ * @param size - the size of an element
+ * @return a pointer to the zeroed block on success, NULL otherwise.
+ */
+void *
+wb_mem_calloc(int subsystem, size_t count, size_t size) {
+	void *ptr = calloc(count, size);
+
+	if (wb_mem_enabled && ptr != NULL) {
+		wb_mem_count(subsystem, wb_mem_size(ptr), 1);
+	}
+	return ptr;
+}
+
+/**
+ * realloc() that accounts the change to a subsystem.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param ptr - the block to resize, or NULL
+ * @param size - the new size
+ * @return a pointer to the resized block on success, NULL otherwise,
+ *   in which case the old block is left alone.
+ */
+void *
+wb_mem_realloc(int subsystem, void *ptr, size_t size) {
+	size_t old_size = wb_mem_enabled ? wb_mem_size(ptr) : 0;
+	void *new_ptr = realloc(ptr, size);
+
+	if (wb_mem_enabled && new_ptr != NULL) {
+		wb_mem_count(subsystem, (long) wb_mem_size(new_ptr) - (long) old_size, 1);
+	}
+	return new_ptr;
+}
+
+/**
+ * strdup() that accounts the copy to a subsystem.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param str - the string to copy
+ * @return the copy on success, NULL otherwise.
+ */
+char *
+wb_mem_strdup(int subsystem, const char *str) {
+	char *copy = strdup(str);
+
+	if (wb_mem_enabled && copy != NULL) {
+		wb_mem_count(subsystem, wb_mem_size(copy), 1);
+	}
+	return copy;
+}
+
+/**
+ * free() for blocks accounted to a subsystem.
+ *
+ * @param subsystem - the WB_MEM_* subsystem the block was
+ *   accounted to
+ * @param ptr - the block, or NULL
+ */
+void
+wb_mem_free(int subsystem, void *ptr) {
+	if (wb_mem_enabled && ptr != NULL) {
+		wb_mem_count(subsystem, -(long) wb_mem_size(ptr), 0);
+	}
+	free(ptr);
+}
+
+/**
+ * Gets the memory of a subsystem.
+ *
+ * @param subsystem - a WB_MEM_* subsystem
+ * @param usage - where to store it
+ */
+void
+wb_mem_usage(int subsystem, struct wb_mem_usage *usage) {
+	usage->current = __sync_fetch_and_add(&mem_usage[subsystem].current, 0);
+	usage->peak = __sync_fetch_and_add(&mem_usage[subsystem].peak, 0);
+	usage->allocations = __sync_fetch_and_add(&mem_usage[subsystem].allocations, 0);
+}
+
+/**
+ * Prints the current and peak memory and the allocations of every
+ * subsystem, then the whole heap and the peak RSS for comparison.
+ *
+ * @param out - where to print them
+ */
+void
+wb_mem_print(FILE *out) {
+	struct wb_mem_usage usage;
+	struct rusage rusage;
+#ifdef WB_MEM_MALLINFO2
+	struct mallinfo2 info;
+#endif
+	int i;
+
+	fprintf(out, "%-18s %12s %12s %12s\n", "memory", "current KiB", "peak KiB", "allocations");
+
+	for (i = 0; i < WB_MEM_SUBSYSTEMS; i++) {
+		wb_mem_usage(i, &usage);
+		fprintf(out, "%-18s %12.1f %12.1f %12lu\n", MEM_SUBSYSTEM_NAMES[i],
+			usage.current / 1024.0, usage.peak / 1024.0, usage.allocations);
+	}
+
+#ifdef WB_MEM_MALLINFO2
+	info = mallinfo2();
+	fprintf(out, "%-18s %12.1f\n", "heap", (info.uordblks + info.hblkhd) / 1024.0);
+#endif
+
+	if (getrusage(RUSAGE_SELF, &rusage) == 0) {
+		fprintf(out, "%-18s %12s %12ld\n", "max rss", "", rusage.ru_maxrss);
+	}
+}
+
+/**
+ * Forgets all accounted memory and stops accounting.
+ */
+void
+wb_mem_reset() {
+	wb_mem_enabled = 0;
+	memset(mem_usage, 0, sizeof(mem_usage));
+}
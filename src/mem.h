@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_MEM_H
+#define INCLUDED_WB_MEM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Subsystems whose heap memory is accounted. The libraries are
+   accounted through their allocator hooks, wb's own memory where it
+   is allocated. */
+#define WB_MEM_CURL       0
+#define WB_MEM_TIDY       1
+#define WB_MEM_XML        2
+#define WB_MEM_ARENA      3
+#define WB_MEM_STR_LIST   4
+#define WB_MEM_SUBSYSTEMS 5
+
+/* The memory of a subsystem */
+struct wb_mem_usage {
+	long current;                /* bytes */
+	long peak;
+	unsigned long allocations;
+};
+
+/* 1 if memory is accounted, checked before doing any work for it */
+extern int wb_mem_enabled;
+
+void wb_mem_enable();
+void wb_mem_count(int subsystem, long bytes, unsigned long allocations);
+size_t wb_mem_size(void *ptr);
+void *wb_mem_malloc(int subsystem, size_t size);
+void *wb_mem_calloc(int subsystem, size_t count, size_t size);
+void *wb_mem_realloc(int subsystem, void *ptr, size_t size);
+char *wb_mem_strdup(int subsystem, const char *str);
+void wb_mem_free(int subsystem, void *ptr);
+void wb_mem_usage(int subsystem, struct wb_mem_usage *usage);
+void wb_mem_print(FILE *out);
+void wb_mem_reset();
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "error.h"
+#include "metrics.h"
+
+/* Bucket upper bounds of the exported histograms, in seconds */
+static const double METRICS_BOUNDS[] = {
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+};
+#define METRICS_BOUND_COUNT (sizeof(METRICS_BOUNDS) / sizeof(METRICS_BOUNDS[0]))
+
+/* Label values of the endpoints, indexed like the WB_METRICS_* endpoints */
+static const char *METRICS_ENDPOINT_NAMES[] = {
+	"listing", "detail", "login"
+};
+
+int wb_metrics_enabled = 0;
+
+static struct wb_histogram metrics_requests[WB_METRICS_ENDPOINTS];
+static struct wb_histogram metrics_parse;
+
+/* Only one dump at a time may write the temporary file */
+static pthread_mutex_t metrics_dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Starts recording metrics. Must be called before any other thread
+ * is started.
+ */
+void
+wb_metrics_enable() {
+	wb_metrics_enabled = 1;
+}
+
+/**
+ * Records how long a request took.
+ *
+ * @param endpoint - a WB_METRICS_* endpoint
+ * @param seconds - how long it took
+ */
+void
+wb_metrics_record_request(int endpoint, double seconds) {
+	if (wb_metrics_enabled) {
+		wb_histogram_record(&metrics_requests[endpoint], (unsigned long) (seconds * 1e6));
+	}
+}
+
+/**
+ * Records how long parsing a page took.
+ *
+ * @param seconds - how long it took
+ */
+void
+wb_metrics_record_parse(double seconds) {
+	if (wb_metrics_enabled) {
+		wb_histogram_record(&metrics_parse, (unsigned long) (seconds * 1e6));
+	}
+}
+
+/**
+ * Writes the samples of a histogram in the Prometheus text format.
+ *
+ * @param out - where to write them
+ * @param name - the name of the metric
+ * @param label - a label to add to every sample, like
+ *   endpoint="listing", or an empty string
+ * @param histogram - the histogram
+ */
+void
+metrics_write_histogram(FILE *out, const char *name, const char *label,
+	struct wb_histogram *histogram) {
+
+	const char *separator = (*label != '\0') ? "," : "";
+	unsigned long count, upto = 0;
+	size_t i;
+
+	for (i = 0; i < METRICS_BOUND_COUNT; i++) {
+		upto = wb_histogram_count_upto(histogram, (unsigned long) (METRICS_BOUNDS[i] * 1e6));
+		fprintf(out, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, label, separator,
+			METRICS_BOUNDS[i], upto);
+	}
+
+	/* Values recorded while writing must not make the count smaller
+	   than a bucket */
+	count = __sync_fetch_and_add(&histogram->count, 0);
+	if (count < upto) {
+		count = upto;
+	}
+	fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, label, separator, count);
+	fprintf(out, "%s_sum{%s} %.6f\n", name, label,
+		__sync_fetch_and_add(&histogram->sum, 0) / 1e6);
+	fprintf(out, "%s_count{%s} %lu\n", name, label, count);
+}
+
+/**
+ * Writes all metrics in the Prometheus text exposition format.
+ *
+ * @param out - where to write them
+ */
+void
+wb_metrics_write(FILE *out) {
+	char label[32];
+	int i;
+
+	fputs("# HELP wb_request_duration_seconds Time taken by wallbase.cc requests.\n", out);
+	fputs("# TYPE wb_request_duration_seconds histogram\n", out);
+	for (i = 0; i < WB_METRICS_ENDPOINTS; i++) {
+		sprintf(label, "endpoint=\"%s\"", METRICS_ENDPOINT_NAMES[i]);
+		metrics_write_histogram(out, "wb_request_duration_seconds", label, &metrics_requests[i]);
+	}
+
+	fputs("# HELP wb_parse_duration_seconds Time taken to parse a page.\n", out);
+	fputs("# TYPE wb_parse_duration_seconds histogram\n", out);
+	metrics_write_histogram(out, "wb_parse_duration_seconds", "", &metrics_parse);
+}
+
+/**
+ * Writes all metrics to a file. The file is replaced at once, so a
+ * collector never reads half of it.
+ *
+ * @param path - the path of the file
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_metrics_dump(const char *path) {
+	char *temp_path;
+	FILE *file;
+	int res;
+
+	temp_path = (char *) malloc(strlen(path) + 5);
+	if (temp_path == NULL) {
+		return -1;
+	}
+	sprintf(temp_path, "%s.tmp", path);
+
+	pthread_mutex_lock(&metrics_dump_lock);
+
+	file = fopen(temp_path, "w");
+	if (file == NULL) {
+		pthread_mutex_unlock(&metrics_dump_lock);
+		wb_error("unable to write metrics to %s: %s", temp_path, strerror(errno));
+		free(temp_path);
+		return -1;
+	}
+
+	wb_metrics_write(file);
+
+	res = (fclose(file) == 0) ? rename(temp_path, path) : -1;
+	if (res != 0) {
+		wb_error("unable to write metrics to %s: %s", path, strerror(errno));
+		remove(temp_path);
+	}
+
+	pthread_mutex_unlock(&metrics_dump_lock);
+
+	free(temp_path);
+	return res == 0 ? 0 : -1;
+}
+
+/**
+ * Clears the recorded values and stops recording.
+ */
+void
+wb_metrics_reset() {
+	wb_metrics_enabled = 0;
+	memset(metrics_requests, 0, sizeof(metrics_requests));
+	memset(&metrics_parse, 0, sizeof(metrics_parse));
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_METRICS_H
+#define INCLUDED_WB_METRICS_H
+
+#include <stdio.h>
+
+#include "histogram.h"
+
+/* Request endpoints */
+#define WB_METRICS_LISTING   0
+#define WB_METRICS_DETAIL    1
+#define WB_METRICS_LOGIN     2
+#define WB_METRICS_ENDPOINTS 3
+
+/* 1 if metrics are recorded, checked before doing any work for them */
+extern int wb_metrics_enabled;
+
+void wb_metrics_enable();
+void wb_metrics_record_request(int endpoint, double seconds);
+void wb_metrics_record_parse(double seconds);
+void wb_metrics_write(FILE *out);
+int wb_metrics_dump(const char *path);
+void wb_metrics_reset();
+
+#endif
@@ -19,49 +19,261 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <signal.h>
 #include <curl/curl.h>
 
 #include "types.h"
 #include "error.h"
+#include "mem.h"
 #include "net.h"
+#include "str_list.h"
+#include "stats.h"
+#include "trace.h"
 
-/* Global CURL handle for reuse */
-static CURL *curl_handle = NULL;
+/* DNS and TLS sessions shared by all threads' handles. Connections
+   stay with each thread's handle, curl can't share them between
+   handles that run at the same time. */
+static CURLSH *curl_share = NULL;
+static pthread_mutex_t curl_share_locks[CURL_LOCK_DATA_LAST];
+
+/* Every thread reuses its own CURL handle */
+static pthread_key_t curl_handle_key;
+
+/* Longest a request may take */
+#define NET_TIMEOUT_MS 120000L
+
+/* When requests must be done by, from wb_stats_now(). 0 if there is
+   no deadline. */
+static double net_deadline = 0;
+
+/* 1 once requests are cancelled, set from signal handlers */
+static volatile sig_atomic_t net_cancel_requested = 0;
+
+/**
+ * Locks a kind of data in the CURL share.
+ */
+void
+net_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+	pthread_mutex_lock(&curl_share_locks[data]);
+}
+
+/**
+ * Unlocks a kind of data in the CURL share.
+ */
+void
+net_share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	pthread_mutex_unlock(&curl_share_locks[data]);
+}
 
 /**
- * Initialize the wb net system.
+ * Frees a thread's CURL handle when the thread exits.
+ */
+void
+net_free_curl_handle(void *curl) {
+	curl_easy_cleanup((CURL *) curl);
+}
+
+/**
+ * curl malloc hook, accounts curl's memory.
+ */
+void *
+net_mem_malloc(size_t size) {
+	return wb_mem_malloc(WB_MEM_CURL, size);
+}
+
+/**
+ * curl free hook.
+ */
+void
+net_mem_free(void *ptr) {
+	wb_mem_free(WB_MEM_CURL, ptr);
+}
+
+/**
+ * curl realloc hook.
+ */
+void *
+net_mem_realloc(void *ptr, size_t size) {
+	return wb_mem_realloc(WB_MEM_CURL, ptr, size);
+}
+
+/**
+ * curl strdup hook.
+ */
+char *
+net_mem_strdup(const char *str) {
+	return wb_mem_strdup(WB_MEM_CURL, str);
+}
+
+/**
+ * curl calloc hook.
+ */
+void *
+net_mem_calloc(size_t count, size_t size) {
+	return wb_mem_calloc(WB_MEM_CURL, count, size);
+}
+
+/**
+ * Initialize the wb net system. curl's memory is accounted if
+ * memory accounting is on.
  */
 void net_init() {
-	curl_global_init(CURL_GLOBAL_ALL);
+	int i;
+
+	if (wb_mem_enabled) {
+		curl_global_init_mem(CURL_GLOBAL_ALL, net_mem_malloc, net_mem_free,
+			net_mem_realloc, net_mem_strdup, net_mem_calloc);
+	} else {
+		curl_global_init(CURL_GLOBAL_ALL);
+	}
+	pthread_key_create(&curl_handle_key, net_free_curl_handle);
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_init(&curl_share_locks[i], NULL);
+	}
+
+	curl_share = curl_share_init();
+	if (curl_share != NULL) {
+		curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, net_share_lock);
+		curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, net_share_unlock);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
 }
 
 /**
- * Cleanup the wb net system.
+ * Cleanup the wb net system. Threads that used the net system must
+ * have exited.
  */
 void net_cleanup() {
+	CURL *curl_handle;
+	int i;
+
+	curl_handle = (CURL *) pthread_getspecific(curl_handle_key);
 	if (curl_handle != NULL) {
 		curl_easy_cleanup(curl_handle);
-		curl_handle = NULL;
+		pthread_setspecific(curl_handle_key, NULL);
+	}
+
+	if (curl_share != NULL) {
+		curl_share_cleanup(curl_share);
+		curl_share = NULL;
+	}
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_destroy(&curl_share_locks[i]);
 	}
 
+	pthread_key_delete(curl_handle_key);
 	curl_global_cleanup();
 }
 
 /**
- * Setup the CURL handle. Creates a new handle if it has not already
- * been created, cleans up the handle otherwise.
+ * Sets when every request must be done by. Requests started after it
+ * fail right away, the others time out at it. Must be called before
+ * any other thread is started.
+ *
+ * @param deadline - the time, from wb_stats_now(). 0 for no deadline.
  */
 void
+net_set_deadline(double deadline) {
+	net_deadline = deadline;
+}
+
+/**
+ * Cancels every request: the ones that are running are aborted and
+ * the ones started after it fail right away. Safe to call from a
+ * signal handler.
+ */
+void
+net_cancel() {
+	net_cancel_requested = 1;
+}
+
+/**
+ * Checks if requests were cancelled with net_cancel().
+ *
+ * @return 1 if they were, 0 otherwise.
+ */
+int
+net_cancelled() {
+	return net_cancel_requested != 0;
+}
+
+/**
+ * Aborts a transfer once requests are cancelled. curl calls it while
+ * a transfer runs, at least once a second.
+ *
+ * @return 1 to abort the transfer, 0 to go on.
+ */
+int
+net_abort_cancelled(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+	curl_off_t ultotal, curl_off_t ulnow) {
+
+	return net_cancel_requested != 0;
+}
+
+/**
+ * Get how long a request started now may take, at most
+ * NET_TIMEOUT_MS and never past the deadline.
+ *
+ * @return the timeout in milliseconds, 0 if the deadline has passed.
+ */
+long
+net_timeout_ms() {
+	double left;
+
+	if (net_deadline == 0) {
+		return NET_TIMEOUT_MS;
+	}
+
+	left = (net_deadline - wb_stats_now()) * 1000;
+	if (left <= 0) {
+		return 0;
+	}
+
+	/* Rounded up, a request that timed out has reached the deadline */
+	return (left < NET_TIMEOUT_MS) ? (long) left + 1 : NET_TIMEOUT_MS;
+}
+
+/**
+ * Setup the calling thread's CURL handle. Creates a new handle if
+ * it has not already been created, cleans up the handle otherwise.
+ *
+ * @return the CURL handle, or NULL if it could not be created.
+ */
+CURL *
 setup_curl_handle() {
+	CURL *curl_handle;
+
+	curl_handle = (CURL *) pthread_getspecific(curl_handle_key);
 	if (curl_handle == NULL) {
 		curl_handle = curl_easy_init();
+		if (curl_handle == NULL) {
+			return NULL;
+		}
+		pthread_setspecific(curl_handle_key, curl_handle);
+
 		curl_easy_setopt(curl_handle, CURLOPT_COOKIEFILE, ""); /* Enable the cookie engine */
-		curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 120L); /* Set the timeout to 2 minutes */
+		curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L); /* Needed with threads */
+		curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, ""); /* Take compressed pages */
+		curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, net_abort_cancelled);
+		curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 0L); /* Needed for cancelling */
+		if (curl_share != NULL) {
+			curl_easy_setopt(curl_handle, CURLOPT_SHARE, curl_share);
+		}
 	} else {
 		curl_easy_setopt(curl_handle, CURLOPT_COOKIELIST, "ALL"); /* Remove all cookies */
 		curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, NULL);
 		curl_easy_setopt(curl_handle, CURLOPT_HTTPGET, 1L);
+		curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, NULL);
+		curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, NULL);
+		curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, NULL);
 	}
+
+	return curl_handle;
 }
 
 /**
@@ -83,12 +295,10 @@ write_data_to_response(void *ptr, size_t size, size_t nmemb, struct curl_respons
 
 	tmp = realloc(data->data, data->size + 1); /* +1 for '\0' */
 
+	/* The old buffer is freed by net_request() */
 	if(tmp) {
 		data->data = tmp;
 	} else {
-		if(data->data) {
-			free(data->data);
-		}
 		wb_error("failed to allocate memory");
 		return 0;
 	}
@@ -110,17 +320,21 @@ write_data_to_response(void *ptr, size_t size, size_t nmemb, struct curl_respons
 struct wb_str_list *
 curl_get_cookies(CURL *curl) {
 	CURLcode res;
-	struct wb_str_list *cookies;
+	struct curl_slist *list = NULL, *item;
+	struct wb_str_list *cookies = NULL;
 
-	res = curl_easy_getinfo(curl, CURLINFO_COOKIELIST, &cookies);
+	res = curl_easy_getinfo(curl, CURLINFO_COOKIELIST, &list);
 	if (res != CURLE_OK) {
-		if (cookies != NULL) {
-			wb_list_free(cookies);
-		}
-
+		curl_slist_free_all(list);
 		return NULL;
 	}
 
+	/* The list is curl's memory, copy it to free it like any other */
+	for (item = list; item != NULL; item = item->next) {
+		cookies = wb_list_append(cookies, item->data);
+	}
+	curl_slist_free_all(list);
+
 	return cookies;
 }
 
@@ -141,25 +355,192 @@ curl_add_cookies(CURL *curl, struct wb_str_list *cookies) {
 }
 
 /**
- * Connects to URL with a GET or POST request and returns
- * the response.
+ * Stores the value of a header in a string if the header has the
+ * given name.
+ *
+ * @param header - the header line, not NUL-terminated
+ * @param length - the length of the header line
+ * @param name - the header name, with the trailing ':'
+ * @param value - where to store the value. A previous value is
+ *   freed.
+ */
+void
+read_header_value(const char *header, size_t length, const char *name, char **value) {
+	size_t name_length = strlen(name);
+	size_t start, end;
+
+	if (length < name_length || strncasecmp(header, name, name_length) != 0) {
+		return;
+	}
+
+	start = name_length;
+	end = length;
+	while (start < end && (header[start] == ' ' || header[start] == '\t')) {
+		start++;
+	}
+	while (end > start && (header[end - 1] == '\r' || header[end - 1] == '\n'
+		|| header[end - 1] == ' ' || header[end - 1] == '\t')) {
+		end--;
+	}
+
+	free(*value);
+	*value = strndup(header + start, end - start);
+}
+
+/**
+ * Collects the validators of a response from its headers.
+ *
+ * @param buffer - a header line, not NUL-terminated.
+ * @param size - always 1.
+ * @param nitems - the length of the header line.
+ * @param validators - where to store the validators.
+ * @return the length of the header line.
+ */
+size_t
+read_validator_headers(char *buffer, size_t size, size_t nitems, struct net_validators *validators) {
+	size_t length = size * nitems;
+
+	/* A new response, like one after a redirect, starts over */
+	if (length >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+		net_validators_free(validators);
+	}
+
+	read_header_value(buffer, length, "ETag:", &validators->etag);
+	read_header_value(buffer, length, "Last-Modified:", &validators->last_modified);
+
+	return length;
+}
+
+/**
+ * Frees the strings of a validators structure, but not the
+ * structure itself.
+ *
+ * @param validators - the validators
+ */
+void
+net_validators_free(struct net_validators *validators) {
+	free(validators->etag);
+	free(validators->last_modified);
+	validators->etag = NULL;
+	validators->last_modified = NULL;
+}
+
+/**
+ * Adds a header to a header list if the value is set.
+ *
+ * @param headers - the header list
+ * @param name - the header name, with the trailing ": "
+ * @param value - the header value, or NULL
+ * @return the new header list.
+ */
+struct curl_slist *
+add_header(struct curl_slist *headers, const char *name, const char *value) {
+	struct curl_slist *new_headers;
+	char *header;
+
+	if (value == NULL) {
+		return headers;
+	}
+
+	header = (char *) malloc(strlen(name) + strlen(value) + 1);
+	if (header == NULL) {
+		return headers;
+	}
+	strcpy(header, name);
+	strcat(header, value);
+
+	new_headers = curl_slist_append(headers, header);
+	free(header);
+
+	return new_headers != NULL ? new_headers : headers;
+}
+
+/**
+ * Gets how long a request phase took from two of curl's times,
+ * which are measured from the start of the request.
+ *
+ * @param end - the time the phase ended, in microseconds
+ * @param start - the time the phase started, in microseconds
+ * @return the duration in seconds, 0 if the phase was skipped.
+ */
+double
+net_phase_time(curl_off_t end, curl_off_t start) {
+	return (end > start) ? (end - start) / 1e6 : 0;
+}
+
+/**
+ * Records the timings and sizes of a finished request.
+ *
+ * @param curl - the CURL handle of the request
+ */
+void
+net_record_stats(CURL *curl) {
+	curl_off_t namelookup = 0, connect = 0, appconnect = 0;
+	curl_off_t starttransfer = 0, total = 0;
+	curl_off_t received = 0, sent = 0;
+	long header_size = 0, request_size = 0;
+
+	curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+	curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+	curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+	curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+	curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &sent);
+	curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &header_size);
+	curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &request_size);
+
+	wb_stats_count(WB_STATS_REQUESTS, 1);
+	wb_stats_count(WB_STATS_BYTES_RECEIVED, (unsigned long) received + header_size);
+	wb_stats_count(WB_STATS_BYTES_SENT, (unsigned long) sent + request_size);
+
+	wb_stats_record(WB_STATS_NAMELOOKUP, net_phase_time(namelookup, 0));
+	wb_stats_record(WB_STATS_CONNECT, net_phase_time(connect, namelookup));
+
+	/* The TLS handshake is only timed for HTTPS requests */
+	if (appconnect > 0) {
+		wb_stats_record(WB_STATS_APPCONNECT, net_phase_time(appconnect, connect));
+		connect = appconnect;
+	}
+
+	wb_stats_record(WB_STATS_STARTTRANSFER, net_phase_time(starttransfer, connect));
+	wb_stats_record(WB_STATS_TOTAL, net_phase_time(total, 0));
+}
+
+/**
+ * Connects to URL with a GET or POST request and returns the
+ * response. Optionally makes the request conditional.
  *
  * @param url - the URL to connect to.
- * @param post_data (optional) - the post data as a string.
- *   If specified, a POST request is made. If post is not
- *   needed, pass NULL here and a GET request will be made.
- * @param cookies (optional) - the cookies to use for this
- *   request.
- * @param update_cookies - 1 if you need the cookies to be
- *   updated, 0 to leave the cookies as they were.
- * @return the response as a string on success, NULL otherwise.
- *   IMPORTANT: the returned string should be freed with free().
+ * @param post_data (optional) - the post data, NULL for GET.
+ * @param cookies (optional) - the cookies to use for this request.
+ * @param update_cookies - 1 if you need the cookies to be updated.
+ * @param validators (optional) - validators of the last response.
+ *   They are sent with the request and replaced with the ones of
+ *   the new response.
+ * @param not_modified (optional) - set to 1 if the server answered
+ *   that the page did not change since the validators, 0 otherwise.
+ * @return the response as a string on success, NULL otherwise or if
+ *   the page was not modified. IMPORTANT: the returned string should
+ *   be freed with free().
  */
 char *
-net_get_response(const char *url, const char *post_data,
-	struct wb_str_list **cookies, int update_cookies) {
+net_request(const char *url, const char *post_data,
+	struct wb_str_list **cookies, int update_cookies,
+	struct net_validators *validators, int *not_modified) {
 
+	struct net_validators received = {NULL, NULL};
+	struct curl_slist *headers = NULL;
+	long status = 0, timeout_ms;
+	double start = 0;
 	CURLcode res;
+	CURL *curl_handle;
+
+	/* Nothing is started past the deadline or once cancelled */
+	timeout_ms = net_timeout_ms();
+	if (timeout_ms == 0 || net_cancelled()) {
+		return NULL;
+	}
 
 	/* Set up struct for CURL response */
 	struct curl_response response;
@@ -170,9 +551,18 @@ net_get_response(const char *url, const char *post_data,
 	}
 	response.data[0] = '\0';
 
+	if (not_modified != NULL) {
+		*not_modified = 0;
+	}
+
 	/* Set up CURL */
-	setup_curl_handle();
+	curl_handle = setup_curl_handle();
+	if (curl_handle == NULL) {
+		free(response.data);
+		return NULL;
+	}
 	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+	curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, timeout_ms);
 	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_data_to_response);
 	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &response);
 
@@ -184,12 +574,59 @@ net_get_response(const char *url, const char *post_data,
 		curl_add_cookies(curl_handle, *cookies);
 	}
 
+	if (validators != NULL) {
+		headers = add_header(headers, "If-None-Match: ", validators->etag);
+		headers = add_header(headers, "If-Modified-Since: ", validators->last_modified);
+		curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+		curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, read_validator_headers);
+		curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, &received);
+	}
+
 	/* Perform CURL transaction */
+	if (wb_trace_enabled) {
+		start = wb_stats_now();
+	}
 	res = curl_easy_perform(curl_handle);
+	if (wb_trace_enabled) {
+		wb_trace_span("download", "net", start, wb_stats_now(), url);
+	}
+	curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &status);
+	if (wb_stats_enabled) {
+		net_record_stats(curl_handle);
+	}
+	curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, NULL);
+	curl_slist_free_all(headers);
+
 	if (res != CURLE_OK) {
+		net_validators_free(&received);
+		free(response.data);
+		return NULL;
+	}
+
+	/* A busy or broken server does not send the page that was asked for */
+	if (status == 429 || status >= 500) {
+		wb_error("request to %s failed with HTTP %ld", url, status);
+		net_validators_free(&received);
+		free(response.data);
 		return NULL;
 	}
 
+	/* Keep the old validators if the page did not change */
+	if (validators != NULL) {
+		if (status == 304) {
+			wb_stats_count(WB_STATS_NOT_MODIFIED, 1);
+			net_validators_free(&received);
+			free(response.data);
+			if (not_modified != NULL) {
+				*not_modified = 1;
+			}
+			return NULL;
+		}
+
+		net_validators_free(validators);
+		*validators = received;
+	}
+
 	/* Update cookies if needed */
 	if (update_cookies == 1) {
 		if (cookies != NULL) {
@@ -198,6 +635,7 @@ net_get_response(const char *url, const char *post_data,
 
 		*cookies = curl_get_cookies(curl_handle);
 		if (*cookies == NULL) {
+			free(response.data);
 			return NULL;
 		}
 	}
@@ -205,6 +643,28 @@ net_get_response(const char *url, const char *post_data,
 	return response.data;
 }
 
+/**
+ * Connects to URL with a GET or POST request and returns
+ * the response.
+ *
+ * @param url - the URL to connect to.
+ * @param post_data (optional) - the post data as a string.
+ *   If specified, a POST request is made. If post is not
+ *   needed, pass NULL here and a GET request will be made.
+ * @param cookies (optional) - the cookies to use for this
+ *   request.
+ * @param update_cookies - 1 if you need the cookies to be
+ *   updated, 0 to leave the cookies as they were.
+ * @return the response as a string on success, NULL otherwise.
+ *   IMPORTANT: the returned string should be freed with free().
+ */
+char *
+net_get_response(const char *url, const char *post_data,
+	struct wb_str_list **cookies, int update_cookies) {
+
+	return net_request(url, post_data, cookies, update_cookies, NULL, NULL);
+}
+
 /**
  * A wrapper for net_get_response(). Should be used when the
  * response is not needed.
@@ -22,8 +22,20 @@
 
 #include "types.h"
 
+/* What a server sent to tell if a page changed */
+struct net_validators {
+	char *etag;
+	char *last_modified;
+};
+
 void net_init();
 void net_cleanup();
+void net_set_deadline(double deadline);
+long net_timeout_ms();
+void net_cancel();
+int net_cancelled();
+char *net_request(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies, struct net_validators *validators, int *not_modified);
+void net_validators_free(struct net_validators *validators);
 char *net_get_response(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies);
 int net_connect(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies);
 
@@ -0,0 +1,455 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/* Initial capacity of a worker deque, must be a power of two */
+#define WB_POOL_DEQUE_CAPACITY 64
+
+struct wb_pool_task {
+	wb_pool_func func;
+	void *arg;
+};
+
+/*
+ * A double-ended task queue owned by one worker. The owner pushes
+ * and pops at the bottom (LIFO, keeps caches warm), idle workers
+ * steal from the top (FIFO, takes the oldest work).
+ */
+struct wb_pool_deque {
+	pthread_mutex_t lock;
+	struct wb_pool_task *tasks;
+	unsigned int capacity;
+	unsigned int top, bottom;
+};
+
+struct wb_pool_worker {
+	struct wb_pool *pool;
+	int id;
+	pthread_t thread;
+	struct wb_pool_deque deque;
+};
+
+struct wb_pool {
+	struct wb_pool_worker *workers;
+	int worker_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int queued;  /* tasks waiting in deques */
+	int pending; /* queued tasks + running tasks */
+	int next_worker;
+	int stopping;
+};
+
+/* The worker the calling thread belongs to, if any */
+static pthread_key_t current_worker_key;
+static pthread_once_t current_worker_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Creates the thread-specific key for the current worker.
+ */
+void
+pool_create_current_worker_key() {
+	pthread_key_create(&current_worker_key, NULL);
+}
+
+/**
+ * Initializes an empty deque.
+ *
+ * @param deque - the deque to initialize
+ * @return 0 on success, -1 otherwise.
+ */
+int
+pool_deque_init(struct wb_pool_deque *deque) {
+	deque->tasks = (struct wb_pool_task *) malloc(
+		WB_POOL_DEQUE_CAPACITY * sizeof(struct wb_pool_task));
+	if (deque->tasks == NULL) {
+		return -1;
+	}
+
+	deque->capacity = WB_POOL_DEQUE_CAPACITY;
+	deque->top = 0;
+	deque->bottom = 0;
+	pthread_mutex_init(&deque->lock, NULL);
+
+	return 0;
+}
+
+/**
+ * Frees the memory used by a deque.
+ *
+ * @param deque - the deque to destroy
+ */
+void
+pool_deque_destroy(struct wb_pool_deque *deque) {
+	pthread_mutex_destroy(&deque->lock);
+	free(deque->tasks);
+}
+
+/**
+ * Pushes a task to the bottom of a deque, growing it if needed.
+ *
+ * @param deque - the deque to push to
+ * @param task - the task to push
+ * @return 0 on success, -1 otherwise.
+ */
+int
+pool_deque_push_bottom(struct wb_pool_deque *deque, struct wb_pool_task task) {
+	struct wb_pool_task *tasks;
+	unsigned int i, size;
+
+	pthread_mutex_lock(&deque->lock);
+
+	size = deque->bottom - deque->top;
+	if (size == deque->capacity) {
+		tasks = (struct wb_pool_task *) malloc(
+			2 * deque->capacity * sizeof(struct wb_pool_task));
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&deque->lock);
+			return -1;
+		}
+
+		for (i = 0; i < size; i++) {
+			tasks[i] = deque->tasks[(deque->top + i) & (deque->capacity - 1)];
+		}
+
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->capacity *= 2;
+		deque->top = 0;
+		deque->bottom = size;
+	}
+
+	deque->tasks[deque->bottom & (deque->capacity - 1)] = task;
+	deque->bottom++;
+
+	pthread_mutex_unlock(&deque->lock);
+	return 0;
+}
+
+/**
+ * Pops a task from the bottom of a deque. Used by the owner.
+ *
+ * @param deque - the deque to pop from
+ * @param task - where to store the popped task
+ * @return 0 on success, -1 if the deque is empty.
+ */
+int
+pool_deque_pop_bottom(struct wb_pool_deque *deque, struct wb_pool_task *task) {
+	int res = -1;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top) {
+		deque->bottom--;
+		*task = deque->tasks[deque->bottom & (deque->capacity - 1)];
+		res = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return res;
+}
+
+/**
+ * Takes a task from the top of a deque. Used by thieves.
+ *
+ * @param deque - the deque to steal from
+ * @param task - where to store the stolen task
+ * @return 0 on success, -1 if the deque is empty.
+ */
+int
+pool_deque_steal_top(struct wb_pool_deque *deque, struct wb_pool_task *task) {
+	int res = -1;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top) {
+		*task = deque->tasks[deque->top & (deque->capacity - 1)];
+		deque->top++;
+		res = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return res;
+}
+
+/**
+ * Finds a task for a worker: first from its own deque, then by
+ * stealing from the other workers, starting with its neighbour.
+ *
+ * @param worker - the worker looking for work
+ * @param task - where to store the found task
+ * @return 0 if a task was found, -1 otherwise.
+ */
+int
+pool_find_task(struct wb_pool_worker *worker, struct wb_pool_task *task) {
+	struct wb_pool *pool = worker->pool;
+	int i, victim;
+
+	if (pool_deque_pop_bottom(&worker->deque, task) == 0) {
+		return 0;
+	}
+
+	for (i = 1; i < pool->worker_count; i++) {
+		victim = (worker->id + i) % pool->worker_count;
+		if (pool_deque_steal_top(&pool->workers[victim].deque, task) == 0) {
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * The main loop of a worker thread.
+ *
+ * @param arg - the wb_pool_worker this thread runs
+ * @return always NULL.
+ */
+void *
+pool_worker_main(void *arg) {
+	struct wb_pool_worker *worker = (struct wb_pool_worker *) arg;
+	struct wb_pool *pool = worker->pool;
+	struct wb_pool_task task;
+
+	pthread_setspecific(current_worker_key, worker);
+
+	for (;;) {
+		if (pool_find_task(worker, &task) == 0) {
+			pthread_mutex_lock(&pool->lock);
+			pool->queued--;
+			pthread_mutex_unlock(&pool->lock);
+
+			task.func(task.arg);
+
+			pthread_mutex_lock(&pool->lock);
+			pool->pending--;
+			if (pool->pending == 0) {
+				pthread_cond_broadcast(&pool->done_cond);
+			}
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+
+		/* Nothing to run or steal, sleep until new work arrives */
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queued == 0 && !pool->stopping) {
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		}
+		if (pool->queued == 0 && pool->stopping) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Stops the running workers and frees the pool. Every deque up to
+ * pool->worker_count must have been initialized.
+ *
+ * @param pool - the pool to destroy
+ * @param running - the number of workers with a running thread
+ */
+void
+pool_destroy(struct wb_pool *pool, int running) {
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < running; i++) {
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	for (i = 0; i < pool->worker_count; i++) {
+		pool_deque_destroy(&pool->workers[i].deque);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	free(pool->workers);
+	free(pool);
+}
+
+/**
+ * Get the default number of pool workers: one per online CPU.
+ *
+ * @return the number of online CPUs, at least 1.
+ */
+int
+wb_pool_default_workers() {
+	long cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1) {
+		return 1;
+	}
+
+	return (int) cpus;
+}
+
+/**
+ * Creates a new work-stealing thread pool.
+ *
+ * @param workers - the number of worker threads, or 0 to use
+ *   wb_pool_default_workers().
+ * @return a new pool on success, NULL otherwise. IMPORTANT: the
+ *   returned pool must be freed with wb_pool_free().
+ */
+struct wb_pool *
+wb_pool_new(int workers) {
+	struct wb_pool *pool;
+	int i;
+
+	if (workers <= 0) {
+		workers = wb_pool_default_workers();
+	}
+
+	pthread_once(&current_worker_once, pool_create_current_worker_key);
+
+	pool = (struct wb_pool *) malloc(sizeof(struct wb_pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->workers = (struct wb_pool_worker *) calloc(workers,
+		sizeof(struct wb_pool_worker));
+	if (pool->workers == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->worker_count = workers;
+	pool->queued = 0;
+	pool->pending = 0;
+	pool->next_worker = 0;
+	pool->stopping = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	/* All deques must exist before any worker starts stealing */
+	for (i = 0; i < workers; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		if (pool_deque_init(&pool->workers[i].deque) != 0) {
+			pool->worker_count = i;
+			pool_destroy(pool, 0);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&pool->workers[i].thread, NULL, pool_worker_main,
+			&pool->workers[i]) != 0) {
+
+			pool_destroy(pool, i);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+/**
+ * Submits a task to the pool. When called from inside a pool task
+ * the new task goes to the calling worker's own deque, otherwise the
+ * tasks are spread over the workers round-robin.
+ *
+ * @param pool - the pool to run the task in
+ * @param func - the function to run
+ * @param arg - the argument passed to func
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_pool_submit(struct wb_pool *pool, wb_pool_func func, void *arg) {
+	struct wb_pool_worker *worker;
+	struct wb_pool_task task;
+
+	task.func = func;
+	task.arg = arg;
+
+	worker = (struct wb_pool_worker *) pthread_getspecific(current_worker_key);
+
+	pthread_mutex_lock(&pool->lock);
+	if (worker == NULL || worker->pool != pool) {
+		worker = &pool->workers[pool->next_worker];
+		pool->next_worker = (pool->next_worker + 1) % pool->worker_count;
+	}
+	pool->pending++;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (pool_deque_push_bottom(&worker->deque, task) != 0) {
+		pthread_mutex_lock(&pool->lock);
+		pool->pending--;
+		if (pool->pending == 0) {
+			pthread_cond_broadcast(&pool->done_cond);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		return -1;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++;
+	pthread_cond_signal(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * Waits until every submitted task, including the tasks submitted
+ * by other tasks, has finished.
+ *
+ * @param pool - the pool to wait for
+ */
+void
+wb_pool_wait(struct wb_pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Waits for all tasks to finish, stops the workers and frees
+ * the pool.
+ *
+ * @param pool - the pool to free
+ */
+void
+wb_pool_free(struct wb_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	wb_pool_wait(pool);
+	pool_destroy(pool, pool->worker_count);
+}
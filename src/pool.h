@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_POOL_H
+#define INCLUDED_WB_POOL_H
+
+typedef void (*wb_pool_func)(void *arg);
+
+struct wb_pool;
+
+int wb_pool_default_workers();
+struct wb_pool *wb_pool_new(int workers);
+int wb_pool_submit(struct wb_pool *pool, wb_pool_func func, void *arg);
+void wb_pool_wait(struct wb_pool *pool);
+void wb_pool_free(struct wb_pool *pool);
+
+#endif
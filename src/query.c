@@ -33,6 +33,60 @@ static const char *URL_ENDPOINT_TOPLIST    = "/toplist";
 static const char *URL_ENDPOINT_RANDOM     = "/random";
 static const char *URL_ENDPOINT_COLLECTION = "/collection";
 
+/* Where requests go instead of URL_BASE, or NULL */
+static const char *url_base_override = NULL;
+
+/* Option values wallbase.cc accepts, indexed by the WB_* constants */
+static const char *RES_OPT_STRINGS[] = {
+	"eqeq",     /* WB_RES_EXACTLY */
+	"gteq"      /* WB_RES_AT_LEAST */
+};
+
+static const char *SORT_BY_STRINGS[] = {
+	"",
+	"relevance", /* WB_SORT_RELEVANCE */
+	"views",     /* WB_SORT_VIEWS */
+	"date",      /* WB_SORT_DATE */
+	"favs",      /* WB_SORT_FAVORITES */
+	"random"     /* WB_SORT_RANDOM */
+};
+
+static const char *SORT_ORDER_STRINGS[] = {
+	"asc",      /* WB_SORT_ASCENDING */
+	"desc"      /* WB_SORT_DESCENDING */
+};
+
+static const char *TOPLIST_INTERVAL_STRINGS[] = {
+	"",
+	"1d", "3d", "1w", "2w", "1m", "2m", "3m",
+	"1"         /* WB_TOPLIST_ALL_TIME */
+};
+
+/* Indexed by WB_PURITY_* flags: SFW, sketchy, NSFW */
+static const char *PURITY_STRINGS[] = {
+	"000", "100", "010", "110", "001", "101", "011", "111"
+};
+
+/* Indexed by WB_BOARD_* flags: anime (1), general (2), high res (3) */
+static const char *BOARD_STRINGS[] = {
+	"", "2", "1", "12", "3", "23", "13", "123"
+};
+
+/* Thumbnails per page values wallbase.cc accepts, smallest first */
+static const int THPP_VALUES[] = {20, 32, 40, 60};
+
+#define THPP_VALUES_SIZE ARR_SIZE(THPP_VALUES)
+
+/* Maximum number of parameters in a query URL */
+#define URL_PARAMS_MAX 12
+
+/* URL parameters, collected before the URL is built */
+struct url_params {
+	const char *names[URL_PARAMS_MAX];
+	const char *values[URL_PARAMS_MAX];
+	int count;
+};
+
 /**
  * Try to detect the query type from options.
  *
@@ -63,121 +117,49 @@ get_query_type(struct options *options) {
 }
 
 /**
- * Get the resolution option string wallbase.cc accepts from
- * an option structure.
+ * Plans the listing page requests needed to get a number of
+ * images. If the page size is not given, the one that needs the
+ * fewest pages is used, and the smallest such one if there is a
+ * tie, so the last page is not bigger than it has to be.
  *
- * @param options - the option structure
- * @return the resolution option.
+ * @param images - the number of images to get
+ * @param images_per_page - the page size to use, or 0 to choose one
+ * @param plan - the plan to fill in
  */
-char *
-get_res_opt_string(struct options *options) {
-	char *str;
-
-	switch(options->res_opt) {
-		case WB_RES_EXACTLY:
-			str = "eqeq";
-			break;
-		case WB_RES_AT_LEAST:
-			str = "gteq";
-			break;
+void
+wb_plan_pages(int images, int images_per_page, struct wb_plan *plan) {
+	int page_count, i;
+
+	if (images_per_page <= 0) {
+		images_per_page = THPP_VALUES[0];
+		for (i = 1; i < THPP_VALUES_SIZE; i++) {
+			page_count = (images + THPP_VALUES[i] - 1) / THPP_VALUES[i];
+			if (page_count < (images + images_per_page - 1) / images_per_page) {
+				images_per_page = THPP_VALUES[i];
+			}
+		}
 	}
 
-	return str;
-}
-
-/**
- * Get the sort by string wallbase.cc accepts from an option
- * structure.
- *
- * @param options - the option structure
- * @return the sort by string.
- */
-char *
-get_sort_by_string(struct options *options) {
-	char *str;
-
-	switch(options->sort_by) {
-		case WB_SORT_RELEVANCE:
-			str = "relevance";
-			break;
-		case WB_SORT_VIEWS:
-			str = "views";
-			break;
-		case WB_SORT_DATE:
-			str = "date";
-			break;
-		case WB_SORT_FAVORITES:
-			str = "favs";
-			break;
-		case WB_SORT_RANDOM:
-			str = "random";
-			break;
+	plan->images_per_page = images_per_page;
+	plan->page_count = (images + images_per_page - 1) / images_per_page;
+	plan->last_page_images = 0;
+	if (plan->page_count > 0) {
+		plan->last_page_images = images - (plan->page_count - 1) * images_per_page;
 	}
-
-	return str;
 }
 
 /**
- * Get the sort order string wallbase.cc accepts from an option
- * structure.
- *
- * @param options - the option structure
- * @return the sort order string.
- */
-char *
-get_sort_order_string(struct options *options) {
-	char *str;
-
-	switch(options->sort_order) {
-		case WB_SORT_ASCENDING:
-			str = "asc";
-			break;
-		case WB_SORT_DESCENDING:
-			str = "desc";
-			break;
-	}
-
-	return str;
-}
-
-/**
- * Get the toplist interval by string wallbase.cc accepts from
- * an option structure.
+ * Get the thumbs per page string wallbase.cc accepts from an
+ * option structure.
  *
  * @param options - the option structure
- * @return the toplist interval string.
+ * @param str - the buffer to write the string to
+ * @param size - the size of the buffer
+ * @return str.
  */
 char *
-get_toplist_interval_string(struct options *options) {
-	char *str;
-
-	switch(options->toplist) {
-		case WB_TOPLIST_1D:
-			str = "1d";
-			break;
-		case WB_TOPLIST_3D:
-			str = "3d";
-			break;
-		case WB_TOPLIST_1W:
-			str = "1w";
-			break;
-		case WB_TOPLIST_2W:
-			str = "2w";
-			break;
-		case WB_TOPLIST_1M:
-			str = "1m";
-			break;
-		case WB_TOPLIST_2M:
-			str = "2m";
-			break;
-		case WB_TOPLIST_3M:
-			str = "3m";
-			break;
-		case WB_TOPLIST_ALL_TIME:
-			str = "1";
-			break;
-	}
-
+get_thpp_string(struct options *options, char *str, int size) {
+	snprintf(str, size, "%d", options->images_per_page);
 	return str;
 }
 
@@ -186,34 +168,28 @@ get_toplist_interval_string(struct options *options) {
  * structure.
  *
  * @param options - the option structure
- * @return the resolution string. IMPORTANT: the returned string
- *   must be freed using free().
+ * @param str - the buffer to write the string to
+ * @param size - the size of the buffer
+ * @return str.
  */
 char *
-get_resolution_string(struct options *options) {
-	char *str;
-
-	str = (char *) malloc(16);
-	snprintf(str, 16, "%dx%d", options->res_x, options->res_y);
-
+get_resolution_string(struct options *options, char *str, int size) {
+	snprintf(str, size, "%dx%d", options->res_x, options->res_y);
 	return str;
 }
 
 /**
  * Get the aspect ratio string wallbase.cc accepts from an
- * option structure.
+ * option structure. Only the first four characters are used.
  *
  * @param options - the option structure
- * @return the aspect ratio string. IMPORTANT: the returned
- *   string must be freed using free().
+ * @param str - the buffer to write the string to, at least 5
+ *   bytes long
+ * @return str.
  */
 char *
-get_aspect_ratio_string(struct options *options) {
-	char *str;
-
-	str = (char *) malloc(5);
+get_aspect_ratio_string(struct options *options, char *str) {
 	snprintf(str, 5, "%.2f", options->aspect_ratio);
-
 	return str;
 }
 
@@ -222,131 +198,77 @@ get_aspect_ratio_string(struct options *options) {
  * structure.
  *
  * @param options - the option structure
- * @return the color string. IMPORTANT: the returned string
- *   must be freed using free().
+ * @param str - the buffer to write the string to, at least 7
+ *   bytes long
+ * @return str.
  */
 char *
-get_color_string(struct options *options) {
-	char *str;
-
-	str = (char *) malloc(7);
+get_color_string(struct options *options, char *str) {
 	snprintf(str, 7, "%x", options->color);
-
 	return str;
 }
 
 /**
- * Get the thumbs per page string wallbase.cc accepts from an
- * option structure.
+ * Adds a parameter to a parameter list.
  *
- * @param options - the option structure
- * @return the resolution string. IMPORTANT: the returned string
- *   must be freed using free().
- */
-char *
-get_thpp_string(struct options *options) {
-	char *str;
-
-	str = (char *) malloc(8);
-	snprintf(str, 8, "%d", options->images_per_page);
-
-	return str;
-}
-
-/**
- * Get the purity string wallbase.cc accepts from an option
- * structure.
- *
- * @param options - the option structure
- * @return the purity string. IMPORTANT: the returned string
- *   must be freed using free().
+ * @param params - the parameter list
+ * @param name - the name of the new parameter
+ * @param value - the value of the new parameter. Must stay valid
+ *   until the URL is built.
  */
-char *
-get_purity_string(struct options *options) {
-	char *str;
-	int pos;
-
-	str = (char *) malloc(4);
-	str[3] = '\0';
-
-	pos = 0;
-	if ((options->purity & WB_PURITY_SFW) > 0) {
-		str[pos] = '1';
-	} else {
-		str[pos] = '0';
-	}
-
-	pos++;
-	if ((options->purity & WB_PURITY_SKETCHY) > 0) {
-		str[pos] = '1';
-	} else {
-		str[pos] = '0';
-	}
-
-	pos++;
-	if ((options->purity & WB_PURITY_NSFW) > 0) {
-		str[pos] = '1';
-	} else {
-		str[pos] = '0';
-	}
-
-	return str;
+void
+add_url_param(struct url_params *params, const char *name, const char *value) {
+	params->names[params->count] = name;
+	params->values[params->count] = value;
+	params->count++;
 }
 
 /**
- * Get the boards string wallbase.cc accepts from an option
- * structure.
+ * Builds a URL from a base URL and a parameter list. The length of
+ * the URL is measured first, so it is written in a single pass.
+ * Always adds a '&' character before every parameter.
  *
- * @param options - the option structure
- * @return the boards string. IMPORTANT: the returned string
- *   must be freed using free().
+ * @param url - the base URL
+ * @param params - the parameter list
+ * @return the parametrized URL. IMPORTANT: the returned URL should
+ *   be freed with free().
  */
 char *
-get_boards_string(struct options *options) {
-	char *str;
-	int pos;
-
-	str = (char *) malloc(4);
-	pos = 0;
-
-	if ((options->boards & WB_BOARD_ANIME) > 0) {
-		str[pos] = '1';
-		pos++;
+build_url(const char *url, struct url_params *params) {
+	size_t lengths[URL_PARAMS_MAX * 2];
+	size_t url_length, total, n;
+	char *new_url, *pos;
+	int i;
+
+	url_length = strlen(url);
+	total = url_length + 1;
+
+	for (i = 0; i < params->count; i++) {
+		lengths[i * 2] = strlen(params->names[i]);
+		lengths[i * 2 + 1] = strlen(params->values[i]);
+		total += lengths[i * 2] + lengths[i * 2 + 1] + 2;
 	}
 
-	if ((options->boards & WB_BOARD_GENERAL) > 0) {
-		str[pos] = '2';
-		pos++;
+	new_url = (char *) malloc(total);
+	if (new_url == NULL) {
+		return NULL;
 	}
 
-	if ((options->boards & WB_BOARD_HIGHRES) > 0) {
-		str[pos] = '3';
-		pos++;
+	memcpy(new_url, url, url_length);
+	pos = new_url + url_length;
+
+	for (i = 0; i < params->count; i++) {
+		*pos++ = '&';
+		n = lengths[i * 2];
+		memcpy(pos, params->names[i], n);
+		pos += n;
+		*pos++ = '=';
+		n = lengths[i * 2 + 1];
+		memcpy(pos, params->values[i], n);
+		pos += n;
 	}
 
-	str[pos] = '\0';
-
-	return str;
-}
-
-/**
- * Adds a parameter to a URL. Always adds a '&' character.
- *
- * @param url - the URL to add a parameter to
- * @param name - the name of the new parameter
- * @param value - the value of the new parameter
- * @return a URL with the added parameter. IMPORTANT: the returned
- *   string must be freed with free().
- */
-char *
-add_url_param(char *url, char *name, char *value) {
-	int new_length;
-	char *new_url;
-
-	new_length = strlen(url) + strlen(name) + strlen(value) + 3;
-	new_url = (char *) malloc(new_length);
-
-	snprintf(new_url, new_length, "%s&%s=%s", url, name, value);
+	*pos = '\0';
 
 	return new_url;
 }
@@ -361,93 +283,49 @@ add_url_param(char *url, char *name, char *value) {
  *   be freed with free().
  */
 char *
-add_url_params_from_options(char *url, int query_type, struct options *options) {
-	char *new_url, *temp_url, *temp_value;
+add_url_params_from_options(const char *url, int query_type, struct options *options) {
+	struct url_params params;
+	char color[8], resolution[32], thpp[16], aspect[8];
 
-	new_url = (char *) malloc(strlen(url) + 1);
-	strcpy(new_url, url);
+	params.count = 0;
 
 	/* Add string query */
 	if (options->query != NULL) {
-		temp_url = add_url_param(new_url, "q", options->query);
-		free(new_url);
-		new_url = temp_url;
+		add_url_param(&params, "q", options->query);
 	}
 
 	/* Add color */
 	if (options->color != -1) {
-		temp_value = get_color_string(options);
-		temp_url = add_url_param(new_url, "color", temp_value);
-		free(new_url);
-		free(temp_value);
-		new_url = temp_url;
+		add_url_param(&params, "color", get_color_string(options, color));
 	}
 
-	/* Add res option */
-	temp_value = get_res_opt_string(options);
-	temp_url = add_url_param(new_url, "res_opt", temp_value);
-	free(new_url);
-	new_url = temp_url;
-
-	/* Add resolution */
-	temp_value = get_resolution_string(options);
-	temp_url = add_url_param(new_url, "res", temp_value);
-	free(new_url);
-	free(temp_value);
-	new_url = temp_url;
+	/* Add res option and resolution */
+	add_url_param(&params, "res_opt", RES_OPT_STRINGS[options->res_opt]);
+	add_url_param(&params, "res",
+		get_resolution_string(options, resolution, sizeof(resolution)));
 
 	/* Add sort by and sort order */
 	if (query_type == WB_TYPE_SEARCH) {
-		/* Add sort order */
-		temp_value = get_sort_order_string(options);
-		temp_url = add_url_param(new_url, "order_mode", temp_value);
-		free(new_url);
-		new_url = temp_url;
-
-		/* Add sort by */
-		temp_value = get_sort_by_string(options);
-		temp_url = add_url_param(new_url, "order", temp_value);
-		free(new_url);
-		new_url = temp_url;
+		add_url_param(&params, "order_mode", SORT_ORDER_STRINGS[options->sort_order]);
+		add_url_param(&params, "order", SORT_BY_STRINGS[options->sort_by]);
 	}
 
 	/* Add thumbnails per page*/
-	temp_value = get_thpp_string(options);
-	temp_url = add_url_param(new_url, "thpp", temp_value);
-	free(new_url);
-	free(temp_value);
-	new_url = temp_url;
-
-	/* Add purity */
-	temp_value = get_purity_string(options);
-	temp_url = add_url_param(new_url, "purity", temp_value);
-	free(new_url);
-	free(temp_value);
-	new_url = temp_url;
-
-	/* Add boards */
-	temp_value = get_boards_string(options);
-	temp_url = add_url_param(new_url, "board", temp_value);
-	free(new_url);
-	free(temp_value);
-	new_url = temp_url;
+	add_url_param(&params, "thpp", get_thpp_string(options, thpp, sizeof(thpp)));
+
+	/* Add purity and boards */
+	add_url_param(&params, "purity", PURITY_STRINGS[options->purity & WB_PURITY_ALL]);
+	add_url_param(&params, "board", BOARD_STRINGS[options->boards & WB_BOARD_ALL]);
 
 	/* Add aspect ratio */
-	temp_value = get_aspect_ratio_string(options);
-	temp_url = add_url_param(new_url, "aspect", temp_value);
-	free(new_url);
-	free(temp_value);
-	new_url = temp_url;
+	add_url_param(&params, "aspect", get_aspect_ratio_string(options, aspect));
 
 	/* Add toplist interval */
 	if (query_type == WB_TYPE_TOPLIST) {
-		temp_value = get_toplist_interval_string(options);
-		temp_url = add_url_param(new_url, "ts", temp_value);
-		free(new_url);
-		new_url = temp_url;
+		add_url_param(&params, "ts", TOPLIST_INTERVAL_STRINGS[options->toplist]);
 	}
 
-	return new_url;
+	return build_url(url, &params);
 }
 
 /**
@@ -463,13 +341,15 @@ struct wb_query *
 wb_generate_query(struct options *options) {
 	struct wb_query *query;
 	int query_type;
-	char *url, *temp;
+	char url[WB_BASE_URL_MAX + 64], suffix[32];
+	const char *base;
 
 	const char *endpoint;
-	char *suffix;
 
 	query = (struct wb_query *) malloc(sizeof(struct wb_query));
-	url = (char *) malloc(128);
+	if (query == NULL) {
+		return NULL;
+	}
 
 	/* Determine the endpoint to be used */
 	query_type = get_query_type(options);
@@ -477,40 +357,129 @@ wb_generate_query(struct options *options) {
 	switch (query_type) {
 		case WB_TYPE_SEARCH:
 			endpoint = URL_ENDPOINT_SEARCH;
-			suffix = strdup(URL_ENDPOINT_GENERAL_SUFFIX);
+			snprintf(suffix, sizeof(suffix), "%s", URL_ENDPOINT_GENERAL_SUFFIX);
 			break;
 		case WB_TYPE_TOPLIST:
 			endpoint = URL_ENDPOINT_TOPLIST;
-			suffix = strdup(URL_ENDPOINT_GENERAL_SUFFIX);
+			snprintf(suffix, sizeof(suffix), "%s", URL_ENDPOINT_GENERAL_SUFFIX);
 			break;
 		case WB_TYPE_RANDOM:
 			endpoint = URL_ENDPOINT_RANDOM;
-			suffix = strdup(URL_ENDPOINT_GENERAL_SUFFIX);
+			snprintf(suffix, sizeof(suffix), "%s", URL_ENDPOINT_GENERAL_SUFFIX);
 			break;
 		case WB_TYPE_COLLECTION:
 			endpoint = URL_ENDPOINT_COLLECTION;
-			suffix = (char *) malloc(32);
-			snprintf(suffix, 32, URL_ENDPOINT_COLLECTION_SUFFIX,
+			snprintf(suffix, sizeof(suffix), URL_ENDPOINT_COLLECTION_SUFFIX,
 				options->collection_id);
 			break;
 	}
 
 	/* Generate the endpoint URL */
-	snprintf(url, 128, "%s%s%s", URL_BASE, endpoint, suffix);
-	free(suffix);
+	base = wb_query_base_url();
+	snprintf(url, sizeof(url), "%s%s%s", base, endpoint, suffix);
 
 	/* Add parameters from the option structure */
-	temp = add_url_params_from_options(url, query_type, options);
-	free(url);
-	url = temp;
-
-	/* Copy data to the final query structure */
-	query->url = url;
+	query->url = add_url_params_from_options(url, query_type, options);
 	query->post_data = NULL;
 
+	if (query->url == NULL) {
+		free(query);
+		return NULL;
+	}
+
+	/* Remember where the offset goes, parameters may contain "%d" too */
+	query->url_length = strlen(query->url);
+	query->offset_pos = strlen(base) + strlen(endpoint) + (strstr(suffix, "%d") - suffix);
+
 	return query;
 }
 
+/**
+ * Sends all requests to another server instead of wallbase.cc. Must
+ * be called before any query is generated.
+ *
+ * @param base_url - the scheme, host and port of the server, NULL
+ *   for wallbase.cc. It is not copied.
+ */
+void
+wb_query_set_base_url(const char *base_url) {
+	url_base_override = base_url;
+}
+
+/**
+ * Gets the URL that requests are sent to.
+ *
+ * @return the scheme, host and port, without a trailing '/'.
+ */
+const char *
+wb_query_base_url() {
+	return (url_base_override != NULL) ? url_base_override : URL_BASE;
+}
+
+/**
+ * Get the size of the buffer wb_query_page_url() needs.
+ *
+ * @param query - the query
+ * @return the buffer size in bytes.
+ */
+size_t
+wb_query_page_url_size(const struct wb_query *query) {
+	/* "%d" is replaced by at most 10 digits */
+	return query->url_length - 2 + 10 + 1;
+}
+
+/**
+ * Writes an unsigned integer in decimal.
+ *
+ * @param buffer - the buffer to write to, at least 10 bytes long
+ * @param n - the integer
+ * @return the number of characters written. The string is not
+ *   NUL-terminated.
+ */
+size_t
+write_uint(char *buffer, unsigned int n) {
+	char digits[10];
+	size_t length = 0;
+	size_t i;
+
+	do {
+		digits[length++] = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+
+	for (i = 0; i < length; i++) {
+		buffer[i] = digits[length - i - 1];
+	}
+
+	return length;
+}
+
+/**
+ * Writes the URL of the results page that starts at an image
+ * offset. Only the offset is formatted, the rest of the URL is
+ * copied as is, so the URL is never used as a format string.
+ *
+ * @param query - the query
+ * @param offset - the offset of the first image on the page, not
+ *   negative
+ * @param buffer - the buffer to write the URL to, at least
+ *   wb_query_page_url_size() bytes long. It can be reused for
+ *   every page.
+ * @return the length of the URL.
+ */
+size_t
+wb_query_page_url(const struct wb_query *query, int offset, char *buffer) {
+	size_t suffix_pos = query->offset_pos + 2;
+	size_t length;
+
+	memcpy(buffer, query->url, query->offset_pos);
+	length = query->offset_pos;
+	length += write_uint(buffer + length, (unsigned int) offset);
+	memcpy(buffer + length, query->url + suffix_pos, query->url_length - suffix_pos + 1);
+
+	return length + query->url_length - suffix_pos;
+}
+
 /**
  * Free a wb_query structure
  *
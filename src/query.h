@@ -22,12 +22,28 @@
 
 #include "types.h"
 
+#include <stddef.h>
+
 struct wb_query {
-	char *url;
+	char *url;          /* has a "%d" where the image offset goes */
+	size_t url_length;
+	size_t offset_pos;  /* position of the offset's "%d" in url */
 	char *post_data;
 };
 
+/* How the listing pages of a query are requested */
+struct wb_plan {
+	int images_per_page;
+	int page_count;
+	int last_page_images; /* images used from the last page */
+};
+
+void wb_plan_pages(int images, int images_per_page, struct wb_plan *plan);
 struct wb_query *wb_generate_query(struct options *options);
+size_t wb_query_page_url_size(const struct wb_query *query);
+size_t wb_query_page_url(const struct wb_query *query, int offset, char *buffer);
 void wb_query_free(struct wb_query *query);
+void wb_query_set_base_url(const char *base_url);
+const char *wb_query_base_url();
 
 #endif
@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+/* Elements whose content is raw text, not markup */
+static const char *RAW_TEXT_ELEMENTS[] = {
+	"script", "style", "textarea", "title", "xmp", "plaintext"
+};
+
+#define RAW_TEXT_ELEMENTS_SIZE ARR_SIZE(RAW_TEXT_ELEMENTS)
+
+/* Raw text elements before this one are raw text to tidy too. Tidy
+   parses markup in the others, so a '<' in them is ambiguous. */
+#define RAW_TEXT_ELEMENTS_TIDY 2
+
+/* One parsed attribute of a start tag */
+struct scan_attr {
+	const char *name;
+	size_t name_length;
+	const char *value;
+	size_t value_length;
+};
+
+/**
+ * Finds the first occurrence of a byte in a string, 16 or 32 bytes
+ * at a time when SSE2 or AVX2 is available.
+ *
+ * @param str - the start of the string
+ * @param end - the end of the string
+ * @param c - the byte to search for
+ * @return a pointer to the byte, or NULL if it was not found.
+ */
+const char *
+scan_find_byte(const char *str, const char *end, char c) {
+#ifdef __AVX2__
+	__m256i needle32 = _mm256_set1_epi8(c);
+	unsigned int mask32;
+
+	while (end - str >= 32) {
+		mask32 = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *) str), needle32));
+		if (mask32 != 0) {
+			return str + __builtin_ctz(mask32);
+		}
+		str += 32;
+	}
+#endif
+#ifdef __SSE2__
+	__m128i needle16 = _mm_set1_epi8(c);
+	unsigned int mask16;
+
+	while (end - str >= 16) {
+		mask16 = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) str), needle16));
+		if (mask16 != 0) {
+			return str + __builtin_ctz(mask16);
+		}
+		str += 16;
+	}
+#endif
+
+	return (const char *) memchr(str, c, end - str);
+}
+
+/**
+ * Case-insensitively compares a string of known length to a
+ * lowercase NUL-terminated string.
+ *
+ * @param str - the string
+ * @param length - the length of str
+ * @param lower - the lowercase string to compare with
+ * @return 1 if the strings are equal, 0 otherwise.
+ */
+int
+scan_name_equals(const char *str, size_t length, const char *lower) {
+	size_t i;
+	char c;
+
+	for (i = 0; i < length; i++) {
+		c = str[i];
+		if (c >= 'A' && c <= 'Z') {
+			c = c - 'A' + 'a';
+		}
+		if (lower[i] == '\0' || c != lower[i]) {
+			return 0;
+		}
+	}
+
+	return lower[length] == '\0';
+}
+
+/**
+ * Checks if a character is HTML whitespace.
+ */
+int
+scan_is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/**
+ * Checks if an attribute value would come out of tidy and the XML
+ * parser byte for byte. Entities are decoded, whitespace is
+ * normalized and non-ASCII bytes are re-encoded on that path, so
+ * values containing them are ambiguous.
+ *
+ * @param value - the attribute value
+ * @param length - the length of the value
+ * @return 1 if the value is plain, 0 otherwise.
+ */
+int
+scan_is_plain_value(const char *value, size_t length) {
+	size_t i;
+	unsigned char c;
+
+	for (i = 0; i < length; i++) {
+		c = (unsigned char) value[i];
+		if (c == '&' || c < 0x20 || c >= 0x80) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Checks if a URL attribute value would come out of tidy and the XML
+ * parser byte for byte. On top of what scan_is_plain_value() checks,
+ * tidy escapes spaces, '<', '>' and quotes in URIs and turns
+ * backslashes into '/', and an empty value is no match on that path.
+ *
+ * @param value - the attribute value
+ * @param length - the length of the value
+ * @return 1 if the value is plain, 0 otherwise.
+ */
+int
+scan_is_plain_url(const char *value, size_t length) {
+	size_t i;
+	char c;
+
+	if (length == 0 || !scan_is_plain_value(value, length)) {
+		return 0;
+	}
+
+	for (i = 0; i < length; i++) {
+		c = value[i];
+		if (c == ' ' || c == '<' || c == '>' || c == '\\' || c == '"' || c == '\'') {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Parses one attribute of a start tag.
+ *
+ * @param pos - the position to start parsing from, after whitespace
+ * @param end - the end of the document
+ * @param attr - where to store the attribute
+ * @return the position after the attribute, or NULL if the tag is
+ *   malformed.
+ */
+const char *
+scan_parse_attr(const char *pos, const char *end, struct scan_attr *attr) {
+	const char *value_end;
+	char quote;
+
+	attr->name = pos;
+	while (pos < end && !scan_is_space(*pos) && *pos != '=' && *pos != '>' && *pos != '/') {
+		if (*pos == '"' || *pos == '\'' || *pos == '<') {
+			return NULL;
+		}
+		pos++;
+	}
+	attr->name_length = pos - attr->name;
+
+	while (pos < end && scan_is_space(*pos)) {
+		pos++;
+	}
+
+	/* Attribute without a value */
+	if (pos >= end || *pos != '=') {
+		attr->value = pos;
+		attr->value_length = 0;
+		return pos;
+	}
+
+	pos++;
+	while (pos < end && scan_is_space(*pos)) {
+		pos++;
+	}
+
+	if (pos < end && (*pos == '"' || *pos == '\'')) {
+		quote = *pos++;
+		value_end = scan_find_byte(pos, end, quote);
+		if (value_end == NULL) {
+			return NULL;
+		}
+		attr->value = pos;
+		attr->value_length = value_end - pos;
+		return value_end + 1;
+	}
+
+	attr->value = pos;
+	while (pos < end && !scan_is_space(*pos) && *pos != '>') {
+		if (*pos == '"' || *pos == '\'' || *pos == '<' || *pos == '=' || *pos == '`') {
+			return NULL;
+		}
+		pos++;
+	}
+	attr->value_length = pos - attr->value;
+
+	return pos;
+}
+
+/**
+ * Finds the end of a raw text element's content, the start of its
+ * case-insensitive closing tag.
+ *
+ * @param pos - the start of the content
+ * @param end - the end of the document
+ * @param name - the lowercase element name
+ * @return a pointer to the closing tag, or NULL if there is none.
+ */
+const char *
+scan_skip_raw_text(const char *pos, const char *end, const char *name) {
+	size_t name_length = strlen(name);
+
+	while ((pos = scan_find_byte(pos, end, '<')) != NULL) {
+		if (end - pos >= (long) name_length + 2 && pos[1] == '/'
+			&& scan_name_equals(pos + 2, name_length, name)) {
+			return pos;
+		}
+		pos++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Finds the end of a comment.
+ *
+ * @param pos - the start of the comment's content
+ * @param end - the end of the document
+ * @return a pointer to the "-->" that ends the comment, or NULL if
+ *   there is none.
+ */
+const char *
+scan_find_comment_end(const char *pos, const char *end) {
+	while ((pos = scan_find_byte(pos, end, '-')) != NULL) {
+		if (end - pos >= 3 && pos[1] == '-' && pos[2] == '>') {
+			return pos;
+		}
+		pos++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks if a string contains a substring.
+ *
+ * @param str - the string
+ * @param length - the length of str
+ * @param sub - the NUL-terminated substring
+ * @return 1 if sub is in str, 0 otherwise.
+ */
+int
+scan_contains(const char *str, size_t length, const char *sub) {
+	size_t sub_length = strlen(sub);
+	size_t i;
+
+	for (i = 0; i + sub_length <= length; i++) {
+		if (memcmp(str + i, sub, sub_length) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Finds the image URL on a wallbase.cc image page by scanning the
+ * raw HTML for the same match as the XPath expression
+ * "//img[contains(@class,'wall')]/@src", without tidy, a DOM or
+ * XPath. Anything the scanner cannot be sure tidy would treat the
+ * same way makes the result ambiguous.
+ *
+ * @param html - the HTML of the page
+ * @param length - the length of the HTML
+ * @param result - where to store a view of the URL, pointing into
+ *   html
+ * @return WB_SCAN_FOUND if exactly one URL was found, WB_SCAN_NOT_FOUND
+ *   if there was none, WB_SCAN_AMBIGUOUS if the page must be parsed
+ *   properly.
+ */
+int
+scan_wall_image_url(const char *html, size_t length, struct wb_str_view *result) {
+	const char *end = html + length;
+	const char *pos = html;
+	const char *content;
+	const char *name;
+	size_t name_length;
+	struct scan_attr attr;
+	struct wb_str_view class_attr, src_attr;
+	int is_img, raw_text, has_class, has_src, found, i;
+
+	found = 0;
+
+	while ((pos = scan_find_byte(pos, end, '<')) != NULL) {
+		pos++;
+		if (pos >= end) {
+			break;
+		}
+
+		/* Comments */
+		if (end - pos >= 3 && memcmp(pos, "!--", 3) == 0) {
+			pos = scan_find_comment_end(pos + 3, end);
+			if (pos == NULL) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+			pos += 3;
+			continue;
+		}
+
+		/* Doctypes, CDATA sections, processing instructions and end tags */
+		if (*pos == '!' || *pos == '?' || *pos == '/') {
+			pos = scan_find_byte(pos, end, '>');
+			if (pos == NULL) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+			continue;
+		}
+
+		/* A '<' that does not start a tag is text */
+		if (!((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z'))) {
+			continue;
+		}
+
+		name = pos;
+		while (pos < end && ((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z')
+			|| (*pos >= '0' && *pos <= '9'))) {
+			pos++;
+		}
+		name_length = pos - name;
+
+		is_img = scan_name_equals(name, name_length, "img");
+		has_class = 0;
+		has_src = 0;
+
+		/* Attributes */
+		for (;;) {
+			while (pos < end && (scan_is_space(*pos) || *pos == '/')) {
+				pos++;
+			}
+			if (pos >= end) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+			if (*pos == '>') {
+				break;
+			}
+
+			pos = scan_parse_attr(pos, end, &attr);
+			if (pos == NULL) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+
+			if (!is_img) {
+				continue;
+			}
+
+			if (scan_name_equals(attr.name, attr.name_length, "class")) {
+				if (has_class) {
+					return WB_SCAN_AMBIGUOUS;
+				}
+				has_class = 1;
+				class_attr.str = attr.value;
+				class_attr.length = attr.value_length;
+			} else if (scan_name_equals(attr.name, attr.name_length, "src")) {
+				if (has_src) {
+					return WB_SCAN_AMBIGUOUS;
+				}
+				has_src = 1;
+				src_attr.str = attr.value;
+				src_attr.length = attr.value_length;
+			}
+		}
+		pos++;
+
+		if (is_img && has_class && has_src) {
+			if (!scan_is_plain_value(class_attr.str, class_attr.length)) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+
+			if (scan_contains(class_attr.str, class_attr.length, "wall")) {
+				if (!scan_is_plain_url(src_attr.str, src_attr.length)) {
+					return WB_SCAN_AMBIGUOUS;
+				}
+
+				*result = src_attr;
+				found++;
+			}
+			continue;
+		}
+
+		/* Skip the content of raw text elements */
+		raw_text = 0;
+		for (i = 0; i < RAW_TEXT_ELEMENTS_SIZE; i++) {
+			if (scan_name_equals(name, name_length, RAW_TEXT_ELEMENTS[i])) {
+				raw_text = 1;
+				break;
+			}
+		}
+
+		if (raw_text) {
+			content = pos;
+			pos = scan_skip_raw_text(pos, end, RAW_TEXT_ELEMENTS[i]);
+			if (pos == NULL) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+			if (i >= RAW_TEXT_ELEMENTS_TIDY && scan_find_byte(content, pos, '<') != NULL) {
+				return WB_SCAN_AMBIGUOUS;
+			}
+		}
+	}
+
+	if (found == 1) {
+		return WB_SCAN_FOUND;
+	} else if (found == 0) {
+		return WB_SCAN_NOT_FOUND;
+	}
+
+	/* More than one match, let the full path decide */
+	return WB_SCAN_AMBIGUOUS;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_SCAN_H
+#define INCLUDED_WB_SCAN_H
+
+#include <stddef.h>
+
+#include "types.h"
+#include "str_list.h"
+
+/* Fast scanner results */
+#define WB_SCAN_FOUND          0
+#define WB_SCAN_NOT_FOUND      1
+#define WB_SCAN_AMBIGUOUS      2
+
+typedef int (*wb_scan_func)(const char *html, size_t length, struct wb_str_view *result);
+
+const char *scan_find_byte(const char *str, const char *end, char c);
+int scan_wall_image_url(const char *html, size_t length, struct wb_str_view *result);
+
+#endif
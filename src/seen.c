@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "seen.h"
+
+/* Initial number of slots, always a power of two */
+#define SEEN_INITIAL_CAPACITY 64
+
+/**
+ * Hashes a string with FNV-1a.
+ *
+ * @param key - the string
+ * @return the hash.
+ */
+uint32_t
+seen_hash(const char *key) {
+	uint32_t hash = 2166136261u;
+
+	while (*key != '\0') {
+		hash ^= (unsigned char) *key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Finds the slot of a key, or the empty slot where it would go.
+ *
+ * @param slots - the slots
+ * @param capacity - the number of slots, a power of two
+ * @param key - the key
+ * @return the slot index.
+ */
+size_t
+seen_find_slot(char **slots, size_t capacity, const char *key) {
+	size_t i = seen_hash(key) & (capacity - 1);
+
+	while (slots[i] != NULL && strcmp(slots[i], key) != 0) {
+		i = (i + 1) & (capacity - 1);
+	}
+
+	return i;
+}
+
+/**
+ * Doubles the number of slots of a set.
+ *
+ * @param seen - the set
+ * @return 0 on success, -1 otherwise.
+ */
+int
+seen_grow(struct wb_seen *seen) {
+	size_t capacity = seen->capacity * 2;
+	char **slots;
+	size_t i;
+
+	slots = (char **) calloc(capacity, sizeof(char *));
+	if (slots == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < seen->capacity; i++) {
+		if (seen->slots[i] != NULL) {
+			slots[seen_find_slot(slots, capacity, seen->slots[i])] = seen->slots[i];
+		}
+	}
+
+	free(seen->slots);
+	seen->slots = slots;
+	seen->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * Creates an empty set.
+ *
+ * @return the set on success, NULL otherwise. IMPORTANT: the set
+ *   must be freed with wb_seen_free().
+ */
+struct wb_seen *
+wb_seen_new() {
+	struct wb_seen *seen;
+
+	seen = (struct wb_seen *) malloc(sizeof(struct wb_seen));
+	if (seen == NULL) {
+		return NULL;
+	}
+
+	seen->slots = (char **) calloc(SEEN_INITIAL_CAPACITY, sizeof(char *));
+	if (seen->slots == NULL) {
+		free(seen);
+		return NULL;
+	}
+
+	seen->capacity = SEEN_INITIAL_CAPACITY;
+	seen->count = 0;
+
+	return seen;
+}
+
+/**
+ * Checks if a set contains a string.
+ *
+ * @param seen - the set
+ * @param key - the string
+ * @return 1 if the set contains the string, 0 otherwise.
+ */
+int
+wb_seen_contains(const struct wb_seen *seen, const char *key) {
+	return seen->slots[seen_find_slot(seen->slots, seen->capacity, key)] != NULL;
+}
+
+/**
+ * Adds a copy of a string to a set.
+ *
+ * @param seen - the set
+ * @param key - the string
+ * @return 1 if the string was added, 0 if the set already contained
+ *   it, -1 on error.
+ */
+int
+wb_seen_add(struct wb_seen *seen, const char *key) {
+	size_t i;
+
+	/* Keep the set at most half full */
+	if ((seen->count + 1) * 2 > seen->capacity && seen_grow(seen) != 0) {
+		return -1;
+	}
+
+	i = seen_find_slot(seen->slots, seen->capacity, key);
+	if (seen->slots[i] != NULL) {
+		return 0;
+	}
+
+	seen->slots[i] = strdup(key);
+	if (seen->slots[i] == NULL) {
+		return -1;
+	}
+	seen->count++;
+
+	return 1;
+}
+
+/**
+ * Frees a set and its strings.
+ *
+ * @param seen - the set
+ */
+void
+wb_seen_free(struct wb_seen *seen) {
+	size_t i;
+
+	for (i = 0; i < seen->capacity; i++) {
+		free(seen->slots[i]);
+	}
+
+	free(seen->slots);
+	free(seen);
+}
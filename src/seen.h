@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_SEEN_H
+#define INCLUDED_WB_SEEN_H
+
+#include <stddef.h>
+
+/* A set of strings, like the IDs of images already emitted */
+struct wb_seen {
+	char **slots;
+	size_t capacity;
+	size_t count;
+};
+
+struct wb_seen *wb_seen_new();
+int wb_seen_contains(const struct wb_seen *seen, const char *key);
+int wb_seen_add(struct wb_seen *seen, const char *key);
+void wb_seen_free(struct wb_seen *seen);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "types.h"
+#include "batch.h"
+#include "error.h"
+#include "metrics.h"
+#include "serve.h"
+
+/* Connections waiting to be accepted */
+#define SERVE_BACKLOG 16
+
+/* Lines that end a response */
+static const char *RESPONSE_OK = "OK\n";
+static const char *RESPONSE_ERROR = "ERROR invalid options\n";
+static const char *RESPONSE_FAILED = "ERROR query failed\n";
+
+/* The request answered with the metrics instead of a query */
+static const char *REQUEST_METRICS = "metrics\n";
+
+/* Requests are parsed with getopt, which is not reentrant */
+static pthread_mutex_t serve_parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* What a connection thread needs */
+struct serve_connection {
+	int fd;
+	const struct options *defaults;
+	wb_serve_func func;
+	void *arg;
+};
+
+/**
+ * Answers the requests of one client until it disconnects. Every
+ * request is a line of options, like a batch file line. The
+ * response is the query's image URLs, one per line, followed by an
+ * "OK" or "ERROR <reason>" line. A "metrics" request is answered
+ * with the metrics in the Prometheus text format and an "OK" line.
+ * Runs in its own thread.
+ *
+ * @param arg - the serve_connection, freed when done.
+ * @return NULL.
+ */
+void *
+serve_connection_run(void *arg) {
+	struct serve_connection *connection = (struct serve_connection *) arg;
+	struct wb_batch_query request;
+	FILE *in, *out;
+	char *line = NULL;
+	size_t line_size = 0;
+	int request_number = 0;
+	int out_fd, res;
+
+	in = fdopen(connection->fd, "r");
+	out_fd = dup(connection->fd);
+	out = out_fd != -1 ? fdopen(out_fd, "w") : NULL;
+	if (in == NULL || out == NULL) {
+		if (in != NULL) {
+			fclose(in);
+		} else {
+			close(connection->fd);
+		}
+		if (out_fd != -1 && out == NULL) {
+			close(out_fd);
+		}
+		free(connection);
+		return NULL;
+	}
+
+	while (getline(&line, &line_size, in) != -1) {
+		request_number++;
+		if (wb_batch_is_blank_line(line)) {
+			continue;
+		}
+
+		if (strcmp(line, REQUEST_METRICS) == 0) {
+			wb_metrics_write(out);
+			fputs(RESPONSE_OK, out);
+			if (fflush(out) != 0) {
+				break;
+			}
+			continue;
+		}
+
+		memset(&request, 0, sizeof(request));
+		request.line = request_number;
+		request.text = strdup(line);
+		if (request.text == NULL) {
+			break;
+		}
+
+		pthread_mutex_lock(&serve_parse_lock);
+		res = wb_batch_parse_query(&request, connection->defaults);
+		pthread_mutex_unlock(&serve_parse_lock);
+
+		if (res != 0) {
+			fputs(RESPONSE_ERROR, out);
+		} else if (connection->func(&request.options, out, connection->arg) != 0) {
+			fputs(RESPONSE_FAILED, out);
+		} else {
+			fputs(RESPONSE_OK, out);
+		}
+
+		wb_batch_query_free(&request);
+		if (fflush(out) != 0) {
+			break;
+		}
+	}
+
+	free(line);
+	fclose(in);
+	fclose(out);
+	free(connection);
+	return NULL;
+}
+
+/**
+ * Listens on a Unix socket and runs the queries clients send,
+ * every client in its own thread. Does not return unless the
+ * socket can not be set up.
+ *
+ * @param path - the path of the socket. A file already there is
+ *   replaced.
+ * @param defaults - the options every request starts from
+ * @param func - the function that runs a query
+ * @param arg - passed to func
+ * @return -1 on error.
+ */
+int
+wb_serve(const char *path, const struct options *defaults, wb_serve_func func, void *arg) {
+	struct sockaddr_un address;
+	struct serve_connection *connection;
+	pthread_t thread;
+	int server_fd, client_fd;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		wb_error("socket path too long: %s", path);
+		return -1;
+	}
+
+	/* Clients that go away must not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server_fd == -1) {
+		wb_error("unable to create socket: %s", strerror(errno));
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	unlink(path);
+
+	if (bind(server_fd, (struct sockaddr *) &address, sizeof(address)) == -1
+		|| listen(server_fd, SERVE_BACKLOG) == -1) {
+
+		wb_error("unable to listen on %s: %s", path, strerror(errno));
+		close(server_fd);
+		return -1;
+	}
+
+	for (;;) {
+		client_fd = accept(server_fd, NULL, NULL);
+		if (client_fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			wb_error("accept() failed: %s", strerror(errno));
+			break;
+		}
+
+		connection = (struct serve_connection *) malloc(sizeof(struct serve_connection));
+		if (connection == NULL) {
+			close(client_fd);
+			continue;
+		}
+		connection->fd = client_fd;
+		connection->defaults = defaults;
+		connection->func = func;
+		connection->arg = arg;
+
+		if (pthread_create(&thread, NULL, serve_connection_run, connection) != 0) {
+			close(client_fd);
+			free(connection);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	close(server_fd);
+	unlink(path);
+	return -1;
+}
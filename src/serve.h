@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_SERVE_H
+#define INCLUDED_WB_SERVE_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+/* Runs a query and writes its image URLs to out, one per line */
+typedef int (*wb_serve_func)(struct options *options, FILE *out, void *arg);
+
+int wb_serve(const char *path, const struct options *defaults, wb_serve_func func, void *arg);
+
+#endif
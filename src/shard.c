@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shard.h"
+#include "error.h"
+#include "seen.h"
+
+/**
+ * Compares shard items by position, then by the order they were
+ * read in.
+ */
+int
+shard_compare_items(const void *a, const void *b) {
+	const struct wb_shard_item *x = (const struct wb_shard_item *) a;
+	const struct wb_shard_item *y = (const struct wb_shard_item *) b;
+
+	if (x->position != y->position) {
+		return (x->position > y->position) - (x->position < y->position);
+	}
+	return (x->order > y->order) - (x->order < y->order);
+}
+
+/**
+ * Reads the image URLs in a shard's output. Lines are only used if
+ * they are complete and start with a position, so the output of a
+ * shard that was killed while printing loses just the last line.
+ *
+ * @param file - the shard's output
+ * @param items - the items read so far, grown as needed
+ * @param count - the number of items read so far, updated
+ * @param size - the number of items allocated, updated
+ * @return 0 on success, -1 otherwise.
+ */
+int
+shard_read_items(FILE *file, struct wb_shard_item **items, size_t *count, size_t *size) {
+	char *line = NULL;
+	char *tab;
+	size_t line_size = 0;
+	ssize_t length;
+	long position;
+	void *grown;
+	int status;
+
+	status = 0;
+	while ((length = getline(&line, &line_size, file)) != -1) {
+		if (line[length - 1] != '\n') {
+			break;
+		}
+		line[length - 1] = '\0';
+
+		position = strtol(line, &tab, 10);
+		if (tab == line || *tab != '\t' || tab[1] == '\0' || position < 0) {
+			continue;
+		}
+
+		if (*count == *size) {
+			*size = (*size > 0) ? *size * 2 : 256;
+			grown = realloc(*items, *size * sizeof(struct wb_shard_item));
+			if (grown == NULL) {
+				status = -1;
+				break;
+			}
+			*items = (struct wb_shard_item *) grown;
+		}
+
+		(*items)[*count].position = position;
+		(*items)[*count].order = *count;
+		(*items)[*count].url = strdup(tab + 1);
+		(*count)++;
+	}
+
+	free(line);
+	return status;
+}
+
+/**
+ * Checks if a listing page belongs to a shard. Pages are dealt out
+ * to the shards in turn.
+ *
+ * @param shard_index - the shard, from 0
+ * @param shard_count - the number of shards, 0 if not sharded
+ * @param page - the listing page, from 0
+ * @return 1 if the shard gets the page, 0 otherwise.
+ */
+int
+wb_shard_owns_page(int shard_index, int shard_count, int page) {
+	if (shard_count <= 0) {
+		return 1;
+	}
+
+	return page % shard_count == shard_index;
+}
+
+/**
+ * Formats an image URL the way a shard prints it, after its
+ * position in the whole query.
+ *
+ * @param position - the position of the image in the query
+ * @param url - the image URL
+ * @return the line, without a line break, NULL on error.
+ *   IMPORTANT: the returned string must be freed using free().
+ */
+char *
+wb_shard_line(long position, const char *url) {
+	char *line;
+	size_t size;
+
+	size = strlen(url) + 24;
+	line = (char *) malloc(size);
+	if (line != NULL) {
+		snprintf(line, size, "%ld\t%s", position, url);
+	}
+
+	return line;
+}
+
+/**
+ * Combines the outputs of the shards of a query into one list of
+ * image URLs, in query order. An image found by more than one shard,
+ * like one that moved to another page while the shards ran, is only
+ * kept at its first position.
+ *
+ * @param paths - the paths of the shard outputs
+ * @param count - the number of paths
+ * @return a wb_str_list of image URLs, NULL if there are none or on
+ *   error. IMPORTANT: the returned list must be freed with
+ *   wb_list_free().
+ */
+struct wb_str_list *
+wb_shard_merge(char *paths[], int count) {
+	struct wb_str_list *urls = NULL;
+	struct wb_shard_item *items = NULL;
+	struct wb_seen *seen;
+	size_t item_count = 0, items_size = 0;
+	size_t i;
+	FILE *file;
+	int status, path;
+
+	status = 0;
+	for (path = 0; path < count && status == 0; path++) {
+		file = fopen(paths[path], "r");
+		if (file == NULL) {
+			wb_error("unable to open shard output %s", paths[path]);
+			status = -1;
+			break;
+		}
+		status = shard_read_items(file, &items, &item_count, &items_size);
+		fclose(file);
+	}
+
+	seen = NULL;
+	if (status == 0) {
+		seen = wb_seen_new();
+	}
+
+	if (seen != NULL) {
+		qsort(items, item_count, sizeof(struct wb_shard_item), shard_compare_items);
+
+		/* Drop duplicates, then build the list from the back */
+		for (i = 0; i < item_count; i++) {
+			if (items[i].url != NULL && wb_seen_add(seen, items[i].url) != 1) {
+				free(items[i].url);
+				items[i].url = NULL;
+			}
+		}
+		for (i = item_count; i > 0; i--) {
+			if (items[i - 1].url != NULL) {
+				urls = wb_list_prepend(urls, items[i - 1].url);
+			}
+		}
+		wb_seen_free(seen);
+	}
+
+	for (i = 0; i < item_count; i++) {
+		free(items[i].url);
+	}
+	free(items);
+
+	return urls;
+}
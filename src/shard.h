@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_SHARD_H
+#define INCLUDED_WB_SHARD_H
+
+#include <stddef.h>
+
+#include "str_list.h"
+
+/* An image URL read from a shard's output */
+struct wb_shard_item {
+	long position;                 /* its position in the whole query */
+	size_t order;                  /* the order it was read in */
+	char *url;
+};
+
+int wb_shard_owns_page(int shard_index, int shard_count, int page);
+char *wb_shard_line(long position, const char *url);
+struct wb_str_list *wb_shard_merge(char *paths[], int count);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* Names of the timed phases, indexed like the WB_STATS_* phases */
+static const char *STATS_PHASE_NAMES[] = {
+	"namelookup", "connect", "appconnect", "starttransfer", "total",
+	"tidy", "xml parse", "xpath"
+};
+
+/* Names of the counters, indexed like the WB_STATS_* counters */
+static const char *STATS_COUNTER_NAMES[] = {
+	"requests", "bytes received", "bytes sent", "not modified",
+	"xpath cache hits", "xpath cache misses", "scan hits",
+	"checkpoint hits", "xml allocations"
+};
+
+int wb_stats_enabled = 0;
+
+/* Recording takes no lock, so the parse workers never wait on it */
+static struct wb_histogram stats_phases[WB_STATS_PHASES];
+static unsigned long stats_counters[WB_STATS_COUNTERS];
+
+/**
+ * Starts recording stats. Must be called before any other thread
+ * is started.
+ */
+void
+wb_stats_enable() {
+	wb_stats_enabled = 1;
+}
+
+/**
+ * Gets the time of a monotonic clock, for timing phases.
+ *
+ * @return the time in seconds.
+ */
+double
+wb_stats_now() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Records how long a phase took once.
+ *
+ * @param phase - a WB_STATS_* phase
+ * @param seconds - how long it took
+ */
+void
+wb_stats_record(int phase, double seconds) {
+	if (wb_stats_enabled) {
+		wb_histogram_record(&stats_phases[phase], (unsigned long) (seconds * 1e6));
+	}
+}
+
+/**
+ * Adds to a counter.
+ *
+ * @param counter - a WB_STATS_* counter
+ * @param amount - the amount to add
+ */
+void
+wb_stats_count(int counter, unsigned long amount) {
+	if (wb_stats_enabled) {
+		__sync_fetch_and_add(&stats_counters[counter], amount);
+	}
+}
+
+/**
+ * Gets the value of a counter.
+ *
+ * @param counter - a WB_STATS_* counter
+ * @return the value.
+ */
+unsigned long
+wb_stats_counter(int counter) {
+	return __sync_fetch_and_add(&stats_counters[counter], 0);
+}
+
+/**
+ * Finds a percentile of the times of a phase, by nearest rank, to
+ * within the precision of the histogram buckets.
+ *
+ * @param phase - a WB_STATS_* phase
+ * @param percentile - the percentile, from 1 to 100
+ * @return the percentile in seconds, 0 if nothing was recorded.
+ */
+double
+wb_stats_percentile(int phase, int percentile) {
+	return wb_histogram_percentile(&stats_phases[phase], percentile) / 1e6;
+}
+
+/**
+ * Prints the count, total and p50/p95/p99 of every phase that was
+ * timed, then every counter.
+ *
+ * @param out - where to print the stats
+ */
+void
+wb_stats_print(FILE *out) {
+	size_t i;
+	int phase;
+
+	fprintf(out, "%-18s %8s %12s %10s %10s %10s\n",
+		"phase", "count", "total ms", "p50 ms", "p95 ms", "p99 ms");
+
+	for (phase = 0; phase < WB_STATS_PHASES; phase++) {
+		if (stats_phases[phase].count == 0) {
+			continue;
+		}
+
+		fprintf(out, "%-18s %8lu %12.1f %10.2f %10.2f %10.2f\n", STATS_PHASE_NAMES[phase],
+			stats_phases[phase].count, stats_phases[phase].sum / 1e3,
+			wb_stats_percentile(phase, 50) * 1000, wb_stats_percentile(phase, 95) * 1000,
+			wb_stats_percentile(phase, 99) * 1000);
+	}
+
+	for (i = 0; i < WB_STATS_COUNTERS; i++) {
+		fprintf(out, "%-18s %8lu\n", STATS_COUNTER_NAMES[i], wb_stats_counter(i));
+	}
+}
+
+/**
+ * Clears the recorded stats and stops recording.
+ */
+void
+wb_stats_free() {
+	if (!wb_stats_enabled) {
+		return;
+	}
+	wb_stats_enabled = 0;
+
+	memset(stats_phases, 0, sizeof(stats_phases));
+	memset(stats_counters, 0, sizeof(stats_counters));
+}
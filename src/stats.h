@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_STATS_H
+#define INCLUDED_WB_STATS_H
+
+#include <stdio.h>
+
+#include "histogram.h"
+
+/* Timed phases. The request phases are the parts of a request curl
+   times, each one measured from the end of the one before it. */
+#define WB_STATS_NAMELOOKUP     0
+#define WB_STATS_CONNECT        1
+#define WB_STATS_APPCONNECT     2
+#define WB_STATS_STARTTRANSFER  3
+#define WB_STATS_TOTAL          4
+#define WB_STATS_TIDY           5
+#define WB_STATS_XML_PARSE      6
+#define WB_STATS_XPATH          7
+#define WB_STATS_PHASES         8
+
+/* Counters */
+#define WB_STATS_REQUESTS           0
+#define WB_STATS_BYTES_RECEIVED     1
+#define WB_STATS_BYTES_SENT         2
+#define WB_STATS_NOT_MODIFIED       3
+#define WB_STATS_XPATH_CACHE_HITS   4
+#define WB_STATS_XPATH_CACHE_MISSES 5
+#define WB_STATS_SCAN_HITS          6
+#define WB_STATS_CHECKPOINT_HITS    7
+#define WB_STATS_XML_ALLOCATIONS    8
+#define WB_STATS_COUNTERS           9
+
+/* 1 if stats are recorded, checked before doing any work for them */
+extern int wb_stats_enabled;
+
+void wb_stats_enable();
+double wb_stats_now();
+void wb_stats_record(int phase, double seconds);
+void wb_stats_count(int counter, unsigned long amount);
+unsigned long wb_stats_counter(int counter);
+double wb_stats_percentile(int phase, int percentile);
+void wb_stats_print(FILE *out);
+void wb_stats_free();
+
+#endif
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "mem.h"
 #include "str_list.h"
 
 /**
@@ -38,6 +39,11 @@ wb_list_new_elem(char *str, struct wb_str_list *next) {
 	new->str = str;
 	new->next = next;
 
+	/* The element and its string are accounted as one allocation */
+	if (wb_mem_enabled) {
+		wb_mem_count(WB_MEM_STR_LIST, wb_mem_size(new) + wb_mem_size(str), 1);
+	}
+
 	return new;
 }
 
@@ -54,6 +60,9 @@ wb_list_free(struct wb_str_list *list) {
 	while (elem != NULL) {
 		prev = elem;
 		elem = elem->next;
+		if (wb_mem_enabled) {
+			wb_mem_count(WB_MEM_STR_LIST, -(long) (wb_mem_size(prev) + wb_mem_size(prev->str)), 0);
+		}
 		free(prev->str);
 		free(prev);
 	}
@@ -88,6 +97,63 @@ wb_list_append(struct wb_str_list *list, const char *str) {
 	}
 }
 
+/**
+ * Appends a string to the end of the list without copying it.
+ * The list takes ownership of the string, which must have been
+ * allocated with malloc().
+ *
+ * @param list - pointer to the first element of the list
+ * @param str - the string to be appended
+ * @return pointer to the first element of the list with the
+ *   new string appended.
+ */
+struct wb_str_list *
+wb_list_append_nocopy(struct wb_str_list *list, char *str) {
+	struct wb_str_list *last = list;
+	struct wb_str_list *new;
+
+	new = wb_list_new_elem(str, NULL);
+
+	if (last != NULL) {
+		while (last->next != NULL) {
+			last = last->next;
+		}
+		last->next = new;
+		return list;
+	} else {
+		return new;
+	}
+}
+
+/**
+ * Appends the first length characters of a string to the end of
+ * the list. The characters are copied, so str does not need to be
+ * NUL-terminated.
+ *
+ * @param list - pointer to the first element of the list
+ * @param str - the string to be appended
+ * @param length - the number of characters to append
+ * @return pointer to the first element of the list with the
+ *   new string appended.
+ */
+struct wb_str_list *
+wb_list_append_n(struct wb_str_list *list, const char *str, size_t length) {
+	struct wb_str_list *last = list;
+	struct wb_str_list *new;
+
+	new = wb_list_new_elem(strndup(str, length), NULL);
+
+	if (last != NULL) {
+		while (last->next != NULL) {
+			last = last->next;
+		}
+		last->next = new;
+		return list;
+	} else {
+		return new;
+	}
+}
+
 /**
  * Appends a list to the end of another list.
  * The second list is copied to the first, so it can be freed
@@ -150,6 +216,26 @@ wb_list_prepend(struct wb_str_list *list, const char *str) {
 	return new;
 }
 
+/**
+ * Counts the strings in a list.
+ *
+ * @param list - the list to count
+ * @return the number of strings in the list.
+ */
+int
+wb_list_length(struct wb_str_list *list) {
+	struct wb_str_list *item;
+	int length = 0;
+
+	item = list;
+	while(item != NULL) {
+		length++;
+		item = item->next;
+	}
+
+	return length;
+}
+
 /**
  * Prints a list of strings to stdout.
  *
@@ -165,3 +251,15 @@ wb_list_print(struct wb_str_list *list) {
 		item = item->next;
 	}
 }
+
+/**
+ * Copies a string view to a new NUL-terminated string.
+ *
+ * @param view - the view to copy
+ * @return the copied string. IMPORTANT: the returned string must
+ *   be freed with free().
+ */
+char *
+wb_str_view_dup(const struct wb_str_view *view) {
+	return strndup(view->str, view->length);
+}
@@ -20,15 +20,27 @@
 #ifndef INCLUDED_WB_STR_LIST_H
 #define INCLUDED_WB_STR_LIST_H
 
+#include <stddef.h>
+
 struct wb_str_list {
 	char *str;
 	struct wb_str_list *next;
 };
 
+/* A string that is not NUL-terminated and not owned */
+struct wb_str_view {
+	const char *str;
+	size_t length;
+};
+
 void wb_list_free(struct wb_str_list *list);
 struct wb_str_list *wb_list_append(struct wb_str_list *list, const char *str);
+struct wb_str_list *wb_list_append_nocopy(struct wb_str_list *list, char *str);
+struct wb_str_list *wb_list_append_n(struct wb_str_list *list, const char *str, size_t length);
 struct wb_str_list *wb_list_append_all(struct wb_str_list *dest, struct wb_str_list *src);
 struct wb_str_list *wb_list_prepend(struct wb_str_list *list, const char *str);
+int wb_list_length(struct wb_str_list *list);
 void wb_list_print(struct wb_str_list *list);
+char *wb_str_view_dup(const struct wb_str_view *view);
 
 #endif
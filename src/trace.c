@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "error.h"
+#include "stats.h"
+#include "trace.h"
+
+int wb_trace_enabled = 0;
+
+/* The trace file, written in the Chrome trace event format */
+static FILE *trace_file = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_event_count = 0;
+
+/* When the trace started, span times are relative to it */
+static double trace_origin = 0;
+
+/* The URL each thread is working on */
+static pthread_key_t trace_url_key;
+
+/**
+ * Writes a string as a JSON string, with quotes.
+ *
+ * @param file - where to write it
+ * @param str - the string
+ */
+void
+trace_write_string(FILE *file, const char *str) {
+	putc('"', file);
+	for (; *str != '\0'; str++) {
+		if (*str == '"' || *str == '\\') {
+			putc('\\', file);
+			putc(*str, file);
+		} else if ((unsigned char) *str < 0x20) {
+			fprintf(file, "\\u%04x", (unsigned char) *str);
+		} else {
+			putc(*str, file);
+		}
+	}
+	putc('"', file);
+}
+
+/**
+ * Starts writing a trace. Must be called before any other thread
+ * is started.
+ *
+ * @param path - the path of the trace file
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_trace_open(const char *path) {
+	trace_file = fopen(path, "w");
+	if (trace_file == NULL) {
+		wb_error("unable to open trace %s", path);
+		return -1;
+	}
+
+	pthread_key_create(&trace_url_key, NULL);
+
+	/* A trace cut short is still readable without the closing ']' */
+	fputs("[\n", trace_file);
+	trace_origin = wb_stats_now();
+	wb_trace_enabled = 1;
+
+	return 0;
+}
+
+/**
+ * Sets the URL the calling thread is working on. Spans without a URL
+ * of their own are tagged with it.
+ *
+ * @param url - the URL, NULL to clear it. It is not copied.
+ */
+void
+wb_trace_set_url(const char *url) {
+	if (wb_trace_enabled) {
+		pthread_setspecific(trace_url_key, url);
+	}
+}
+
+/**
+ * Writes a span, tagged with the calling thread.
+ *
+ * @param name - what was done
+ * @param category - the part of wb that did it
+ * @param start - when it started, from wb_stats_now()
+ * @param end - when it ended, from wb_stats_now()
+ * @param url (optional) - the URL it was done for. Defaults to the
+ *   thread's URL.
+ */
+void
+wb_trace_span(const char *name, const char *category, double start, double end,
+	const char *url) {
+
+	if (!wb_trace_enabled) {
+		return;
+	}
+
+	if (url == NULL) {
+		url = (const char *) pthread_getspecific(trace_url_key);
+	}
+
+	pthread_mutex_lock(&trace_lock);
+
+	/* The trace may have been closed since the check */
+	if (trace_file == NULL) {
+		pthread_mutex_unlock(&trace_lock);
+		return;
+	}
+
+	if (trace_event_count++ > 0) {
+		fputs(",\n", trace_file);
+	}
+
+	fputs("{\"name\":", trace_file);
+	trace_write_string(trace_file, name);
+	fputs(",\"cat\":", trace_file);
+	trace_write_string(trace_file, category);
+	fprintf(trace_file, ",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":%d,\"tid\":%ld",
+		(start - trace_origin) * 1e6, (end - start) * 1e6, (int) getpid(),
+		(long) syscall(SYS_gettid));
+	if (url != NULL) {
+		fputs(",\"args\":{\"url\":", trace_file);
+		trace_write_string(trace_file, url);
+		putc('}', trace_file);
+	}
+	putc('}', trace_file);
+
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/**
+ * Finishes and closes the trace. Registered with atexit().
+ */
+void
+wb_trace_close() {
+	if (!wb_trace_enabled) {
+		return;
+	}
+
+	pthread_mutex_lock(&trace_lock);
+	wb_trace_enabled = 0;
+	fputs("\n]\n", trace_file);
+	fclose(trace_file);
+	trace_file = NULL;
+	trace_event_count = 0;
+	pthread_mutex_unlock(&trace_lock);
+
+	pthread_key_delete(trace_url_key);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_WB_TRACE_H
+#define INCLUDED_WB_TRACE_H
+
+/* 1 if spans are written, checked before doing any work for them */
+extern int wb_trace_enabled;
+
+int wb_trace_open(const char *path);
+void wb_trace_set_url(const char *url);
+void wb_trace_span(const char *name, const char *category, double start, double end,
+	const char *url);
+void wb_trace_close();
+
+#endif
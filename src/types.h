@@ -64,6 +64,12 @@
 /* Flags */
 #define WB_FLAG_RANDOM      0x01
 #define WB_FLAG_PROGRESS    0x02
+#define WB_FLAG_XML_ARENA   0x04
+#define WB_FLAG_VERBOSE     0x08
+#define WB_FLAG_OFFLINE     0x10
+#define WB_FLAG_RESUME      0x20
+#define WB_FLAG_MERGE       0x40
+#define WB_FLAG_STATS       0x80
 
 /* wallbase.cc purities */
 #define WB_PURITY_SFW       0x01
@@ -80,6 +86,26 @@
 /* getopt() option keys */
 #define WB_KEY_USAGE         300
 #define WB_KEY_RANDOM        301
+#define WB_KEY_XML_ARENA     302
+#define WB_KEY_BATCH         303
+#define WB_KEY_SERVE         304
+#define WB_KEY_WATCH         305
+#define WB_KEY_INDEX         306
+#define WB_KEY_OFFLINE       307
+#define WB_KEY_CHECKPOINT    308
+#define WB_KEY_RESUME        309
+#define WB_KEY_SHARD         310
+#define WB_KEY_MERGE         311
+#define WB_KEY_STATS         312
+#define WB_KEY_TRACE         313
+#define WB_KEY_METRICS       314
+#define WB_KEY_BASE_URL      315
+#define WB_KEY_STREAM        316
+#define WB_KEY_DEADLINE      317
+#define WB_KEY_FAST_SCAN     318
+
+/* Longest --base-url, without a trailing '/' */
+#define WB_BASE_URL_MAX      100
 
 /**************************************************
  * Structs
@@ -97,6 +123,20 @@ struct options {
 	int collection_id;
 	int color;
 	int images, images_per_page;
+	int jobs;
+	char *batch_file;
+	char *serve_socket;
+	int watch_interval;
+	char *index_file;
+	char *checkpoint_file;
+	int shard_index, shard_count; /* shard_index counts from 0, shard_count
+	                                 is 0 if the query is not sharded */
+	char *trace_file;
+	char *metrics_file;
+	char *base_url;               /* NULL for wallbase.cc */
+	int stream;                   /* 1 to print image urls as they are found */
+	int deadline_ms;              /* 0 if the run has no deadline */
+	int fast_scan;                /* 1 to scan image pages before parsing them */
 	unsigned char flags, purity, boards;
 	int res_x, res_y;
 	unsigned char res_opt;
@@ -22,12 +22,27 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include "wb.h"
 #include "types.h"
 #include "args.h"
+#include "batch.h"
+#include "checkpoint.h"
+#include "index.h"
+#include "mem.h"
+#include "metrics.h"
 #include "net.h"
+#include "pool.h"
 #include "query.h"
+#include "scan.h"
+#include "seen.h"
+#include "serve.h"
+#include "shard.h"
+#include "stats.h"
+#include "trace.h"
 #include "url_enc.h"
 #include "xml.h"
 #include "xpath.h"
@@ -36,8 +51,9 @@
  * General global constants
  **************************************************/
 
-static const char *URL_LOGIN_PAGE = "http://wallbase.cc/user/login";
-static const char *URL_LOGIN_POST = "http://wallbase.cc/user/do_login";
+/* Login paths, after wb_query_base_url() */
+static const char *URL_LOGIN_PAGE = "/user/login";
+static const char *URL_LOGIN_POST = "/user/do_login";
 
 static const char *FORMAT_LOGIN = "csrf=%s&ref=aHR0cDovL3dhbGxiYXNlLmNjLw%%3D%%3D&password=%s&username=%s";
 
@@ -45,6 +61,154 @@ static const char *XPATH_CSRF_TOKEN = "//input[@name='csrf']/@value";
 static const char *XPATH_IMAGE_PAGE_URL = "//div[contains(@class,'thumb')]/div[@class='wrapper']/a[@target='_blank']/@href";
 static const char *XPATH_IMAGE_URL = "//img[contains(@class,'wall')]/@src";
 
+/* Image page details recorded in the index */
+static const char *XPATH_META_WIDTH = "//img[contains(@class,'wall')]/@width";
+static const char *XPATH_META_HEIGHT = "//img[contains(@class,'wall')]/@height";
+static const char *XPATH_META_PURITY = "//img[contains(@class,'wall')]/@data-purity";
+static const char *XPATH_META_COLOR = "//div[contains(@class,'palette')]/a[1]/@data-color";
+static const char *XPATH_META_FAVORITES = "//span[contains(@class,'fav-count')]";
+static const char *XPATH_META_TAGS = "//a[contains(@class,'tagname')]";
+
+/* Image page details, in the order they are evaluated */
+#define META_IMAGE_URL  0
+#define META_WIDTH      1
+#define META_HEIGHT     2
+#define META_PURITY     3
+#define META_COLOR      4
+#define META_FAVORITES  5
+#define META_TAGS       6
+#define META_FIELDS     7
+
+/* Purity names on image pages, indexed like the WB_PURITY_* flags */
+static const char *PURITY_NAMES[] = {
+	"sfw", "sketchy", "nsfw"
+};
+
+/* Image directories of the wallpaper boards, indexed like the
+   WB_BOARD_* flags */
+static const char *BOARD_PATHS[] = {
+	"/rozne/", "/manga-anime/", "/high-resolution/"
+};
+
+/**************************************************
+ * Parse jobs
+ **************************************************/
+
+/* Pool that downloads, converts and evaluates pages */
+static struct wb_pool *parse_pool = NULL;
+
+/* Parse jobs of one query, waited for together */
+struct wb_parse_group {
+	pthread_mutex_t lock;
+	pthread_cond_t done_cond;
+	int pending;
+	int short_page;              /* 1 if a listing page had fewer results
+	                                than a full page */
+};
+
+/* A page waiting to be downloaded, converted and evaluated */
+struct wb_parse_job {
+	struct wb_parse_group *group;
+	char *url;                   /* copied, callers reuse their buffer */
+	const char *post_data;       /* must outlive the job, or NULL */
+	struct wb_str_list *cookies; /* must outlive the job, or NULL */
+	char *html;
+	const char *expression;
+	wb_scan_func scan;           /* fast path tried before parsing, or NULL */
+	int single;                  /* 1 if only a single result is kept */
+	int full_page;               /* results on a full page, 0 if unknown.
+	                                Set before the job is queued. */
+	struct wb_index_entry *entry; /* image page details to record, or
+	                                NULL. Set before the job is queued. */
+	int resumed;                 /* 1 if an earlier run did the job */
+	double queued;               /* when the job was queued, while tracing */
+	struct wb_str_list *results; /* all results, if single is 0 */
+	char *result;                /* the only result, if single is 1 */
+};
+
+/* Pages downloaded between checkpoints */
+#define CHECKPOINT_PAGES 20
+
+/**************************************************
+ * Streaming
+ **************************************************/
+
+/* Image pages --stream resolves at once, for every parse job */
+#define STREAM_WINDOW_PER_JOB 4
+
+/* An image page being resolved by --stream. Every slot has a group
+   of its own, so that the oldest one can be waited for alone. */
+struct wb_stream_slot {
+	struct wb_parse_group group;
+	struct wb_parse_job job;
+};
+
+/**************************************************
+ * Batch queries
+ **************************************************/
+
+/* Maximum number of batch queries that run at the same time */
+#define BATCH_THREADS_MAX 8
+
+/* The state batch threads share */
+struct wb_batch_runner {
+	struct wb_batch *batch;
+	pthread_mutex_t lock;
+	int next;                    /* the next query to run */
+};
+
+/**************************************************
+ * Login sessions
+ **************************************************/
+
+/* A login session that batch and daemon queries share. Queries only
+   get the session of the credentials they were sent with. */
+struct wb_session {
+	char *username;
+	char *password;
+	struct wb_str_list *cookies;
+	int users;                      /* queries using the cookies */
+	int expired;                    /* 1 once a query failed with it */
+	int logging_in;                 /* 1 until the login is done */
+	pthread_cond_t logged_in;       /* signalled when the login is done */
+	struct wb_session *next;
+};
+
+static struct wb_session *sessions = NULL;
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**************************************************
+ * Metrics
+ **************************************************/
+
+/* The file metrics are written to, or NULL */
+static const char *metrics_file = NULL;
+
+/**************************************************
+ * Deadline
+ **************************************************/
+
+/* When the run must be done by, from wb_stats_now(). 0 if there is
+   no deadline. */
+static double run_deadline = 0;
+
+/* 1 once work was skipped or cut short by the deadline */
+static int deadline_reached = 0;
+
+/**************************************************
+ * Cancellation
+ **************************************************/
+
+/* The signal that cancelled the run, 0 if it was not cancelled */
+static volatile sig_atomic_t cancel_signal = 0;
+
+/**************************************************
+ * Local index
+ **************************************************/
+
+/* The index offline queries are answered from */
+static struct wb_index *offline_index = NULL;
+
 /**************************************************
  * Main
  **************************************************/
@@ -54,8 +218,10 @@ main(int argc, char* argv[]) {
 	/* Variables */
 	struct wb_str_list *cookies = NULL;
 	struct wb_str_list *image_urls = NULL;
-	struct wb_query *query;
+	struct wb_batch *batch = NULL;
 	struct options *options;
+	struct sigaction action;
+	int status;
 
 	/* Get default options */
 	options = wb_get_default_options();
@@ -63,43 +229,263 @@ main(int argc, char* argv[]) {
 	/* Parse arguments */
 	wb_parse_args(argc, argv, options);
 
+	/* Combine the outputs of shards, the files left after the options */
+	if ((options->flags & WB_FLAG_MERGE) > 0) {
+		if (optind >= argc) {
+			fprintf(stderr, "Error: --merge needs the output files of the shards\n");
+			free(options);
+			return 1;
+		}
+
+		image_urls = wb_shard_merge(argv + optind, argc - optind);
+		status = (image_urls == NULL) ? 1 : 0;
+		wb_list_print(image_urls);
+		wb_list_free(image_urls);
+		free(options);
+		return status;
+	}
+
+	/* Read the batch file */
+	if (options->batch_file != NULL) {
+		batch = wb_batch_read(options->batch_file, options);
+		if (batch == NULL) {
+			free(options);
+			return 1;
+		}
+	}
+
+	/* A checkpoint journals one query */
+	if (options->checkpoint_file != NULL && (batch != NULL || options->serve_socket != NULL
+		|| options->watch_interval > 0)) {
+		fprintf(stderr, "Error: --checkpoint can not be used with --batch, --serve or --watch\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		free(options);
+		return 1;
+	}
+	/* A shard is one part of one query */
+	if (options->shard_count > 0 && (batch != NULL || options->serve_socket != NULL
+		|| options->watch_interval > 0 || (options->flags & WB_FLAG_OFFLINE) > 0)) {
+		fprintf(stderr, "Error: --shard can not be used with --batch, --serve, --watch or --offline\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		free(options);
+		return 1;
+	}
+	/* A stream prints one query's image urls as they are found */
+	if (options->stream && (batch != NULL || options->serve_socket != NULL
+		|| options->watch_interval > 0 || options->checkpoint_file != NULL
+		|| options->index_file != NULL || options->shard_count > 0)) {
+		fprintf(stderr, "Error: --stream can not be used with --batch, --serve, --watch, --checkpoint, --index or --shard\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		free(options);
+		return 1;
+	}
+	/* A deadline bounds one run, all of whose pages it can see */
+	if (options->deadline_ms > 0 && (options->serve_socket != NULL
+		|| options->watch_interval > 0 || options->shard_count > 0)) {
+		fprintf(stderr, "Error: --deadline can not be used with --serve, --watch or --shard\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		free(options);
+		return 1;
+	}
+	if ((options->flags & WB_FLAG_RESUME) > 0 && options->checkpoint_file == NULL) {
+		fprintf(stderr, "Error: --resume needs a --checkpoint file\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		free(options);
+		return 1;
+	}
+
+	/* Load the index for offline queries */
+	if ((options->flags & WB_FLAG_OFFLINE) > 0) {
+		if (options->index_file == NULL) {
+			fprintf(stderr, "Error: --offline needs an --index file\n");
+			if (batch != NULL) {
+				wb_batch_free(batch);
+			}
+			free(options);
+			return 1;
+		}
+		if (options->watch_interval > 0) {
+			fprintf(stderr, "Error: --watch can not be used with --offline\n");
+			if (batch != NULL) {
+				wb_batch_free(batch);
+			}
+			free(options);
+			return 1;
+		}
+
+		offline_index = wb_index_load(options->index_file);
+		if (offline_index == NULL) {
+			if (batch != NULL) {
+				wb_batch_free(batch);
+			}
+			free(options);
+			return 1;
+		}
+	}
+
+	/* Time every phase, account memory and print the stats at exit.
+	   Memory accounting must be on before the libraries are set up. */
+	if ((options->flags & WB_FLAG_STATS) > 0) {
+		wb_stats_enable();
+		wb_mem_enable();
+		xml_count_memory();
+		atexit(wb_print_stats);
+	}
+
+	/* Trace every request and parse, the trace is finished at exit */
+	if (options->trace_file != NULL) {
+		if (wb_trace_open(options->trace_file) != 0) {
+			if (batch != NULL) {
+				wb_batch_free(batch);
+			}
+			wb_index_free(offline_index);
+			free(options);
+			return 1;
+		}
+		atexit(wb_trace_close);
+	}
+
+	/* Send requests to another server */
+	wb_query_set_base_url(options->base_url);
+
+	/* Stop cleanly on SIGINT or SIGTERM, a second one kills. The
+	   daemon runs until it is killed. */
+	if (options->serve_socket == NULL) {
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = wb_cancel;
+		action.sa_flags = SA_RESETHAND;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGINT, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+	}
+
+	/* Finish in time, the deadline counts from the start of the run */
+	if (options->deadline_ms > 0) {
+		run_deadline = wb_stats_now() + options->deadline_ms / 1000.0;
+		net_set_deadline(run_deadline);
+	}
+
+	/* Keep latency histograms. The daemon always has them for clients
+	   that ask, --metrics also writes them to a file. */
+	if (options->metrics_file != NULL || options->serve_socket != NULL) {
+		wb_metrics_enable();
+	}
+	if (options->metrics_file != NULL) {
+		metrics_file = options->metrics_file;
+		atexit(wb_dump_metrics);
+	}
+
 	/* Init net and xpath systems */
 	net_init();
+	if ((options->flags & WB_FLAG_XML_ARENA) > 0 && xpath_enable_arena() != 0) {
+		fprintf(stderr, "Error: unable to set up the libxml2 arena\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		wb_index_free(offline_index);
+		free(options);
+		net_cleanup();
+		return 1;
+	}
+	if ((options->flags & (WB_FLAG_STATS | WB_FLAG_XML_ARENA)) == WB_FLAG_STATS) {
+		xpath_count_allocations();
+	}
 	xpath_init();
 
-	/* Login if needed */
-	if ((options->purity & WB_PURITY_NSFW) > 0) {
+	/* Start the parse workers */
+	parse_pool = wb_pool_new(options->jobs);
+	if (parse_pool == NULL) {
+		fprintf(stderr, "Error: unable to start parse workers\n");
+		if (batch != NULL) {
+			wb_batch_free(batch);
+		}
+		wb_index_free(offline_index);
+		free(options);
+		net_cleanup();
+		xpath_cleanup();
+		return 1;
+	}
+
+	/* Answer queries until killed */
+	if (options->serve_socket != NULL) {
+		wb_serve(options->serve_socket, options, wb_serve_query, NULL);
+		wb_free_sessions();
+		free(options);
+		wb_pool_free(parse_pool);
+		net_cleanup();
+		xpath_cleanup();
+		return 1;
+	}
+
+	/* Login if needed. Batch queries log in with their own
+	   credentials when they run. Offline queries never go to
+	   wallbase.cc. */
+	if (batch == NULL && offline_index == NULL && (options->purity & WB_PURITY_NSFW) > 0) {
 		cookies = wb_login(options->username, options->password);
 		if (cookies == NULL) {
+			free(options);
+			wb_pool_free(parse_pool);
 			net_cleanup();
 			xpath_cleanup();
 			return 1;
 		}
 	}
 
-	/* Generate the query URL and POST data */
-	query = wb_generate_query(options);
+	/* Get and print image URLs */
+	status = 0;
+	if (options->watch_interval > 0 && batch == NULL) {
+		status = wb_watch(options, cookies);
+	} else if (options->stream) {
+		if (wb_stream_query(options, cookies, stdout) <= 0) {
+			status = 1;
+		}
+	} else if (batch == NULL) {
+		image_urls = wb_run_query(options, cookies, 0);
+		if (image_urls == NULL) {
+			status = 1;
+		}
+		wb_list_print(image_urls);
+	} else {
+		status = wb_run_batch(batch);
+	}
 
-	/* Get image urls */
-	image_urls = wb_get_image_urls(query->url, query->post_data, cookies, options);
-	if (image_urls == NULL) {
-		wb_list_free(cookies);
-		net_cleanup();
-		xpath_cleanup();
-		return 1;
+	/* Mark the image URLs as partial if the deadline cut them short */
+	if (__sync_fetch_and_add(&deadline_reached, 0)) {
+		fprintf(stderr, "Partial: the %d ms deadline was reached, only the image URLs found before it were printed\n",
+			options->deadline_ms);
+		status = 2;
 	}
 
-	/* Print image URLs */
-	wb_list_print(image_urls);
+	/* Mark them as partial if the run was cancelled */
+	if (cancel_signal != 0) {
+		fprintf(stderr, "Cancelled: stopped by signal %d, only the image URLs found before it were printed\n",
+			(int) cancel_signal);
+		status = 128 + cancel_signal;
+	}
 
 	/* Cleanup and return */
+	if (batch != NULL) {
+		wb_batch_free(batch);
+	}
+	wb_index_free(offline_index);
 	free(options);
-	wb_query_free(query);
 	wb_list_free(cookies);
 	wb_list_free(image_urls);
+	wb_free_sessions();
+	wb_pool_free(parse_pool);
 	net_cleanup();
 	xpath_cleanup();
-	return 0;
+	return status;
 }
 
 /**************************************************
@@ -122,6 +508,19 @@ wb_get_default_options() {
 	options->password = "";
 	options->images = 20;
 	options->images_per_page = 20;
+	options->jobs = 0;
+	options->batch_file = NULL;
+	options->serve_socket = NULL;
+	options->watch_interval = 0;
+	options->index_file = NULL;
+	options->checkpoint_file = NULL;
+	options->shard_index = 0;
+	options->shard_count = 0;
+	options->trace_file = NULL;
+	options->metrics_file = NULL;
+	options->base_url = NULL;
+	options->stream = 0;
+	options->deadline_ms = 0;
 
 	options->query = NULL;
 	options->color = -1;
@@ -143,6 +542,58 @@ wb_get_default_options() {
 	return options;
 }
 
+/**
+ * Prints the stats and memory to stderr and frees the stats.
+ * Registered with atexit().
+ */
+void
+wb_print_stats() {
+	wb_stats_print(stderr);
+	wb_mem_print(stderr);
+	wb_stats_free();
+}
+
+/**
+ * Writes the metrics to the --metrics file, if there is one.
+ * Registered with atexit() and called after every query of the
+ * watch and daemon modes.
+ */
+void
+wb_dump_metrics() {
+	if (metrics_file != NULL) {
+		wb_metrics_dump(metrics_file);
+	}
+}
+
+/**
+ * Evaluates an XPath expression that must have exactly one result.
+ * Only that result is copied out of the document.
+ *
+ * @param xml_data - the XML data as a string.
+ * @param expression - the expression to evaluate.
+ * @return a copy of the only result, NULL if there are no results
+ *   or more than one. IMPORTANT: the returned string must be freed
+ *   using free().
+ */
+char *
+wb_eval_single_result(const char *xml_data, const char *expression) {
+	struct wb_xpath_result *results;
+	char *str = NULL;
+
+	results = xpath_eval_views(xml_data, expression, NULL);
+	if (results == NULL) {
+		return NULL;
+	}
+
+	if (results->count == 1) {
+		str = wb_str_view_dup(&results->views[0]);
+	}
+
+	xpath_result_free(results);
+
+	return str;
+}
+
 /**
  * Login to wallbase.cc, by setting your specified cookies.
  *
@@ -159,9 +610,15 @@ wb_login(const char *username, const char *password) {
 	char post_data[256];
 	char *login_response;
 	char *csrf_token;
+	char url[WB_BASE_URL_MAX + 32];
+	double start = 0, end;
 
 	struct wb_str_list *cookies = NULL;
 
+	if (wb_trace_enabled || wb_metrics_enabled) {
+		start = wb_stats_now();
+	}
+
 	/* Get a new CSRF token */
 	csrf_token = wb_get_login_csrf_token(&cookies);
 
@@ -174,12 +631,19 @@ wb_login(const char *username, const char *password) {
 	free(csrf_token);
 
 	/* Login */
-	login_response = net_get_response(URL_LOGIN_POST, post_data, &cookies, 1);
+	snprintf(url, sizeof(url), "%s%s", wb_query_base_url(), URL_LOGIN_POST);
+	login_response = net_get_response(url, post_data, &cookies, 1);
 	if (login_response == NULL) {
 		fprintf(stderr, "Error: net_get_response() failed\n");
 		return NULL;
 	}
 
+	if (wb_trace_enabled || wb_metrics_enabled) {
+		end = wb_stats_now();
+		wb_metrics_record_request(WB_METRICS_LOGIN, end - start);
+		wb_trace_span("login", "net", start, end, url);
+	}
+
 	if (strlen(login_response) > 0) {
 		fprintf(stderr, "Error: unable to login to wallbase.cc\n");
 		free(login_response);
@@ -207,29 +671,19 @@ char *
 wb_get_login_csrf_token(struct wb_str_list **cookies) {
 	char *login_page_xml_data;
 	char *csrf_token;
-
-	struct wb_str_list *xpath_results;
+	char url[WB_BASE_URL_MAX + 32];
 
 	/* Get the login page as XML */
-	login_page_xml_data = net_get_response_as_xml(URL_LOGIN_PAGE, NULL, cookies, 1);
+	snprintf(url, sizeof(url), "%s%s", wb_query_base_url(), URL_LOGIN_PAGE);
+	login_page_xml_data = net_get_response_as_xml(url, NULL, cookies, 1);
 	if (login_page_xml_data == NULL) {
 		return NULL;
 	}
 
 	/* Get the CSRF token from XML */
-	xpath_results = xpath_eval_expr(login_page_xml_data, XPATH_CSRF_TOKEN, NULL);
+	csrf_token = wb_eval_single_result(login_page_xml_data, XPATH_CSRF_TOKEN);
 	free(login_page_xml_data);
 
-	if (xpath_results == NULL) {
-		return NULL;
-	} else if (xpath_results->next != NULL) {
-		wb_list_free(xpath_results);
-		return NULL;
-	}
-
-	csrf_token = strdup(xpath_results->str);
-	wb_list_free(xpath_results);
-
 	return csrf_token;
 }
 
@@ -265,115 +719,1736 @@ wb_get_image_page_urls(const char *url, const char *post_data,
 }
 
 /**
- * Connects to wallbase.cc with the specified post data and
- * cookies and retrieves image urls.
+ * Cancels the run: no more requests are started and the running ones
+ * are aborted, what was found so far is printed and journaled.
+ * Installed as the SIGINT and SIGTERM handler.
  *
- * @param url - wallbase.cc url to get images from. Must have a
- *   '%d' element to insert the image to start from.
- * @param post_data - post data required for search parameters.
- * @param cookies - cookies with login session information.
- * @return a wb_str_list of image urls on success, NULL
- *   otherwise. IMPORTANT: the returned list must be freed with
- *   wb_list_free().
+ * @param signal_number - the signal that cancelled the run.
  */
-struct wb_str_list *
-wb_get_image_urls(const char *url, const char *post_data,
-	struct wb_str_list *cookies, struct options *options) {
+void
+wb_cancel(int signal_number) {
+	cancel_signal = signal_number;
+	net_cancel();
+}
 
-	struct wb_str_list *img_urls      = NULL;
-	struct wb_str_list *img_page_urls = NULL;
-	struct wb_str_list *img_page_url  = NULL;
-	struct wb_str_list *new_img_page_urls;
-	char *img_url, *page_url;
-	int page_url_length, show_progress, i;
+/**
+ * Checks if work that takes about as long as given can be done
+ * before the deadline. If it can not, the work is to be skipped and
+ * the run is marked as cut short. No work is done once the run is
+ * cancelled.
+ *
+ * @param needed - how long the work takes, in seconds.
+ * @return 1 if the work can be started, 0 otherwise.
+ */
+int
+wb_deadline_allows(double needed) {
+	if (net_cancelled()) {
+		return 0;
+	}
+	if (run_deadline == 0 || wb_stats_now() + needed < run_deadline) {
+		return 1;
+	}
 
-	show_progress = options->flags & WB_FLAG_PROGRESS;
+	__sync_fetch_and_or(&deadline_reached, 1);
+	return 0;
+}
 
-	/* Get image page URLs */
-	page_url_length = strlen(url) + 8;
-	page_url = (char *) malloc(page_url_length);
-	for (i = 0; i < options->images; i += options->images_per_page) {
-		if (show_progress) {
-			printf("Getting page URLs: %d - %d\r", i + 1, i + options->images_per_page);
-			fflush(stdout);
-		}
+/**
+ * Initializes a parse job group.
+ *
+ * @param group - the group to initialize.
+ */
+void
+wb_parse_group_init(struct wb_parse_group *group) {
+	pthread_mutex_init(&group->lock, NULL);
+	pthread_cond_init(&group->done_cond, NULL);
+	group->pending = 0;
+	group->short_page = 0;
+}
 
-		snprintf(page_url, page_url_length, url, i);
+/**
+ * Destroys a parse job group. All of its jobs must be done.
+ *
+ * @param group - the group to destroy.
+ */
+void
+wb_parse_group_destroy(struct wb_parse_group *group) {
+	pthread_mutex_destroy(&group->lock);
+	pthread_cond_destroy(&group->done_cond);
+}
 
-		new_img_page_urls = wb_get_image_page_urls(page_url, post_data, cookies);
-		img_page_urls = wb_list_append_all(img_page_urls, new_img_page_urls);
-		wb_list_free(new_img_page_urls);
-	}
-	free(page_url);
+/**
+ * Get the board of an image from the directory in its URL.
+ *
+ * @param image_url - the URL of the image.
+ * @return a WB_BOARD_* flag, 0 if the board is not known.
+ */
+unsigned char
+wb_image_board(const char *image_url) {
+	int i;
 
-	if (show_progress) {
-		printf("\n");
-		fflush(stdout);
+	for (i = 0; i < ARR_SIZE(BOARD_PATHS); i++) {
+		if (strstr(image_url, BOARD_PATHS[i]) != NULL) {
+			return 1 << i;
+		}
 	}
 
-	/* Get an image URL from every image page URL */
-	img_page_url = img_page_urls;
-	i = 0;
-	while ((i < options->images) && (img_page_url != NULL)) {
-		if (show_progress) {
-			printf("Getting image URLs: %d / %d\r", i + 1, options->images);
-			fflush(stdout);
+	return 0;
+}
+
+/**
+ * Finds the image URL and the details recorded in the index on an
+ * image page, parsing the page once for all of them.
+ *
+ * @param xml_data - the image page as XML.
+ * @param entry - where to store the details. The ID and fetch time
+ *   are not set.
+ * @return the image URL if the page has exactly one, NULL
+ *   otherwise. IMPORTANT: the returned string must be freed using
+ *   free(), like entry->tags.
+ */
+char *
+wb_parse_image_meta(const char *xml_data, struct wb_index_entry *entry) {
+	const char *expressions[META_FIELDS] = {
+		XPATH_IMAGE_URL, XPATH_META_WIDTH, XPATH_META_HEIGHT, XPATH_META_PURITY,
+		XPATH_META_COLOR, XPATH_META_FAVORITES, XPATH_META_TAGS
+	};
+	struct wb_str_list *fields[META_FIELDS];
+	struct wb_str_list *tag;
+	char *image_url = NULL;
+	size_t tags_length;
+	int i;
+
+	entry->image_url = NULL;
+	entry->tags = NULL;
+	entry->res_x = 0;
+	entry->res_y = 0;
+	entry->purity = 0;
+	entry->board = 0;
+	entry->color = -1;
+	entry->favorites = 0;
+
+	if (xpath_eval_fields(xml_data, expressions, META_FIELDS, NULL, fields) == 0
+		&& fields[META_IMAGE_URL] != NULL && fields[META_IMAGE_URL]->next == NULL) {
+
+		image_url = strdup(fields[META_IMAGE_URL]->str);
+		if (image_url != NULL) {
+			entry->image_url = image_url;
+			entry->board = wb_image_board(image_url);
 		}
 
-		img_url = wb_get_image_url(img_page_url->str, cookies);
-		if (img_url != NULL) {
-			img_urls = wb_list_append(img_urls, img_url);
-			free(img_url);
+		if (fields[META_WIDTH] != NULL && fields[META_HEIGHT] != NULL) {
+			entry->res_x = (unsigned short) strtoul(fields[META_WIDTH]->str, NULL, 10);
+			entry->res_y = (unsigned short) strtoul(fields[META_HEIGHT]->str, NULL, 10);
 		}
 
-		img_page_url = img_page_url->next;
-		i++;
-	}
+		for (i = 0; fields[META_PURITY] != NULL && i < ARR_SIZE(PURITY_NAMES); i++) {
+			if (strcmp(fields[META_PURITY]->str, PURITY_NAMES[i]) == 0) {
+				entry->purity = 1 << i;
+			}
+		}
 
-	if (show_progress) {
-		printf("\n");
-		fflush(stdout);
+		if (fields[META_COLOR] != NULL) {
+			entry->color = (int) strtol(fields[META_COLOR]->str + (fields[META_COLOR]->str[0] == '#'),
+				NULL, 16);
+		}
+
+		if (fields[META_FAVORITES] != NULL) {
+			entry->favorites = (int) strtol(fields[META_FAVORITES]->str, NULL, 10);
+		}
+
+		/* Join the tags with commas */
+		tags_length = 0;
+		for (tag = fields[META_TAGS]; tag != NULL; tag = tag->next) {
+			tags_length += strlen(tag->str) + 1;
+		}
+		if (tags_length > 0) {
+			entry->tags = (char *) malloc(tags_length);
+		}
+		if (entry->tags != NULL) {
+			entry->tags[0] = '\0';
+			for (tag = fields[META_TAGS]; tag != NULL; tag = tag->next) {
+				if (entry->tags[0] != '\0') {
+					strcat(entry->tags, ",");
+				}
+				strcat(entry->tags, tag->str);
+			}
+		}
 	}
 
-	/* Cleanup */
-	wb_list_free(img_page_urls);
+	for (i = 0; i < META_FIELDS; i++) {
+		wb_list_free(fields[i]);
+	}
 
-	return img_urls;
+	return image_url;
 }
 
 /**
- * Get the full image url from a wallbase.cc image page url.
+ * Converts a downloaded page to XML and evaluates the job's XPath
+ * expression on it. If the job has a fast scanner, it is tried on
+ * the raw HTML first.
  *
- * @param url - wallbase.cc image page url.
- * @param cookies - cookie list needed for NSFW images.
- * @return the URL of the image on success, NULL otherwise.
- *   IMPORTANT: the resulting string must be freed eith free().
+ * @param job - the job to run.
  */
-char *
-wb_get_image_url(const char *url, struct wb_str_list *cookies) {
-	char *img_url = NULL;
+void
+wb_parse_page(struct wb_parse_job *job) {
+	struct wb_str_view view;
 	char *xml_data;
-	struct wb_str_list *xpath_results;
 
-	/* Get response as XML */
-	xml_data = net_get_response_as_xml(url, NULL, &cookies, 0);
+	/* Try the fast path first, parse the page only if it is unsure.
+	   Image page details are only found by parsing. */
+	if (job->scan != NULL && job->single && job->entry == NULL) {
+		if (job->scan(job->html, strlen(job->html), &view) == WB_SCAN_FOUND) {
+			wb_stats_count(WB_STATS_SCAN_HITS, 1);
+			job->result = wb_str_view_dup(&view);
+			free(job->html);
+			job->html = NULL;
+			return;
+		}
+	}
+
+	/* Convert HTML to XML */
+	xml_data = convert_html_to_xml(job->html);
+	free(job->html);
+	job->html = NULL;
+
 	if (xml_data == NULL) {
-		return NULL;
+		fprintf(stderr, "Error: unable to convert HTML to XML\n");
+		return;
 	}
 
-	/* Get the script node (that contains the encoded url) data */
-	xpath_results = xpath_eval_expr(xml_data, XPATH_IMAGE_URL, NULL);
+	/* Get results from the XML */
+	if (job->entry != NULL) {
+		job->result = wb_parse_image_meta(xml_data, job->entry);
+	} else if (job->single) {
+		job->result = wb_eval_single_result(xml_data, job->expression);
+	} else {
+		job->results = xpath_eval_expr(xml_data, job->expression, NULL);
+		if (job->full_page > 0 && wb_list_length(job->results) < job->full_page) {
+			pthread_mutex_lock(&job->group->lock);
+			job->group->short_page = 1;
+			pthread_mutex_unlock(&job->group->lock);
+		}
+	}
 	free(xml_data);
+}
 
-	if (xpath_results == NULL) {
-		return NULL;
-	} else if (xpath_results->next != NULL) {
-		wb_list_free(xpath_results);
-		return NULL;
+/**
+ * Downloads the page of a parse job.
+ *
+ * @param job - the job.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_fetch_page(struct wb_parse_job *job) {
+	double start = 0, end;
+
+	if (wb_trace_enabled || wb_metrics_enabled) {
+		start = wb_stats_now();
+	}
+
+	job->html = net_get_response(job->url, job->post_data, &job->cookies, 0);
+	if (job->html == NULL) {
+		/* A request cut short by the deadline is not an error */
+		if (wb_deadline_allows(0)) {
+			fprintf(stderr, "Error: net_get_response() failed\n");
+		}
+		return -1;
 	}
 
-	img_url = strdup(xpath_results->str);
-	wb_list_free(xpath_results);
+	if (wb_trace_enabled || wb_metrics_enabled) {
+		end = wb_stats_now();
+		wb_metrics_record_request(job->single ? WB_METRICS_DETAIL : WB_METRICS_LISTING,
+			end - start);
+		wb_trace_span(job->single ? "detail fetch" : "listing fetch", "fetch", start, end,
+			job->url);
+	}
+
+	return 0;
+}
+
+/**
+ * Runs a parse job and marks it done in its group. Runs in a parse
+ * pool worker, or on the calling thread if there are no workers.
+ *
+ * @param arg - the wb_parse_job to run.
+ */
+void
+wb_run_parse_job(void *arg) {
+	struct wb_parse_job *job = (struct wb_parse_job *) arg;
+	struct wb_parse_group *group = job->group;
+	double start = 0, end;
+
+	if (wb_trace_enabled) {
+		wb_trace_span("parse queue", "parse", job->queued, wb_stats_now(), job->url);
+		wb_trace_set_url(job->url);
+	}
+
+	if (wb_fetch_page(job) == 0) {
+		if (wb_metrics_enabled || wb_trace_enabled) {
+			start = wb_stats_now();
+		}
+
+		wb_parse_page(job);
+
+		if (wb_metrics_enabled || wb_trace_enabled) {
+			end = wb_stats_now();
+			wb_metrics_record_parse(end - start);
+			wb_trace_span("parse", "parse", start, end, job->url);
+		}
+	}
+
+	wb_trace_set_url(NULL);
+	free(job->url);
+	job->url = NULL;
+
+	pthread_mutex_lock(&group->lock);
+	group->pending--;
+	if (group->pending == 0) {
+		pthread_cond_broadcast(&group->done_cond);
+	}
+	pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Checks if a parsed listing page had fewer results than a full
+ * page, meaning that there are no more results after it.
+ *
+ * @param group - the group the listing pages were parsed in.
+ * @return 1 if a short page was seen, 0 otherwise.
+ */
+int
+wb_seen_short_page(struct wb_parse_group *group) {
+	int seen;
+
+	pthread_mutex_lock(&group->lock);
+	seen = group->short_page;
+	pthread_mutex_unlock(&group->lock);
+
+	return seen;
+}
+
+/**
+ * Hands a page to the parse pool, which downloads it, converts it
+ * and evaluates an expression on it. Pages are downloaded by as many
+ * workers at a time as there are parse jobs. The results are
+ * available in job->results after wb_wait_parse_jobs() returns for
+ * the group.
+ *
+ * @param group - the group to add the job to.
+ * @param job - the job to fill in.
+ * @param url - the URL of the page.
+ * @param post_data - post data required for search parameters. It
+ *   must not be freed before the job is done.
+ * @param cookies - cookies with login session information. They
+ *   must not be freed before the job is done.
+ * @param expression - the XPath expression to evaluate on the page.
+ * @param scan - a scanner that finds the same result as expression
+ *   in the raw HTML, or NULL.
+ * @param single - 1 if the expression must have exactly one result,
+ *   which is stored in job->result. 0 to store all results in
+ *   job->results.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_queue_parse_job(struct wb_parse_group *group, struct wb_parse_job *job,
+	const char *url, const char *post_data, struct wb_str_list *cookies,
+	const char *expression, wb_scan_func scan, int single) {
+
+	job->group = group;
+	job->post_data = post_data;
+	job->cookies = cookies;
+	job->html = NULL;
+	job->expression = expression;
+	job->scan = scan;
+	job->single = single;
+	job->results = NULL;
+	job->result = NULL;
+
+	/* The URL buffer is reused for the next page */
+	job->url = strdup(url);
+	if (job->url == NULL) {
+		return -1;
+	}
+
+	if (wb_trace_enabled) {
+		job->queued = wb_stats_now();
+	}
+
+	pthread_mutex_lock(&group->lock);
+	group->pending++;
+	pthread_mutex_unlock(&group->lock);
+
+	/* Run it right away if there are no workers */
+	if (parse_pool == NULL) {
+		wb_run_parse_job(job);
+		return 0;
+	}
+
+	if (wb_pool_submit(parse_pool, wb_run_parse_job, job) != 0) {
+		pthread_mutex_lock(&group->lock);
+		group->pending--;
+		pthread_mutex_unlock(&group->lock);
+
+		free(job->url);
+		job->url = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Waits until all queued parse jobs of a group are done. Other
+ * groups' jobs may still be running.
+ *
+ * @param group - the group to wait for.
+ */
+void
+wb_wait_parse_jobs(struct wb_parse_group *group) {
+	pthread_mutex_lock(&group->lock);
+	while (group->pending > 0) {
+		pthread_cond_wait(&group->done_cond, &group->lock);
+	}
+	pthread_mutex_unlock(&group->lock);
+}
+
+/**
+ * Waits for the listing pages queued so far and journals the ones
+ * that were parsed.
+ *
+ * @param checkpoint - the checkpoint to journal them in.
+ * @param group - the group the pages were parsed in.
+ * @param jobs - the parse jobs of the pages.
+ * @param from - the first page to journal.
+ * @param to - the page after the last one to journal.
+ * @param images_per_page - the number of images on a full page.
+ */
+void
+wb_journal_listing_pages(struct wb_checkpoint *checkpoint, struct wb_parse_group *group,
+	struct wb_parse_job *jobs, int from, int to, int images_per_page) {
+
+	int i;
+
+	wb_wait_parse_jobs(group);
+	for (i = from; i < to; i++) {
+		if (!jobs[i].resumed && jobs[i].results != NULL) {
+			wb_checkpoint_add_page(checkpoint, i * images_per_page, jobs[i].results);
+		}
+	}
+	wb_checkpoint_sync(checkpoint);
+}
+
+/**
+ * Waits for the image pages queued so far and journals the ones
+ * that were resolved.
+ *
+ * @param checkpoint - the checkpoint to journal them in.
+ * @param group - the group the pages were parsed in.
+ * @param jobs - the parse jobs of the pages.
+ * @param from - the first page to journal.
+ * @param to - the page after the last one to journal.
+ * @param page_url - the URL of the first page to journal.
+ * @return the URL of the page after the last one journaled.
+ */
+struct wb_str_list *
+wb_journal_image_pages(struct wb_checkpoint *checkpoint, struct wb_parse_group *group,
+	struct wb_parse_job *jobs, int from, int to, struct wb_str_list *page_url) {
+
+	int i;
+
+	wb_wait_parse_jobs(group);
+	for (i = from; i < to; i++) {
+		if (!jobs[i].resumed && jobs[i].result != NULL) {
+			wb_checkpoint_add_image(checkpoint, page_url->str, jobs[i].result);
+		}
+		page_url = page_url->next;
+	}
+	wb_checkpoint_sync(checkpoint);
+
+	return page_url;
+}
+
+/**
+ * Finds the position in the whole query of every image page a shard
+ * got. Image pages past the number of images wanted are dropped.
+ *
+ * @param jobs - the parse jobs of the listing pages, results
+ *   updated.
+ * @param page_count - the number of listing pages.
+ * @param images_per_page - the number of images on a full page.
+ * @param images - the number of images wanted.
+ * @return the positions, in the order of the image pages, NULL on
+ *   error. IMPORTANT: the returned array must be freed using free().
+ */
+long *
+wb_shard_image_pages(struct wb_parse_job *jobs, int page_count, int images_per_page,
+	int images) {
+
+	struct wb_str_list *url, *rest;
+	long *positions;
+	long position;
+	int count, i;
+
+	positions = (long *) malloc((images + 1) * sizeof(long));
+	if (positions == NULL) {
+		return NULL;
+	}
+
+	count = 0;
+	for (i = 0; i < page_count; i++) {
+		position = (long) i * images_per_page;
+		if (position >= images) {
+			wb_list_free(jobs[i].results);
+			jobs[i].results = NULL;
+		}
+
+		for (url = jobs[i].results; url != NULL; url = url->next) {
+			positions[count++] = position++;
+			if (position >= images) {
+				rest = url->next;
+				url->next = NULL;
+				wb_list_free(rest);
+			}
+		}
+	}
+
+	return positions;
+}
+
+/**
+ * Connects to wallbase.cc with the specified post data and
+ * cookies and retrieves image urls. Pages are downloaded and parsed
+ * in the parse pool. A listing page is parsed before the next one is
+ * requested, so that none is requested after the last page of
+ * results. Image pages are downloaded many at a time.
+ *
+ * @param query - the wallbase.cc query to get images from.
+ * @param cookies - cookies with login session information.
+ * @param checkpoint (optional) - listing and image pages found in it
+ *   are not downloaded again, new ones are journaled in it.
+ * @return a wb_str_list of image urls on success, NULL
+ *   otherwise. A shard only gets its own listing pages and prints
+ *   every image url after its position in the whole query.
+ *   IMPORTANT: the returned list must be freed with wb_list_free().
+ */
+struct wb_str_list *
+wb_get_image_urls(struct wb_query *query, struct wb_str_list *cookies,
+	struct options *options, struct wb_checkpoint *checkpoint) {
+
+	struct wb_str_list *img_urls      = NULL;
+	struct wb_str_list *img_page_urls = NULL;
+	const struct wb_checkpoint_page *done;
+	struct wb_parse_group group;
+	struct wb_parse_job *jobs;
+	struct wb_plan plan;
+	char *page_url;
+	long *positions = NULL;
+	double start = 0;
+	int page_count, journaled, show_progress, i;
+
+	/* With a deadline, image pages are resolved as soon as their
+	   listing page is parsed */
+	if (run_deadline > 0) {
+		return wb_get_image_urls_in_time(query, cookies, options, checkpoint);
+	}
+
+	show_progress = options->flags & WB_FLAG_PROGRESS;
+	wb_parse_group_init(&group);
+
+	/* Get image page URLs */
+	wb_plan_pages(options->images, options->images_per_page, &plan);
+	jobs = (struct wb_parse_job *) calloc(plan.page_count, sizeof(struct wb_parse_job));
+	if (jobs == NULL) {
+		wb_parse_group_destroy(&group);
+		return NULL;
+	}
+
+	page_url = (char *) malloc(wb_query_page_url_size(query));
+	if (page_url == NULL) {
+		free(jobs);
+		wb_parse_group_destroy(&group);
+		return NULL;
+	}
+
+	/* Stop once a page comes back short, there is nothing after it */
+	journaled = 0;
+	for (page_count = 0; page_count < plan.page_count; page_count++) {
+		wb_wait_parse_jobs(&group);
+		if (page_count > 0 && wb_seen_short_page(&group)) {
+			break;
+		}
+
+		/* Other shards get the pages that are not this one's */
+		if (!wb_shard_owns_page(options->shard_index, options->shard_count, page_count)) {
+			continue;
+		}
+
+		/* Pages an earlier run parsed are not downloaded again */
+		if (checkpoint != NULL) {
+			if (wb_trace_enabled) {
+				start = wb_stats_now();
+			}
+			done = wb_checkpoint_find_page(checkpoint, page_count * plan.images_per_page);
+			if (wb_trace_enabled) {
+				wb_trace_span("cache lookup", "cache", start, wb_stats_now(), NULL);
+			}
+			if (done != NULL) {
+				wb_stats_count(WB_STATS_CHECKPOINT_HITS, 1);
+				jobs[page_count].results = wb_list_append_all(NULL, done->urls);
+				jobs[page_count].resumed = 1;
+				if (wb_list_length(done->urls) < plan.images_per_page) {
+					pthread_mutex_lock(&group.lock);
+					group.short_page = 1;
+					pthread_mutex_unlock(&group.lock);
+				}
+				continue;
+			}
+		}
+
+		/* Nothing new is started once the run is cancelled */
+		if (!wb_deadline_allows(0)) {
+			break;
+		}
+
+		if (show_progress) {
+			printf("Getting page URLs: %d - %d\r", page_count * plan.images_per_page + 1,
+				(page_count + 1) * plan.images_per_page);
+			fflush(stdout);
+		}
+
+		wb_query_page_url(query, page_count * plan.images_per_page, page_url);
+		jobs[page_count].full_page = plan.images_per_page;
+		wb_queue_parse_job(&group, &jobs[page_count], page_url, query->post_data, cookies,
+			XPATH_IMAGE_PAGE_URL, NULL, 0);
+
+		if (checkpoint != NULL && page_count + 1 - journaled >= CHECKPOINT_PAGES) {
+			wb_journal_listing_pages(checkpoint, &group, jobs, journaled, page_count + 1,
+				plan.images_per_page);
+			journaled = page_count + 1;
+		}
+	}
+	free(page_url);
+
+	wb_wait_parse_jobs(&group);
+	if (checkpoint != NULL) {
+		wb_journal_listing_pages(checkpoint, &group, jobs, journaled, page_count,
+			plan.images_per_page);
+	}
+	if (options->shard_count > 0) {
+		positions = wb_shard_image_pages(jobs, page_count, plan.images_per_page,
+			options->images);
+	}
+	for (i = 0; i < page_count; i++) {
+		img_page_urls = wb_list_append_all(img_page_urls, jobs[i].results);
+		wb_list_free(jobs[i].results);
+	}
+	free(jobs);
+
+	if (show_progress) {
+		printf("\n");
+		fflush(stdout);
+	}
+
+	/* Get an image URL from every image page URL */
+	if (options->shard_count == 0 || positions != NULL) {
+		img_urls = wb_get_image_urls_from_pages(img_page_urls, options->images,
+			cookies, options, NULL, checkpoint, positions);
+	}
+
+	/* Cleanup */
+	free(positions);
+	wb_list_free(img_page_urls);
+	wb_parse_group_destroy(&group);
+
+	return img_urls;
+}
+
+/**
+ * Get the image URLs of a query before the deadline. Unlike
+ * wb_get_image_urls(), the image pages of every listing page are
+ * resolved as soon as it is parsed, so the time left goes to the
+ * image pages already found before any new listing page. A listing
+ * page is only requested while there is twice as long left as the
+ * slowest one took.
+ *
+ * @param query - the query.
+ * @param cookies - cookies with login session information.
+ * @param options - the options of the query.
+ * @param checkpoint (optional) - listing and image pages found in it
+ *   are not downloaded again, new ones are journaled in it.
+ * @return a wb_str_list of image urls, NULL if none were found.
+ *   IMPORTANT: the returned list must be freed with wb_list_free().
+ */
+struct wb_str_list *
+wb_get_image_urls_in_time(struct wb_query *query, struct wb_str_list *cookies,
+	struct options *options, struct wb_checkpoint *checkpoint) {
+
+	struct wb_str_list *img_urls = NULL;
+	struct wb_str_list *page_img_urls;
+	const struct wb_checkpoint_page *done;
+	struct wb_parse_group group;
+	struct wb_parse_job listing;
+	struct wb_plan plan;
+	char *page_url;
+	double listing_time = 0, fetch_time;
+	int found, page_count;
+
+	page_url = (char *) malloc(wb_query_page_url_size(query));
+	if (page_url == NULL) {
+		return NULL;
+	}
+	wb_parse_group_init(&group);
+
+	/* Stop once a page comes back short, there is nothing after it */
+	wb_plan_pages(options->images, options->images_per_page, &plan);
+	found = 0;
+	for (page_count = 0; page_count < plan.page_count && found < options->images;
+		page_count++) {
+
+		if (page_count > 0 && wb_seen_short_page(&group)) {
+			break;
+		}
+
+		memset(&listing, 0, sizeof(struct wb_parse_job));
+
+		/* Pages an earlier run parsed are not downloaded again */
+		done = NULL;
+		if (checkpoint != NULL) {
+			done = wb_checkpoint_find_page(checkpoint, page_count * plan.images_per_page);
+		}
+
+		if (done != NULL) {
+			wb_stats_count(WB_STATS_CHECKPOINT_HITS, 1);
+			listing.results = wb_list_append_all(NULL, done->urls);
+			if (wb_list_length(done->urls) < plan.images_per_page) {
+				pthread_mutex_lock(&group.lock);
+				group.short_page = 1;
+				pthread_mutex_unlock(&group.lock);
+			}
+		} else {
+			/* The image pages found so far are all resolved, leave as
+			   long as the slowest listing page took for the ones on
+			   the next one */
+			if (!wb_deadline_allows(2 * listing_time)) {
+				break;
+			}
+
+			listing.full_page = plan.images_per_page;
+			wb_query_page_url(query, page_count * plan.images_per_page, page_url);
+			fetch_time = wb_stats_now();
+			wb_queue_parse_job(&group, &listing, page_url, query->post_data, cookies,
+				XPATH_IMAGE_PAGE_URL, NULL, 0);
+			wb_wait_parse_jobs(&group);
+			fetch_time = wb_stats_now() - fetch_time;
+			if (fetch_time > listing_time) {
+				listing_time = fetch_time;
+			}
+
+			if (checkpoint != NULL && listing.results != NULL) {
+				wb_checkpoint_add_page(checkpoint, page_count * plan.images_per_page,
+					listing.results);
+				wb_checkpoint_sync(checkpoint);
+			}
+		}
+
+		/* Resolve the image pages on it right away */
+		page_img_urls = wb_get_image_urls_from_pages(listing.results, options->images - found,
+			cookies, options, NULL, checkpoint, NULL);
+		found += wb_list_length(page_img_urls);
+		img_urls = wb_list_append_all(img_urls, page_img_urls);
+		wb_list_free(page_img_urls);
+		wb_list_free(listing.results);
+	}
+	free(page_url);
+	wb_parse_group_destroy(&group);
+
+	return img_urls;
+}
+
+/**
+ * Get the image URL from every image page in a list. The pages are
+ * downloaded and parsed in the parse pool, many at a time.
+ *
+ * @param img_page_urls - the image page URLs.
+ * @param max - the maximum number of image pages to use.
+ * @param cookies - cookies with login session information.
+ * @param options - the options of the query.
+ * @param emitted (optional) - the IDs of pages whose image URL was
+ *   found are added to this set.
+ * @param checkpoint (optional) - image pages found in it are not
+ *   downloaded again, new ones are journaled in it.
+ * @param positions (optional) - the position of every image page in
+ *   the whole query. Image urls are prefixed with them, the way a
+ *   shard prints them.
+ * @return a wb_str_list of image urls, NULL if none were found.
+ *   IMPORTANT: the returned list must be freed with wb_list_free().
+ */
+struct wb_str_list *
+wb_get_image_urls_from_pages(struct wb_str_list *img_page_urls, int max,
+	struct wb_str_list *cookies, struct options *options, struct wb_seen *emitted,
+	struct wb_checkpoint *checkpoint, const long *positions) {
+
+	struct wb_str_list *img_urls     = NULL;
+	struct wb_str_list *img_page_url = NULL;
+	struct wb_str_list *journal_from = NULL;
+	struct wb_str_list *img_url;
+	struct wb_index_entry *entries = NULL;
+	struct wb_parse_group group;
+	struct wb_parse_job *jobs;
+	const char *done;
+	char *line;
+	double start = 0;
+	size_t entry_count;
+	int job_count, journaled, show_progress, i;
+
+	show_progress = options->flags & WB_FLAG_PROGRESS;
+
+	job_count = 0;
+	img_page_url = img_page_urls;
+	while ((job_count < max) && (img_page_url != NULL)) {
+		job_count++;
+		img_page_url = img_page_url->next;
+	}
+
+	jobs = (struct wb_parse_job *) calloc(job_count + 1, sizeof(struct wb_parse_job));
+	if (jobs == NULL) {
+		return NULL;
+	}
+
+	/* Image page details are recorded when there is an index */
+	if (options->index_file != NULL) {
+		entries = (struct wb_index_entry *) calloc(job_count + 1, sizeof(struct wb_index_entry));
+		if (entries == NULL) {
+			free(jobs);
+			return NULL;
+		}
+	}
+	wb_parse_group_init(&group);
+
+	journaled = 0;
+	journal_from = img_page_urls;
+	img_page_url = img_page_urls;
+	for (i = 0; i < job_count; i++) {
+		if (show_progress) {
+			printf("Getting image URLs: %d / %d\r", i + 1, max);
+			fflush(stdout);
+		}
+
+		/* Images an earlier run resolved are not downloaded again */
+		done = NULL;
+		if (checkpoint != NULL) {
+			if (wb_trace_enabled) {
+				start = wb_stats_now();
+			}
+			done = wb_checkpoint_find_image(checkpoint, img_page_url->str);
+			if (wb_trace_enabled) {
+				wb_trace_span("cache lookup", "cache", start, wb_stats_now(), img_page_url->str);
+			}
+		}
+
+		if (done != NULL) {
+			wb_stats_count(WB_STATS_CHECKPOINT_HITS, 1);
+			jobs[i].result = strdup(done);
+			jobs[i].resumed = 1;
+		} else if (wb_deadline_allows(0)) {
+			if (entries != NULL) {
+				jobs[i].entry = &entries[i];
+			}
+			wb_queue_parse_job(&group, &jobs[i], img_page_url->str, NULL, cookies,
+				XPATH_IMAGE_URL, options->fast_scan ? scan_wall_image_url : NULL, 1);
+		}
+		img_page_url = img_page_url->next;
+
+		if (checkpoint != NULL && i + 1 - journaled >= CHECKPOINT_PAGES) {
+			journal_from = wb_journal_image_pages(checkpoint, &group, jobs, journaled, i + 1,
+				journal_from);
+			journaled = i + 1;
+		}
+	}
+
+	wb_wait_parse_jobs(&group);
+	if (checkpoint != NULL) {
+		wb_journal_image_pages(checkpoint, &group, jobs, journaled, job_count, journal_from);
+	}
+	entry_count = 0;
+	img_page_url = img_page_urls;
+	for (i = 0; i < job_count; i++) {
+		if (jobs[i].result != NULL) {
+			img_urls = wb_list_append_nocopy(img_urls, jobs[i].result);
+			if (emitted != NULL) {
+				wb_seen_add(emitted, wb_image_page_id(img_page_url->str));
+			}
+
+			/* Entries are recorded only for numeric IDs */
+			if (entries != NULL && entries[i].image_url != NULL) {
+				entries[entry_count] = entries[i];
+				entries[entry_count].id = (unsigned int) strtoul(
+					wb_image_page_id(img_page_url->str), NULL, 10);
+				entries[entry_count].fetched = time(NULL);
+				if (entries[entry_count].id != 0) {
+					entry_count++;
+				} else {
+					free(entries[entry_count].tags);
+				}
+			}
+		} else if (entries != NULL) {
+			free(entries[i].tags);
+		}
+		img_page_url = img_page_url->next;
+	}
+	wb_parse_group_destroy(&group);
+
+	/* Record the details, the image URLs belong to img_urls */
+	if (entries != NULL) {
+		wb_index_append(options->index_file, entries, entry_count);
+		for (i = 0; i < entry_count; i++) {
+			free(entries[i].tags);
+		}
+		free(entries);
+	}
+
+	/* Put every image URL after its position */
+	img_url = img_urls;
+	for (i = 0; positions != NULL && i < job_count; i++) {
+		if (jobs[i].result != NULL) {
+			line = wb_shard_line(positions[i], img_url->str);
+			if (line != NULL) {
+				wb_mem_count(WB_MEM_STR_LIST,
+					(long) wb_mem_size(line) - (long) wb_mem_size(img_url->str), 0);
+				free(img_url->str);
+				img_url->str = line;
+			}
+			img_url = img_url->next;
+		}
+	}
+	free(jobs);
+
+	if (show_progress) {
+		printf("\n");
+		fflush(stdout);
+	}
+
+	return img_urls;
+}
+
+/**
+ * Get the ID of an image from its image page URL, the last
+ * segment of the URL's path.
+ *
+ * @param url - the image page URL.
+ * @return a pointer to the ID in url.
+ */
+const char *
+wb_image_page_id(const char *url) {
+	const char *id;
+
+	id = strrchr(url, '/');
+	if (id == NULL || id[1] == '\0') {
+		return url;
+	}
+
+	return id + 1;
+}
+
+/**
+ * Plans the listing pages of a query, generates its URL and gets
+ * its image URLs.
+ *
+ * @param options - the options of the query. images_per_page is
+ *   set to the planned page size.
+ * @param cookies - cookies with login session information.
+ * @param line - the batch file line of the query, 0 if it is not
+ *   from a batch file.
+ * @return a wb_str_list of image urls on success, NULL otherwise.
+ *   IMPORTANT: the returned list must be freed with wb_list_free().
+ */
+struct wb_str_list *
+wb_run_query(struct options *options, struct wb_str_list *cookies, int line) {
+	struct wb_str_list *image_urls;
+	struct wb_checkpoint *checkpoint;
+	struct wb_query *query;
+	double start = 0;
+
+	/* Answer offline queries from the index */
+	if ((options->flags & WB_FLAG_OFFLINE) > 0) {
+		if (offline_index == NULL) {
+			fprintf(stderr, "Error: --offline must be given on the command line\n");
+			return NULL;
+		}
+
+		if (wb_trace_enabled) {
+			start = wb_stats_now();
+		}
+		image_urls = wb_index_query(offline_index, options);
+		if (wb_trace_enabled) {
+			wb_trace_span("cache lookup", "cache", start, wb_stats_now(), NULL);
+		}
+		return image_urls;
+	}
+
+	/* Plan the listing pages */
+	wb_plan_query(options, line, NULL);
+
+	/* Generate the query URL and POST data */
+	query = wb_generate_query(options);
+	if (query == NULL) {
+		return NULL;
+	}
+
+	/* Pick up where an earlier run stopped */
+	checkpoint = NULL;
+	if (options->checkpoint_file != NULL) {
+		checkpoint = wb_open_checkpoint(query, options);
+		if (checkpoint == NULL) {
+			wb_query_free(query);
+			return NULL;
+		}
+	}
+
+	/* Get image urls */
+	image_urls = wb_get_image_urls(query, cookies, options, checkpoint);
+	wb_checkpoint_close(checkpoint);
+	wb_query_free(query);
+
+	return image_urls;
+}
+
+/**
+ * Waits for the image page in a --stream slot to be resolved, prints
+ * its image URL and frees it.
+ *
+ * @param slot - the slot of the image page.
+ * @param out - where to print the image URL.
+ * @return 1 if an image URL was printed, 0 otherwise.
+ */
+int
+wb_stream_flush_slot(struct wb_stream_slot *slot, FILE *out) {
+	wb_wait_parse_jobs(&slot->group);
+	if (slot->job.result == NULL) {
+		return 0;
+	}
+
+	fprintf(out, "%s\n", slot->job.result);
+	fflush(out);
+	free(slot->job.result);
+	slot->job.result = NULL;
+
+	return 1;
+}
+
+/**
+ * Get the image URLs of a query and print them in query order as
+ * soon as they are found. Only one listing page and a window of
+ * image pages are held at a time: no image page is downloaded while
+ * the window is full, until the oldest one in it is printed, and the
+ * next listing page is downloaded only once every image page of the
+ * one before it is in the window. Memory grows with the number of
+ * parse jobs, not with the number of images.
+ *
+ * @param query - the query.
+ * @param cookies - cookies with login session information.
+ * @param options - the options of the query.
+ * @param out - where to print the image URLs.
+ * @return the number of image URLs printed, -1 on error.
+ */
+int
+wb_stream_image_urls(struct wb_query *query, struct wb_str_list *cookies,
+	struct options *options, FILE *out) {
+
+	struct wb_str_list *img_page_url;
+	struct wb_stream_slot *slots;
+	struct wb_stream_slot *slot;
+	struct wb_parse_group listing_group;
+	struct wb_parse_job listing;
+	struct wb_plan plan;
+	char *page_url;
+	double listing_time = 0, fetch_time;
+	int window, queued, printed, page_count, i;
+
+	window = (options->jobs > 0) ? options->jobs : wb_pool_default_workers();
+	window *= STREAM_WINDOW_PER_JOB;
+	slots = (struct wb_stream_slot *) calloc(window, sizeof(struct wb_stream_slot));
+	if (slots == NULL) {
+		return -1;
+	}
+
+	page_url = (char *) malloc(wb_query_page_url_size(query));
+	if (page_url == NULL) {
+		free(slots);
+		return -1;
+	}
+
+	for (i = 0; i < window; i++) {
+		wb_parse_group_init(&slots[i].group);
+	}
+	wb_parse_group_init(&listing_group);
+
+	/* Stop once a page comes back short, there is nothing after it */
+	wb_plan_pages(options->images, options->images_per_page, &plan);
+	queued = 0;
+	printed = 0;
+	for (page_count = 0; page_count < plan.page_count && queued < options->images;
+		page_count++) {
+
+		if (page_count > 0 && wb_seen_short_page(&listing_group)) {
+			break;
+		}
+
+		/* The image pages found so far are all downloaded, leave as
+		   long as the slowest listing page took for the ones on the
+		   next one */
+		if (!wb_deadline_allows(2 * listing_time)) {
+			break;
+		}
+
+		memset(&listing, 0, sizeof(struct wb_parse_job));
+		listing.full_page = plan.images_per_page;
+		wb_query_page_url(query, page_count * plan.images_per_page, page_url);
+		fetch_time = wb_stats_now();
+		wb_queue_parse_job(&listing_group, &listing, page_url, query->post_data, cookies,
+			XPATH_IMAGE_PAGE_URL, NULL, 0);
+		wb_wait_parse_jobs(&listing_group);
+		fetch_time = wb_stats_now() - fetch_time;
+		if (fetch_time > listing_time) {
+			listing_time = fetch_time;
+		}
+
+		img_page_url = listing.results;
+		while (img_page_url != NULL && queued < options->images && wb_deadline_allows(0)) {
+			/* Make room by printing the oldest image page */
+			slot = &slots[queued % window];
+			if (queued >= window) {
+				printed += wb_stream_flush_slot(slot, out);
+			}
+
+			memset(&slot->job, 0, sizeof(struct wb_parse_job));
+			wb_queue_parse_job(&slot->group, &slot->job, img_page_url->str, NULL, cookies,
+				XPATH_IMAGE_URL, options->fast_scan ? scan_wall_image_url : NULL, 1);
+			queued++;
+			img_page_url = img_page_url->next;
+		}
+		wb_list_free(listing.results);
+	}
+	free(page_url);
+
+	/* Print the rest of the window, oldest first */
+	for (i = (queued > window) ? queued - window : 0; i < queued; i++) {
+		printed += wb_stream_flush_slot(&slots[i % window], out);
+	}
+
+	for (i = 0; i < window; i++) {
+		wb_parse_group_destroy(&slots[i].group);
+	}
+	wb_parse_group_destroy(&listing_group);
+	free(slots);
+
+	return printed;
+}
+
+/**
+ * Plans the listing pages of a query, generates its URL and prints
+ * its image URLs as they are found.
+ *
+ * @param options - the options of the query. images_per_page is
+ *   set to the planned page size.
+ * @param cookies - cookies with login session information.
+ * @param out - where to print the image URLs.
+ * @return the number of image URLs printed, -1 on error.
+ */
+int
+wb_stream_query(struct options *options, struct wb_str_list *cookies, FILE *out) {
+	struct wb_query *query;
+	int printed;
+
+	/* Plan the listing pages */
+	wb_plan_query(options, 0, NULL);
+
+	/* Generate the query URL and POST data */
+	query = wb_generate_query(options);
+	if (query == NULL) {
+		return -1;
+	}
+
+	printed = wb_stream_image_urls(query, cookies, options, out);
+	wb_query_free(query);
+
+	return printed;
+}
+
+/**
+ * Opens the checkpoint of a query. The journal is identified by the
+ * query's first listing page URL and POST data.
+ *
+ * @param query - the query.
+ * @param options - the options of the query.
+ * @return the checkpoint on success, NULL otherwise. IMPORTANT: the
+ *   returned checkpoint must be closed with wb_checkpoint_close().
+ */
+struct wb_checkpoint *
+wb_open_checkpoint(struct wb_query *query, struct options *options) {
+	struct wb_checkpoint *checkpoint;
+	const char *post_data;
+	char *query_id;
+	size_t url_length;
+
+	post_data = (query->post_data != NULL) ? query->post_data : "";
+	query_id = (char *) malloc(wb_query_page_url_size(query) + strlen(post_data) + 1);
+	if (query_id == NULL) {
+		return NULL;
+	}
+
+	wb_query_page_url(query, 0, query_id);
+	url_length = strlen(query_id);
+	query_id[url_length] = '\t';
+	strcpy(query_id + url_length + 1, post_data);
+
+	checkpoint = wb_checkpoint_open(options->checkpoint_file, query_id,
+		(options->flags & WB_FLAG_RESUME) > 0);
+	free(query_id);
+
+	return checkpoint;
+}
+
+/**
+ * Plans the listing pages of a query and prints the plan in
+ * verbose mode.
+ *
+ * @param options - the options of the query. images_per_page is
+ *   set to the planned page size.
+ * @param line - the batch file line of the query, 0 if it is not
+ *   from a batch file.
+ * @param plan (optional) - where to store the plan.
+ */
+void
+wb_plan_query(struct options *options, int line, struct wb_plan *plan_out) {
+	struct wb_plan plan;
+	char prefix[32];
+
+	wb_plan_pages(options->images, 0, &plan);
+	options->images_per_page = plan.images_per_page;
+	if ((options->flags & WB_FLAG_VERBOSE) > 0) {
+		prefix[0] = '\0';
+		if (line > 0) {
+			snprintf(prefix, sizeof(prefix), "Line %d: ", line);
+		}
+		fprintf(stderr, "%sPlan: %d images in %d pages of %d, %d from the last page\n",
+			prefix, options->images, plan.page_count, plan.images_per_page, plan.last_page_images);
+	}
+
+	if (plan_out != NULL) {
+		*plan_out = plan;
+	}
+}
+
+/**
+ * Parses a listing page and returns the image page URLs on it.
+ *
+ * @param html - the HTML of the page, freed by this function.
+ * @return a wb_str_list of image page urls, NULL if there are none
+ *   or on error. IMPORTANT: the returned list must be freed with
+ *   wb_list_free().
+ */
+struct wb_str_list *
+wb_parse_image_page_urls(char *html) {
+	struct wb_str_list *urls;
+	char *xml_data;
+
+	xml_data = convert_html_to_xml(html);
+	free(html);
+	if (xml_data == NULL) {
+		return NULL;
+	}
+
+	urls = xpath_eval_expr(xml_data, XPATH_IMAGE_PAGE_URL, NULL);
+	free(xml_data);
+
+	return urls;
+}
+
+/**
+ * Gets the image page URLs that were not emitted yet. The first
+ * listing page is requested conditionally, and the next page is
+ * only requested while every image on a full page is new.
+ *
+ * @param query - the query.
+ * @param plan - the planned listing pages.
+ * @param cookies - cookies with login session information.
+ * @param validators - validators of the first listing page, updated.
+ * @param emitted - the IDs of the images already emitted.
+ * @param page_url - a buffer of wb_query_page_url_size() bytes.
+ * @return a wb_str_list of new image page urls, NULL if there are
+ *   none or on error. IMPORTANT: the returned list must be freed
+ *   with wb_list_free().
+ */
+struct wb_str_list *
+wb_watch_new_pages(struct wb_query *query, struct wb_plan *plan,
+	struct wb_str_list *cookies, struct net_validators *validators,
+	struct wb_seen *emitted, char *page_url) {
+
+	struct wb_str_list *new_page_urls = NULL;
+	struct wb_str_list *page_urls, *img_page_url;
+	int not_modified, all_new, count, page;
+	double start = 0;
+	char *html;
+
+	if (wb_metrics_enabled) {
+		start = wb_stats_now();
+	}
+
+	wb_query_page_url(query, 0, page_url);
+	html = net_request(page_url, query->post_data, &cookies, 0, validators, &not_modified);
+	if (wb_metrics_enabled) {
+		wb_metrics_record_request(WB_METRICS_LISTING, wb_stats_now() - start);
+	}
+	if (html == NULL && !not_modified && !net_cancelled()) {
+		fprintf(stderr, "Error: unable to get %s\n", page_url);
+	}
+
+	for (page = 0; html != NULL; page++) {
+		if (wb_metrics_enabled) {
+			start = wb_stats_now();
+		}
+		page_urls = wb_parse_image_page_urls(html);
+		html = NULL;
+		if (wb_metrics_enabled) {
+			wb_metrics_record_parse(wb_stats_now() - start);
+		}
+
+		all_new = 1;
+		count = 0;
+		img_page_url = page_urls;
+		while (img_page_url != NULL) {
+			if (wb_seen_contains(emitted, wb_image_page_id(img_page_url->str))) {
+				all_new = 0;
+			} else {
+				new_page_urls = wb_list_append(new_page_urls, img_page_url->str);
+			}
+			count++;
+			img_page_url = img_page_url->next;
+		}
+		wb_list_free(page_urls);
+
+		/* New images may have pushed others to the next page */
+		if (all_new && count == plan->images_per_page && page + 1 < plan->page_count) {
+			if (wb_metrics_enabled) {
+				start = wb_stats_now();
+			}
+			wb_query_page_url(query, (page + 1) * plan->images_per_page, page_url);
+			html = net_get_response(page_url, query->post_data, &cookies, 0);
+			if (wb_metrics_enabled) {
+				wb_metrics_record_request(WB_METRICS_LISTING, wb_stats_now() - start);
+			}
+		}
+	}
+
+	return new_page_urls;
+}
+
+/**
+ * Keeps checking a query for new images and prints their URLs.
+ * Image pages are never downloaded again for images that were
+ * already printed.
+ *
+ * @param options - the options of the query.
+ * @param cookies - cookies with login session information.
+ * @return 1 on error, 0 once the run is cancelled.
+ */
+int
+wb_watch(struct options *options, struct wb_str_list *cookies) {
+	struct net_validators validators = {NULL, NULL};
+	struct wb_str_list *new_page_urls, *image_urls;
+	struct wb_query *query;
+	struct wb_seen *emitted;
+	struct wb_plan plan;
+	char *page_url;
+	int slept;
+
+	wb_plan_query(options, 0, &plan);
+
+	query = wb_generate_query(options);
+	if (query == NULL) {
+		return 1;
+	}
+
+	emitted = wb_seen_new();
+	page_url = (char *) malloc(wb_query_page_url_size(query));
+	if (emitted == NULL || page_url == NULL) {
+		if (emitted != NULL) {
+			wb_seen_free(emitted);
+		}
+		free(page_url);
+		wb_query_free(query);
+		return 1;
+	}
+
+	while (!net_cancelled()) {
+		new_page_urls = wb_watch_new_pages(query, &plan, cookies, &validators, emitted, page_url);
+		if (new_page_urls != NULL) {
+			image_urls = wb_get_image_urls_from_pages(new_page_urls, options->images,
+				cookies, options, emitted, NULL, NULL);
+			wb_list_print(image_urls);
+			fflush(stdout);
+
+			wb_list_free(image_urls);
+			wb_list_free(new_page_urls);
+		}
+
+		wb_dump_metrics();
+
+		/* A second at a time, to notice cancelling */
+		for (slept = 0; slept < options->watch_interval && !net_cancelled(); slept++) {
+			sleep(1);
+		}
+	}
+
+	net_validators_free(&validators);
+	wb_seen_free(emitted);
+	free(page_url);
+	wb_query_free(query);
+
+	return 0;
+}
+
+/**
+ * Frees a login session.
+ *
+ * @param session - the session.
+ */
+void
+wb_free_session(struct wb_session *session) {
+	free(session->username);
+	free(session->password);
+	wb_list_free(session->cookies);
+	pthread_cond_destroy(&session->logged_in);
+	free(session);
+}
+
+/**
+ * Creates a login session that is logging in, used by the query
+ * that creates it.
+ *
+ * @param username - wallbase.cc username
+ * @param password - wallbase.cc password
+ * @return the session on success, NULL otherwise.
+ */
+struct wb_session *
+wb_new_session(const char *username, const char *password) {
+	struct wb_session *session;
+
+	session = (struct wb_session *) calloc(1, sizeof(struct wb_session));
+	if (session == NULL) {
+		return NULL;
+	}
+	pthread_cond_init(&session->logged_in, NULL);
+
+	session->username = strdup(username);
+	session->password = strdup(password);
+	if (session->username == NULL || session->password == NULL) {
+		wb_free_session(session);
+		return NULL;
+	}
+
+	session->users = 1;
+	session->logging_in = 1;
+	return session;
+}
+
+/**
+ * Frees all login sessions, once no query runs.
+ */
+void
+wb_free_sessions() {
+	struct wb_session *next;
+
+	while (sessions != NULL) {
+		next = sessions->next;
+		wb_free_session(sessions);
+		sessions = next;
+	}
+}
+
+/**
+ * Gives back a session from wb_get_session(). An expired
+ * session is freed once no query uses it.
+ *
+ * @param session - the session.
+ * @param expired - 1 if a query failed with the session, so
+ *   that the next query logs in again.
+ */
+void
+wb_release_session(struct wb_session *session, int expired) {
+	struct wb_session **link;
+
+	pthread_mutex_lock(&sessions_lock);
+
+	session->users--;
+	if (expired) {
+		session->expired = 1;
+	}
+
+	if (session->expired && session->users == 0) {
+		link = &sessions;
+		while (*link != session) {
+			link = &(*link)->next;
+		}
+		*link = session->next;
+		wb_free_session(session);
+	}
+
+	pthread_mutex_unlock(&sessions_lock);
+}
+
+/**
+ * Gets the login session of some credentials, logging
+ * in if there is none yet or the last one expired. Queries with the
+ * same credentials wait for a login that is running, the others
+ * don't.
+ *
+ * @param username - wallbase.cc username
+ * @param password - wallbase.cc password
+ * @return the session on success, NULL otherwise. IMPORTANT: it
+ *   must be given back with wb_release_session().
+ */
+struct wb_session *
+wb_get_session(const char *username, const char *password) {
+	struct wb_session *session;
+	struct wb_str_list *cookies;
+
+	pthread_mutex_lock(&sessions_lock);
+
+	session = sessions;
+	while (session != NULL && (session->expired
+		|| strcmp(session->username, username) != 0
+		|| strcmp(session->password, password) != 0)) {
+		session = session->next;
+	}
+
+	if (session != NULL) {
+		session->users++;
+
+		/* Another query is logging in with the same credentials */
+		while (session->logging_in) {
+			pthread_cond_wait(&session->logged_in, &sessions_lock);
+		}
+
+		pthread_mutex_unlock(&sessions_lock);
+	} else {
+		session = wb_new_session(username, password);
+		if (session == NULL) {
+			pthread_mutex_unlock(&sessions_lock);
+			return NULL;
+		}
+		session->next = sessions;
+		sessions = session;
+
+		/* Queries with other credentials don't wait for the login */
+		pthread_mutex_unlock(&sessions_lock);
+		cookies = wb_login(username, password);
+		pthread_mutex_lock(&sessions_lock);
+
+		session->cookies = cookies;
+		session->expired = (cookies == NULL);
+		session->logging_in = 0;
+		pthread_cond_broadcast(&session->logged_in);
+
+		pthread_mutex_unlock(&sessions_lock);
+	}
+
+	/* The cookies don't change once the login is done */
+	if (session->cookies == NULL) {
+		wb_release_session(session, 1);
+		return NULL;
+	}
+
+	return session;
+}
+
+
+/**
+ * Runs a query with the login session of its credentials if it
+ * needs one. A query that fails with a session is run once more
+ * after logging in again, in case the session expired.
+ *
+ * @param options - the options of the query.
+ * @param line - the batch file line of the query, 0 if none.
+ * @return a list of image URLs on success, NULL otherwise.
+ *   IMPORTANT: the list must be freed with wb_list_free().
+ */
+struct wb_str_list *
+wb_run_session_query(struct options *options, int line) {
+	struct wb_session *session;
+	struct wb_str_list *image_urls = NULL;
+	int attempt;
+
+	/* Offline queries never go to wallbase.cc */
+	if ((options->purity & WB_PURITY_NSFW) == 0 || offline_index != NULL) {
+		return wb_run_query(options, NULL, line);
+	}
+
+	for (attempt = 0; attempt < 2 && image_urls == NULL; attempt++) {
+		session = wb_get_session(options->username, options->password);
+		if (session == NULL) {
+			break;
+		}
+
+		image_urls = wb_run_query(options, session->cookies, line);
+		wb_release_session(session, image_urls == NULL);
+	}
+
+	return image_urls;
+}
+
+/**
+ * Runs the queries of a batch until there are none left. Runs in a
+ * batch thread.
+ *
+ * @param arg - the wb_batch_runner shared by the batch threads.
+ * @return NULL.
+ */
+void *
+wb_run_batch_queries(void *arg) {
+	struct wb_batch_runner *runner = (struct wb_batch_runner *) arg;
+	struct wb_batch_query *query;
+
+	for (;;) {
+		pthread_mutex_lock(&runner->lock);
+		if (runner->next >= runner->batch->count || net_cancelled()) {
+			pthread_mutex_unlock(&runner->lock);
+			break;
+		}
+		query = &runner->batch->queries[runner->next++];
+		pthread_mutex_unlock(&runner->lock);
+
+		query->image_urls = wb_run_session_query(&query->options, query->line);
+		query->failed = query->image_urls == NULL;
+	}
+
+	return NULL;
+}
+
+/**
+ * Runs all queries of a batch at the same time and prints their
+ * image URLs, each preceded by the line number of its query and a
+ * tab. The queries share the parse pool, DNS and TLS sessions and
+ * the login session of their credentials.
+ *
+ * @param batch - the batch to run.
+ * @return 0 if all queries succeeded, 1 otherwise.
+ */
+int
+wb_run_batch(struct wb_batch *batch) {
+	struct wb_batch_runner runner;
+	struct wb_str_list *image_url;
+	pthread_t threads[BATCH_THREADS_MAX];
+	int thread_count, started, status, i;
+
+	runner.batch = batch;
+	runner.next = 0;
+	pthread_mutex_init(&runner.lock, NULL);
+
+	/* Progress lines of several queries would be mixed up */
+	for (i = 0; i < batch->count; i++) {
+		batch->queries[i].options.flags &= ~WB_FLAG_PROGRESS;
+	}
+
+	thread_count = batch->count < BATCH_THREADS_MAX ? batch->count : BATCH_THREADS_MAX;
+	for (started = 0; started < thread_count; started++) {
+		if (pthread_create(&threads[started], NULL, wb_run_batch_queries, &runner) != 0) {
+			break;
+		}
+	}
+
+	/* Run the queries on this thread if no thread could be started */
+	if (started == 0) {
+		wb_run_batch_queries(&runner);
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&runner.lock);
+
+	/* Print the results in batch file order */
+	status = 0;
+	for (i = 0; i < batch->count; i++) {
+		if (batch->queries[i].failed) {
+			fprintf(stderr, "Error: query on batch line %d failed\n", batch->queries[i].line);
+			status = 1;
+			continue;
+		}
+
+		image_url = batch->queries[i].image_urls;
+		while (image_url != NULL) {
+			printf("%d\t%s\n", batch->queries[i].line, image_url->str);
+			image_url = image_url->next;
+		}
+	}
+
+	return status;
+}
+
+/**
+ * Runs a query sent to the daemon and writes its image URLs.
+ *
+ * @param options - the options of the query.
+ * @param out - where to write the image URLs, one per line.
+ * @param arg - not used.
+ * @return 0 on success, -1 otherwise.
+ */
+int
+wb_serve_query(struct options *options, FILE *out, void *arg) {
+	struct wb_str_list *image_urls;
+	struct wb_str_list *image_url;
+
+	/* Nobody sees the progress of a daemon */
+	options->flags &= ~WB_FLAG_PROGRESS;
+
+	image_urls = wb_run_session_query(options, 0);
+	wb_dump_metrics();
+	if (image_urls == NULL) {
+		return -1;
+	}
+
+	image_url = image_urls;
+	while (image_url != NULL) {
+		fprintf(out, "%s\n", image_url->str);
+		image_url = image_url->next;
+	}
+
+	wb_list_free(image_urls);
+	return 0;
+}
+
+/**
+ * Get the full image url from a wallbase.cc image page url.
+ *
+ * @param url - wallbase.cc image page url.
+ * @param cookies - cookie list needed for NSFW images.
+ * @return the URL of the image on success, NULL otherwise.
+ *   IMPORTANT: the resulting string must be freed eith free().
+ */
+char *
+wb_get_image_url(const char *url, struct wb_str_list *cookies) {
+	char *img_url = NULL;
+	char *html, *xml_data;
+
+	/* Get HTML */
+	html = net_get_response(url, NULL, &cookies, 0);
+	if (html == NULL) {
+		return NULL;
+	}
+
+	/* Convert it to XML */
+	xml_data = convert_html_to_xml(html);
+	free(html);
+	if (xml_data == NULL) {
+		return NULL;
+	}
+
+	/* Get the script node (that contains the encoded url) data */
+	img_url = wb_eval_single_result(xml_data, XPATH_IMAGE_URL);
+	free(xml_data);
 
 	return img_url;
 }
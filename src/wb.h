@@ -20,11 +20,24 @@
 #ifndef INCLUDED_WB_H
 #define INCLUDED_WB_H
 
+#include <stdio.h>
+
 #include "types.h"
+#include "query.h"
+#include "batch.h"
+#include "seen.h"
+#include "index.h"
+#include "checkpoint.h"
 
 struct options *
 wb_get_default_options();
 
+void
+wb_print_stats();
+
+void
+wb_dump_metrics();
+
 struct wb_str_list *
 wb_login(const char *username, const char *password);
 
@@ -35,7 +48,52 @@ struct wb_str_list *
 wb_get_image_page_urls(const char *url, const char *post_data, struct wb_str_list *cookies);
 
 struct wb_str_list *
-wb_get_image_urls(const char *url, const char *post_data, struct wb_str_list *cookies, struct options *options);
+wb_get_image_urls(struct wb_query *query, struct wb_str_list *cookies, struct options *options, struct wb_checkpoint *checkpoint);
+
+struct wb_str_list *
+wb_get_image_urls_in_time(struct wb_query *query, struct wb_str_list *cookies, struct options *options, struct wb_checkpoint *checkpoint);
+
+struct wb_str_list *
+wb_run_query(struct options *options, struct wb_str_list *cookies, int line);
+
+int
+wb_stream_image_urls(struct wb_query *query, struct wb_str_list *cookies, struct options *options, FILE *out);
+
+int
+wb_stream_query(struct options *options, struct wb_str_list *cookies, FILE *out);
+
+int
+wb_run_batch(struct wb_batch *batch);
+
+void
+wb_free_sessions();
+
+int
+wb_serve_query(struct options *options, FILE *out, void *arg);
+
+struct wb_str_list *
+wb_get_image_urls_from_pages(struct wb_str_list *img_page_urls, int max, struct wb_str_list *cookies, struct options *options, struct wb_seen *emitted, struct wb_checkpoint *checkpoint, const long *positions);
+
+struct wb_checkpoint *
+wb_open_checkpoint(struct wb_query *query, struct options *options);
+
+const char *
+wb_image_page_id(const char *url);
+
+void
+wb_plan_query(struct options *options, int line, struct wb_plan *plan);
+
+int
+wb_watch(struct options *options, struct wb_str_list *cookies);
+
+void
+wb_cancel(int signal_number);
+
+unsigned char
+wb_image_board(const char *image_url);
+
+char *
+wb_parse_image_meta(const char *xml_data, struct wb_index_entry *entry);
 
 char *
 wb_get_image_url(const char *url, struct wb_str_list *cookies);
@@ -17,16 +17,96 @@
  * along with wb.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <tidy.h>
 #include <buffio.h>
 
+#include "mem.h"
 #include "net.h"
+#include "stats.h"
+#include "trace.h"
 #include "types.h"
 #include "xml.h"
 
+/* A growable string that tidy serializes into */
+struct xml_output {
+	char *data;
+	size_t size;
+	size_t capacity;
+	int failed;
+};
+
+/**
+ * tidy malloc hook, accounts tidy's memory.
+ */
+void *
+xml_mem_malloc(size_t size) {
+	return wb_mem_malloc(WB_MEM_TIDY, size);
+}
+
+/**
+ * tidy realloc hook.
+ */
+void *
+xml_mem_realloc(void *ptr, size_t size) {
+	return wb_mem_realloc(WB_MEM_TIDY, ptr, size);
+}
+
+/**
+ * tidy free hook.
+ */
+void
+xml_mem_free(void *ptr) {
+	wb_mem_free(WB_MEM_TIDY, ptr);
+}
+
+/**
+ * Routes tidy's allocations through hooks that account them. Must
+ * be called before the first document is converted.
+ */
+void
+xml_count_memory() {
+	tidySetMallocCall(xml_mem_malloc);
+	tidySetReallocCall(xml_mem_realloc);
+	tidySetFreeCall(xml_mem_free);
+}
+
+/**
+ * A tidy output sink callback that appends one byte to an
+ * xml_output structure.
+ *
+ * @param sink_data - the xml_output structure.
+ * @param bt - the byte to append.
+ */
+void
+xml_output_put_byte(void *sink_data, byte bt) {
+	struct xml_output *output = (struct xml_output *) sink_data;
+	char *tmp;
+
+	if (output->failed) {
+		return;
+	}
+
+	/* Keep one byte free for the terminating '\0' */
+	if (output->size + 1 >= output->capacity) {
+		tmp = (char *) realloc(output->data, output->capacity * 2);
+		if (tmp == NULL) {
+			output->failed = 1;
+			return;
+		}
+
+		output->data = tmp;
+		output->capacity *= 2;
+	}
+
+	output->data[output->size++] = (char) bt;
+}
+
 /**
- * Converts HTML to XML using libTidy.
+ * Converts HTML to XML using libTidy. The XML is serialized in a
+ * single pass into a buffer sized from the HTML, which the XML
+ * output rarely outgrows.
  *
  * @param html - the HTML you want to convert to XML.
  * @return a string containing the converted XML on success,
@@ -36,9 +116,23 @@
 char *
 convert_html_to_xml(const char *html) {
 	TidyDoc document;
+	TidyOutputSink sink;
+	struct xml_output output;
+	double start = 0, end;
 	int res;
-	unsigned int xml_buffer_size;
-	char *xml;
+
+	if (wb_stats_enabled || wb_trace_enabled) {
+		start = wb_stats_now();
+	}
+
+	/* Set up the output buffer */
+	output.size = 0;
+	output.capacity = strlen(html) + 256;
+	output.failed = 0;
+	output.data = (char *) malloc(output.capacity);
+	if (output.data == NULL) {
+		return NULL;
+	}
 
 	/* Set up the tidy parser */
 	document = tidyCreate();
@@ -57,27 +151,28 @@ convert_html_to_xml(const char *html) {
 	}
 
 	if (res >= 0) {
-		xml_buffer_size = 0;
-		xml = (char *) malloc(1);
+		tidyInitSink(&sink, &output, xml_output_put_byte);
+		res = tidySaveSink(document, &sink);
+	}
 
-		while ((res = tidySaveString(document, xml, &xml_buffer_size)) == -ENOMEM) {
-			xml = realloc(xml, xml_buffer_size + 1);
-		}
+	/* Clean up */
+	tidyRelease(document);
 
-		xml[xml_buffer_size] = '\0';
+	if (wb_stats_enabled || wb_trace_enabled) {
+		end = wb_stats_now();
+		wb_stats_record(WB_STATS_TIDY, end - start);
+		wb_trace_span("tidy", "parse", start, end, NULL);
 	}
 
 	/* Check for errors */
-	if (res < 0) {
-		tidyRelease(document);
-		free(xml);
+	if (res < 0 || output.failed) {
+		free(output.data);
 		return NULL;
 	}
 
-	/* Clean up */
-	tidyRelease(document);
+	output.data[output.size] = '\0';
 
-	return xml;
+	return output.data;
 }
 
 /**
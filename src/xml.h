@@ -22,6 +22,7 @@
 
 #include "types.h"
 
+void xml_count_memory();
 char *convert_html_to_xml(const char *html);
 char *net_get_response_as_xml(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies);
 
@@ -17,27 +17,367 @@
  * along with wb.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <pthread.h>
 #include <libxml/tree.h>
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
+#include "arena.h"
+#include "mem.h"
+#include "stats.h"
+#include "trace.h"
 #include "xpath.h"
 
+/* Size of the chunks a thread's libxml2 arena grows by */
+#define XPATH_ARENA_CHUNK_SIZE (256 * 1024)
+
+/* Header in front of every libxml2 block while arena mode is on */
+struct xpath_block_header {
+	size_t size;
+	size_t in_arena;
+};
+
+/* A thread's libxml2 arena and whether allocations go to it */
+struct xpath_thread_arena {
+	struct wb_arena *arena;
+	int active;
+};
+
+/* Per-thread XML parser context, reset between documents */
+static pthread_key_t parser_context_key;
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_keys_once = PTHREAD_ONCE_INIT;
+
+/* 1 if libxml2 allocations go through the arena hooks */
+static int arena_mode = 0;
+
+/* Compiled XPath expressions, shared by all threads */
+#define XPATH_CACHE_SIZE 16
+
+struct xpath_cached_expr {
+	char *expression;
+	xmlXPathCompExprPtr comp;
+};
+
+static struct xpath_cached_expr xpath_cache[XPATH_CACHE_SIZE];
+static int xpath_cache_count = 0; /* published last, see xpath_get_compiled() */
+static pthread_mutex_t xpath_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Frees a thread's parser context when the thread exits.
+ *
+ * @param ctxt - the parser context
+ */
+void
+xpath_free_parser_context(void *ctxt) {
+	xmlFreeParserCtxt((xmlParserCtxtPtr) ctxt);
+}
+
+/**
+ * Frees a thread's libxml2 arena when the thread exits.
+ *
+ * @param thread_arena - the xpath_thread_arena structure
+ */
+void
+xpath_free_thread_arena(void *thread_arena) {
+	wb_arena_free(((struct xpath_thread_arena *) thread_arena)->arena);
+	free(thread_arena);
+}
+
+/**
+ * Creates the thread-specific keys for parser contexts and arenas.
+ */
+void
+xpath_create_thread_keys() {
+	pthread_key_create(&parser_context_key, xpath_free_parser_context);
+	pthread_key_create(&thread_arena_key, xpath_free_thread_arena);
+}
+
+/**
+ * libxml2 malloc hook. Allocates from the calling thread's arena
+ * while it is active, from the heap otherwise.
+ *
+ * @param size - the size of the block
+ * @return a pointer to the block on success, NULL otherwise.
+ */
+void *
+xpath_arena_malloc(size_t size) {
+	struct xpath_thread_arena *thread_arena;
+	struct xpath_block_header *header;
+
+	wb_stats_count(WB_STATS_XML_ALLOCATIONS, 1);
+
+	thread_arena = (struct xpath_thread_arena *) pthread_getspecific(thread_arena_key);
+	if (thread_arena != NULL && thread_arena->active) {
+		header = (struct xpath_block_header *) wb_arena_alloc(thread_arena->arena,
+			sizeof(struct xpath_block_header) + size);
+		if (header == NULL) {
+			return NULL;
+		}
+		header->in_arena = 1;
+	} else {
+		header = (struct xpath_block_header *) wb_mem_malloc(WB_MEM_XML,
+			sizeof(struct xpath_block_header) + size);
+		if (header == NULL) {
+			return NULL;
+		}
+		header->in_arena = 0;
+	}
+
+	header->size = size;
+	return header + 1;
+}
+
+/**
+ * libxml2 free hook. Arena blocks are released with the arena,
+ * so only heap blocks are freed here.
+ *
+ * @param ptr - the block to free
+ */
+void
+xpath_arena_free(void *ptr) {
+	struct xpath_block_header *header;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	header = (struct xpath_block_header *) ptr - 1;
+	if (!header->in_arena) {
+		wb_mem_free(WB_MEM_XML, header);
+	}
+}
+
+/**
+ * libxml2 realloc hook. Heap blocks stay on the heap, arena blocks
+ * are copied to a new block.
+ *
+ * @param ptr - the block to resize
+ * @param size - the new size
+ * @return a pointer to the resized block on success, NULL otherwise.
+ */
+void *
+xpath_arena_realloc(void *ptr, size_t size) {
+	struct xpath_block_header *header;
+	void *new_ptr;
+
+	if (ptr == NULL) {
+		return xpath_arena_malloc(size);
+	}
+
+	header = (struct xpath_block_header *) ptr - 1;
+	if (!header->in_arena) {
+		wb_stats_count(WB_STATS_XML_ALLOCATIONS, 1);
+		header = (struct xpath_block_header *) wb_mem_realloc(WB_MEM_XML, header,
+			sizeof(struct xpath_block_header) + size);
+		if (header == NULL) {
+			return NULL;
+		}
+		header->size = size;
+		return header + 1;
+	}
+
+	new_ptr = xpath_arena_malloc(size);
+	if (new_ptr == NULL) {
+		return NULL;
+	}
+
+	memcpy(new_ptr, ptr, (header->size < size) ? header->size : size);
+	return new_ptr;
+}
+
+/**
+ * libxml2 strdup hook.
+ *
+ * @param str - the string to copy
+ * @return a copy of the string on success, NULL otherwise.
+ */
+char *
+xpath_arena_strdup(const char *str) {
+	size_t length;
+	char *copy;
+
+	length = strlen(str) + 1;
+	copy = (char *) xpath_arena_malloc(length);
+	if (copy != NULL) {
+		memcpy(copy, str, length);
+	}
+
+	return copy;
+}
+
+/**
+ * Routes libxml2 allocations made while parsing and evaluating a
+ * document to a per-thread arena, which is released in one shot
+ * when the document is done. Must be called before xpath_init().
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int
+xpath_enable_arena() {
+	/* The hooks look up the thread's arena from the first allocation on */
+	pthread_once(&thread_keys_once, xpath_create_thread_keys);
+
+	if (xmlMemSetup(xpath_arena_free, xpath_arena_malloc,
+		xpath_arena_realloc, xpath_arena_strdup) != 0) {
+		return -1;
+	}
+
+	arena_mode = 1;
+	return 0;
+}
+
+/**
+ * Routes libxml2 allocations through the arena hooks without using
+ * an arena, so that they are counted in the stats and their memory
+ * is accounted. Must be called before xpath_init().
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int
+xpath_count_allocations() {
+	pthread_once(&thread_keys_once, xpath_create_thread_keys);
+
+	if (xmlMemSetup(xpath_arena_free, xpath_arena_malloc,
+		xpath_arena_realloc, xpath_arena_strdup) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Starts sending the calling thread's libxml2 allocations to its
+ * arena, creating the arena on first use.
+ *
+ * @return the thread's arena on success, NULL otherwise.
+ */
+struct xpath_thread_arena *
+xpath_begin_arena() {
+	struct xpath_thread_arena *thread_arena;
+
+	thread_arena = (struct xpath_thread_arena *) pthread_getspecific(thread_arena_key);
+	if (thread_arena == NULL) {
+		thread_arena = (struct xpath_thread_arena *) malloc(sizeof(struct xpath_thread_arena));
+		if (thread_arena == NULL) {
+			return NULL;
+		}
+
+		thread_arena->arena = wb_arena_new(XPATH_ARENA_CHUNK_SIZE);
+		if (thread_arena->arena == NULL) {
+			free(thread_arena);
+			return NULL;
+		}
+
+		pthread_setspecific(thread_arena_key, thread_arena);
+	}
+
+	thread_arena->active = 1;
+	return thread_arena;
+}
+
+/**
+ * Stops using the thread's arena and releases everything that was
+ * allocated from it.
+ *
+ * @param thread_arena - the arena returned by xpath_begin_arena()
+ */
+void
+xpath_end_arena(struct xpath_thread_arena *thread_arena) {
+	/* The last error may hold strings from the arena */
+	xmlResetLastError();
+
+	thread_arena->active = 0;
+	wb_arena_reset(thread_arena->arena);
+}
+
 /**
  * Initializes the XPath system
  */
 void xpath_init() {
 	xmlInitParser();
+	pthread_once(&thread_keys_once, xpath_create_thread_keys);
 }
 
 /**
- * Cleans up the XPath system
+ * Cleans up the XPath system. Parser contexts of other threads are
+ * freed when those threads exit, so they must be joined before this
+ * is called.
  */
 void xpath_cleanup() {
+	xmlParserCtxtPtr ctxt;
+	struct xpath_thread_arena *thread_arena;
+	int i;
+
+	for (i = 0; i < xpath_cache_count; i++) {
+		xmlXPathFreeCompExpr(xpath_cache[i].comp);
+		free(xpath_cache[i].expression);
+	}
+	xpath_cache_count = 0;
+
+	ctxt = (xmlParserCtxtPtr) pthread_getspecific(parser_context_key);
+	if (ctxt != NULL) {
+		xmlFreeParserCtxt(ctxt);
+		pthread_setspecific(parser_context_key, NULL);
+	}
+
+	thread_arena = (struct xpath_thread_arena *) pthread_getspecific(thread_arena_key);
+	if (thread_arena != NULL) {
+		xpath_free_thread_arena(thread_arena);
+		pthread_setspecific(thread_arena_key, NULL);
+	}
+
 	xmlCleanupParser();
 }
 
+/**
+ * Get the calling thread's XML parser context, creating it on
+ * first use. The context is reused for every document the thread
+ * parses instead of being rebuilt for each page.
+ *
+ * @return the parser context on success, NULL otherwise.
+ */
+xmlParserCtxtPtr
+xpath_get_parser_context() {
+	xmlParserCtxtPtr ctxt;
+
+	pthread_once(&thread_keys_once, xpath_create_thread_keys);
+
+	ctxt = (xmlParserCtxtPtr) pthread_getspecific(parser_context_key);
+	if (ctxt == NULL) {
+		ctxt = xmlNewParserCtxt();
+		if (ctxt != NULL) {
+			pthread_setspecific(parser_context_key, ctxt);
+		}
+	}
+
+	return ctxt;
+}
+
+/**
+ * Parses an XML document with the calling thread's parser context.
+ * xmlCtxtReadMemory() resets the context before parsing, keeping
+ * its buffers and name dictionary.
+ *
+ * @param xml_data - the XML data as a string.
+ * @return the parsed document on success, NULL otherwise.
+ *   IMPORTANT: the returned document must be freed with
+ *   xmlFreeDoc().
+ */
+xmlDocPtr
+xpath_parse_doc(const char *xml_data) {
+	xmlParserCtxtPtr ctxt;
+
+	ctxt = xpath_get_parser_context();
+	if (ctxt == NULL) {
+		return xmlParseDoc(BAD_CAST xml_data);
+	}
+
+	return xmlCtxtReadMemory(ctxt, xml_data, strlen(xml_data), NULL, NULL, 0);
+}
+
 /**
  * Registers the specified namespaces with an XML XPath context.
  *
@@ -76,6 +416,85 @@ libxml_xpath_register_namespaces(xmlXPathContextPtr xpath_context,
 	return 0;
 }
 
+/**
+ * Finds an expression in the first entries of the cache.
+ *
+ * @param expression - the expression
+ * @param count - the number of entries to search
+ * @return the compiled expression, or NULL if it is not there.
+ */
+xmlXPathCompExprPtr
+xpath_find_compiled(const xmlChar *expression, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (strcmp(xpath_cache[i].expression, (const char *) expression) == 0) {
+			return xpath_cache[i].comp;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Get a compiled XPath expression from the cache, compiling it on
+ * first use. Compiled expressions are only read while evaluating,
+ * so all threads share them. Entries are never changed once the
+ * count that covers them is published, so lookups take no lock;
+ * only a miss locks the cache to add an entry.
+ *
+ * @param expression - the expression
+ * @return the compiled expression, or NULL if it could not be
+ *   compiled or the cache is full. IMPORTANT: it must not be freed.
+ */
+xmlXPathCompExprPtr
+xpath_get_compiled(const xmlChar *expression) {
+	struct xpath_thread_arena *thread_arena;
+	xmlXPathCompExprPtr comp;
+	int arena_active;
+
+	comp = xpath_find_compiled(expression,
+		__atomic_load_n(&xpath_cache_count, __ATOMIC_ACQUIRE));
+	wb_stats_count((comp != NULL) ? WB_STATS_XPATH_CACHE_HITS : WB_STATS_XPATH_CACHE_MISSES, 1);
+	if (comp != NULL) {
+		return comp;
+	}
+
+	pthread_mutex_lock(&xpath_cache_lock);
+
+	/* Another thread may have added it since */
+	comp = xpath_find_compiled(expression, xpath_cache_count);
+
+	if (comp == NULL && xpath_cache_count < XPATH_CACHE_SIZE) {
+		/* Cached expressions outlive the document's arena */
+		thread_arena = (struct xpath_thread_arena *) pthread_getspecific(thread_arena_key);
+		arena_active = thread_arena != NULL && thread_arena->active;
+		if (arena_active) {
+			thread_arena->active = 0;
+		}
+
+		comp = xmlXPathCompile(expression);
+		if (comp != NULL) {
+			xpath_cache[xpath_cache_count].expression = strdup((const char *) expression);
+			if (xpath_cache[xpath_cache_count].expression != NULL) {
+				xpath_cache[xpath_cache_count].comp = comp;
+				__atomic_store_n(&xpath_cache_count, xpath_cache_count + 1, __ATOMIC_RELEASE);
+			} else {
+				xmlXPathFreeCompExpr(comp);
+				comp = NULL;
+			}
+		}
+
+		if (arena_active) {
+			thread_arena->active = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&xpath_cache_lock);
+
+	return comp;
+}
+
 /**
  * Evaluates an XPath expression on the given XML file.
  *
@@ -93,6 +512,12 @@ libxml_xpath_eval_expr(xmlDocPtr xml_doc, const xmlChar *expression,
 
 	xmlXPathContextPtr xpath_context;
 	xmlXPathObjectPtr xpath_object;
+	xmlXPathCompExprPtr comp;
+	double start = 0, end;
+
+	if (wb_stats_enabled || wb_trace_enabled) {
+		start = wb_stats_now();
+	}
 
 	/* Create XPath context */
 	xpath_context = xmlXPathNewContext(xml_doc);
@@ -106,8 +531,18 @@ libxml_xpath_eval_expr(xmlDocPtr xml_doc, const xmlChar *expression,
 		return NULL;
 	}
 
-	/* Evaluate XPath expression */
-	xpath_object = xmlXPathEvalExpression(expression, xpath_context);
+	/* Evaluate XPath expression, compiled once if possible */
+	comp = xpath_get_compiled(expression);
+	if (comp != NULL) {
+		xpath_object = xmlXPathCompiledEval(comp, xpath_context);
+	} else {
+		xpath_object = xmlXPathEvalExpression(expression, xpath_context);
+	}
+	if (wb_stats_enabled || wb_trace_enabled) {
+		end = wb_stats_now();
+		wb_stats_record(WB_STATS_XPATH, end - start);
+		wb_trace_span("xpath eval", "parse", start, end, NULL);
+	}
 	if (xpath_object == NULL) {
 		xmlXPathFreeContext(xpath_context);
 		return NULL;
@@ -120,37 +555,209 @@ libxml_xpath_eval_expr(xmlDocPtr xml_doc, const xmlChar *expression,
 }
 
 /**
- * Converts a XML XPath object to a list of strings. Assumes
- * that every node in the object is a text node.
+ * Fills in a string view for every node in an XPath object. Nodes
+ * whose value is a single text node are viewed in place, other
+ * values are assembled with xmlNodeListGetString() and owned by the
+ * result.
  *
  * @param xpath_object - the object to be converted
  * @param xml_doc - the parent XML document
- * @return a wb_str_list containing the converted object on success,
- *   NULL otherwise. IMPORTANT: the returned list must be frees with
- *   wb_list_free().
+ * @param result - the result to fill in
+ * @return 0 on success, -1 otherwise.
  */
-struct wb_str_list *
-xpath_object_to_str_list(xmlXPathObjectPtr xpath_object, xmlDocPtr xml_doc) {
-	struct wb_str_list *obj_list = NULL;
+int
+xpath_object_to_views(xmlXPathObjectPtr xpath_object, xmlDocPtr xml_doc,
+	struct wb_xpath_result *result) {
 
 	xmlNodeSetPtr object_nodes;
-	xmlNodePtr current_node;
+	xmlNodePtr current_node, value_node;
 	xmlChar *current_str;
 	int i, object_node_count;
 
 	object_nodes = xpath_object->nodesetval;
 	object_node_count = (object_nodes) ? object_nodes->nodeNr : 0;
 
+	result->views = (struct wb_str_view *) malloc(
+		(object_node_count + 1) * sizeof(struct wb_str_view));
+	if (result->views == NULL) {
+		return -1;
+	}
+
 	for (i = 0; i < object_node_count; i++) {
 		current_node = object_nodes->nodeTab[i];
-		current_str = xmlNodeListGetString(xml_doc, current_node->xmlChildrenNode, 1);
-		if (current_str != NULL) {
-			obj_list = wb_list_append(obj_list, (char *)current_str);
-			xmlFree(current_str);
+		value_node = current_node->xmlChildrenNode;
+
+		if (value_node != NULL && value_node->next == NULL
+			&& value_node->type == XML_TEXT_NODE && value_node->content != NULL) {
+
+			current_str = value_node->content;
+		} else {
+			current_str = xmlNodeListGetString(xml_doc, value_node, 1);
+			if (current_str == NULL) {
+				continue;
+			}
+
+			if (result->owned == NULL) {
+				result->owned = (void **) calloc(object_node_count, sizeof(void *));
+				if (result->owned == NULL) {
+					xmlFree(current_str);
+					return -1;
+				}
+			}
+
+			result->owned[result->count] = current_str;
+		}
+
+		result->views[result->count].str = (const char *) current_str;
+		result->views[result->count].length = strlen((const char *) current_str);
+		result->count++;
+	}
+
+	return 0;
+}
+
+/**
+ * Frees the views of an XPath result, keeping its document.
+ *
+ * @param result - the result whose views are freed
+ */
+void
+xpath_result_clear_views(struct wb_xpath_result *result) {
+	size_t i;
+
+	if (result->owned != NULL) {
+		for (i = 0; i < result->count; i++) {
+			xmlFree(result->owned[i]);
 		}
+		free(result->owned);
+	}
+
+	free(result->views);
+
+	result->owned = NULL;
+	result->views = NULL;
+	result->count = 0;
+}
+
+/**
+ * Frees an XPath result and the document its views point into.
+ *
+ * @param result - the result to free
+ */
+void
+xpath_result_free(struct wb_xpath_result *result) {
+	if (result == NULL) {
+		return;
 	}
 
-	return obj_list;
+	xpath_result_clear_views(result);
+
+	if (result->thread_arena != NULL) {
+		xpath_end_arena((struct xpath_thread_arena *) result->thread_arena);
+	} else if (result->xml_doc != NULL) {
+		xmlFreeDoc((xmlDocPtr) result->xml_doc);
+	}
+
+	free(result);
+}
+
+/**
+ * Parses an XML document into a new, empty XPath result. In arena
+ * mode the document is parsed without a shared dictionary, so it
+ * owns nothing outside the arena and never has to be freed node by
+ * node.
+ *
+ * @param xml_data - the XML data as a string.
+ * @return the result on success, NULL otherwise. IMPORTANT: the
+ *   returned result must be freed with xpath_result_free().
+ */
+struct wb_xpath_result *
+xpath_result_new(const char *xml_data) {
+	struct wb_xpath_result *result;
+	struct xpath_thread_arena *thread_arena = NULL;
+	xmlDocPtr xml_doc;
+	double start = 0, end;
+
+	result = (struct wb_xpath_result *) calloc(1, sizeof(struct wb_xpath_result));
+	if (result == NULL) {
+		return NULL;
+	}
+
+	if (arena_mode) {
+		thread_arena = xpath_begin_arena();
+	}
+
+	if (wb_stats_enabled || wb_trace_enabled) {
+		start = wb_stats_now();
+	}
+	if (thread_arena != NULL) {
+		xml_doc = xmlReadMemory(xml_data, strlen(xml_data), NULL, NULL, XML_PARSE_NODICT);
+	} else {
+		xml_doc = xpath_parse_doc(xml_data);
+	}
+	if (wb_stats_enabled || wb_trace_enabled) {
+		end = wb_stats_now();
+		wb_stats_record(WB_STATS_XML_PARSE, end - start);
+		wb_trace_span("xml parse", "parse", start, end, NULL);
+	}
+
+	result->xml_doc = xml_doc;
+	result->thread_arena = thread_arena;
+
+	if (xml_doc == NULL) {
+		xpath_result_free(result);
+		return NULL;
+	}
+
+	return result;
+}
+
+/**
+ * Evaluates an XPath expression on the given XML file and returns
+ * (pointer, length) views of the result values. The views point into
+ * the parsed document and stay valid until the result is freed, so
+ * values are only copied when the caller decides to keep them.
+ * In arena mode the result must be freed before the calling thread
+ * evaluates another expression.
+ *
+ * @param xml_data - the XML data as a string.
+ * @param expression - the expressions to evaluate.
+ * @param namespaces - a list of namespaces, containing two elements
+ *   for every namespace: a prefix, and a href (in that order).
+ * @return the results on success, NULL otherwise. IMPORTANT: the
+ *   returned result must be freed with xpath_result_free().
+ */
+struct wb_xpath_result *
+xpath_eval_views(const char *xml_data, const char *expression,
+	struct wb_str_list *namespaces) {
+
+	struct wb_xpath_result *result;
+	xmlXPathObjectPtr results_xpath_object;
+	int res;
+
+	result = xpath_result_new(xml_data);
+	if (result == NULL) {
+		return NULL;
+	}
+
+	/* Evaluate the XPath expression */
+	results_xpath_object = libxml_xpath_eval_expr((xmlDocPtr) result->xml_doc,
+		BAD_CAST expression, namespaces);
+	if (results_xpath_object == NULL) {
+		xpath_result_free(result);
+		return NULL;
+	}
+
+	/* The views point into the document, not into the XPath object */
+	res = xpath_object_to_views(results_xpath_object, (xmlDocPtr) result->xml_doc, result);
+	xmlXPathFreeObject(results_xpath_object);
+
+	if (res != 0) {
+		xpath_result_free(result);
+		return NULL;
+	}
+
+	return result;
 }
 
 /**
@@ -169,29 +776,79 @@ xpath_eval_expr(const char *xml_data, const char *expression,
 	struct wb_str_list *namespaces) {
 
 	struct wb_str_list *results = NULL;
-	xmlDocPtr xml_doc;
-	xmlXPathObjectPtr results_xpath_object;
+	struct wb_xpath_result *result;
+	size_t i;
 
-	/* Create an XML document from XML data */
-	xml_doc = xmlParseDoc(BAD_CAST xml_data);
-	if (xml_doc == NULL) {
+	result = xpath_eval_views(xml_data, expression, namespaces);
+	if (result == NULL) {
 		return NULL;
 	}
 
-	/* Evaluate the XPath expression */
-	results_xpath_object = libxml_xpath_eval_expr(xml_doc,
-		BAD_CAST expression, namespaces);
-	if (results_xpath_object == NULL) {
-		xmlFreeDoc(xml_doc);
-		return NULL;
+	for (i = 0; i < result->count; i++) {
+		results = wb_list_append_n(results, result->views[i].str,
+			result->views[i].length);
 	}
 
-	/* Get the result list from the XML object */
-	results = xpath_object_to_str_list(results_xpath_object, xml_doc);
-
-	/* Cleanup */
-	xmlXPathFreeObject(results_xpath_object);
-	xmlFreeDoc(xml_doc);
+	xpath_result_free(result);
 
 	return results;
 }
+
+/**
+ * Evaluates several XPath expressions on the given XML file,
+ * parsing it only once.
+ *
+ * @param xml_data - the XML data as a string.
+ * @param expressions - the expressions to evaluate.
+ * @param count - the number of expressions.
+ * @param namespaces - a list of namespaces, containing two elements
+ *   for every namespace: a prefix, and a href (in that order).
+ * @param results - where to store a wb_str_list of the results of
+ *   every expression, NULL if it has none.
+ * @return 0 on success, -1 otherwise. IMPORTANT: the lists in
+ *   results must be freed with wb_list_free(), also on error.
+ */
+int
+xpath_eval_fields(const char *xml_data, const char **expressions, size_t count,
+	struct wb_str_list *namespaces, struct wb_str_list **results) {
+
+	struct wb_xpath_result *result;
+	xmlXPathObjectPtr xpath_object;
+	size_t i, j;
+	int res;
+
+	for (i = 0; i < count; i++) {
+		results[i] = NULL;
+	}
+
+	result = xpath_result_new(xml_data);
+	if (result == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		xpath_object = libxml_xpath_eval_expr((xmlDocPtr) result->xml_doc,
+			BAD_CAST expressions[i], namespaces);
+		if (xpath_object == NULL) {
+			xpath_result_free(result);
+			return -1;
+		}
+
+		res = xpath_object_to_views(xpath_object, (xmlDocPtr) result->xml_doc, result);
+		xmlXPathFreeObject(xpath_object);
+		if (res != 0) {
+			xpath_result_free(result);
+			return -1;
+		}
+
+		for (j = 0; j < result->count; j++) {
+			results[i] = wb_list_append_n(results[i], result->views[j].str,
+				result->views[j].length);
+		}
+		xpath_result_clear_views(result);
+	}
+
+	xpath_result_free(result);
+
+	return 0;
+}
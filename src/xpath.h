@@ -20,10 +20,28 @@
 #ifndef INCLUDED_WB_XPATH_H
 #define INCLUDED_WB_XPATH_H
 
+#include <stddef.h>
+
 #include "types.h"
 
+struct wb_xpath_result {
+	size_t count;
+	struct wb_str_view *views;
+
+	/* Private: what the views point into */
+	void *xml_doc;
+	void *thread_arena;
+	void **owned;
+};
+
+int xpath_enable_arena();
+int xpath_count_allocations();
 void xpath_init();
 void xpath_cleanup();
 struct wb_str_list *xpath_eval_expr(const char *xml_data, const char *expression, struct wb_str_list *namespaces);
+struct wb_xpath_result *xpath_eval_views(const char *xml_data, const char *expression, struct wb_str_list *namespaces);
+void xpath_result_free(struct wb_xpath_result *result);
+int xpath_eval_fields(const char *xml_data, const char **expressions, size_t count,
+	struct wb_str_list *namespaces, struct wb_str_list **results);
 
 #endif
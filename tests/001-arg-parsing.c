@@ -48,6 +48,20 @@ void resetOptions() {
 	options.password = "";
 	options.images = 20;
 	options.images_per_page = 20;
+	options.jobs = 0;
+	options.batch_file = NULL;
+	options.serve_socket = NULL;
+	options.watch_interval = 0;
+	options.index_file = NULL;
+	options.checkpoint_file = NULL;
+	options.shard_index = 0;
+	options.shard_count = 0;
+	options.trace_file = NULL;
+	options.metrics_file = NULL;
+	options.base_url = NULL;
+	options.stream = 0;
+	options.deadline_ms = 0;
+	options.fast_scan = 0;
 
 	options.query = NULL;
 	options.color = -1;
@@ -136,6 +150,195 @@ void test_parseOpt_color_invalid() {
 	TEST_ASSERT_EQUAL_INT(-1, res);
 }
 
+void test_parseOpt_jobs_valid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt('j', "1", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(1, options.jobs);
+
+	resetOptions();
+	res = parse_opt('j', "32", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(32, options.jobs);
+}
+
+void test_parseOpt_jobs_invalid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt('j', "0", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt('j', "-4", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt('j', "many", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+}
+
+void test_parseOpt_watchInterval_valid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "90", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(90, options.watch_interval);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "30s", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(30, options.watch_interval);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "15m", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(900, options.watch_interval);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "2h", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(7200, options.watch_interval);
+}
+
+void test_parseOpt_watchInterval_invalid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "0", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "10d", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_WATCH, "m", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+}
+
+void test_parseOpt_shard_valid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "1/4", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(0, options.shard_index);
+	TEST_ASSERT_EQUAL_INT(4, options.shard_count);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "3/3", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(2, options.shard_index);
+	TEST_ASSERT_EQUAL_INT(3, options.shard_count);
+}
+
+void test_parseOpt_shard_invalid() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "0/4", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "5/4", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "2", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "/4", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_SHARD, "1/4x", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+}
+
+void test_parseOpt_baseUrl_valid() {
+	char with_slash[] = "https://mirror.example.com/";
+	char with_port[] = "http://127.0.0.1:8080";
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, with_port, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("http://127.0.0.1:8080", options.base_url);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, with_slash, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("https://mirror.example.com", options.base_url);
+}
+
+void test_parseOpt_baseUrl_invalid() {
+	char no_scheme[] = "127.0.0.1:8080";
+	char other_scheme[] = "ftp://127.0.0.1";
+	char no_host[] = "http:///";
+	char with_path[] = "http://127.0.0.1/wb";
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, no_scheme, &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, other_scheme, &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, no_host, &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BASE_URL, with_path, &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+	TEST_ASSERT_NULL(options.base_url);
+}
+
+void test_parseOpt_stream() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_STREAM, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(1, options.stream);
+	TEST_ASSERT_EQUAL_INT(0, options.flags);
+}
+
+void test_parseOpt_fastScan() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_FAST_SCAN, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(1, options.fast_scan);
+	TEST_ASSERT_EQUAL_INT(0, options.flags);
+}
+
+void test_parseOpt_deadline() {
+	int res;
+
+	resetOptions();
+	res = parse_opt(WB_KEY_DEADLINE, "1500", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(1500, options.deadline_ms);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_DEADLINE, "0", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_DEADLINE, "1.5s", &options);
+	TEST_ASSERT_EQUAL_INT(-1, res);
+	TEST_ASSERT_EQUAL_INT(0, options.deadline_ms);
+}
+
 void test_parseOpt_imageNum_valid() {
 	int res;
 
@@ -415,6 +618,10 @@ void test_parseOpt_flags() {
 	TEST_ASSERT_EQUAL_INT(0, res);
 	TEST_ASSERT_EQUAL_INT(WB_FLAG_RANDOM, options.flags & WB_FLAG_RANDOM);
 
+	res = parse_opt('v', NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_VERBOSE, options.flags & WB_FLAG_VERBOSE);
+
 	resetOptions();
 	res = parse_opt('S', NULL, &options);
 	TEST_ASSERT_EQUAL_INT(0, res);
@@ -440,6 +647,55 @@ void test_parseOpt_flags() {
 	res = parse_opt('H', NULL, &options);
 	TEST_ASSERT_EQUAL_INT(0, res);
 	TEST_ASSERT_EQUAL_INT(WB_BOARD_HIGHRES, options.boards & WB_BOARD_HIGHRES);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_XML_ARENA, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_XML_ARENA, options.flags & WB_FLAG_XML_ARENA);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_BATCH, "searches.txt", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("searches.txt", options.batch_file);
+
+	res = parse_opt(WB_KEY_SERVE, "/tmp/wb.sock", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("/tmp/wb.sock", options.serve_socket);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_INDEX, "wb.index", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("wb.index", options.index_file);
+
+	res = parse_opt(WB_KEY_OFFLINE, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_OFFLINE, options.flags & WB_FLAG_OFFLINE);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_CHECKPOINT, "run.journal", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("run.journal", options.checkpoint_file);
+
+	res = parse_opt(WB_KEY_RESUME, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_RESUME, options.flags & WB_FLAG_RESUME);
+
+	resetOptions();
+	res = parse_opt(WB_KEY_MERGE, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_MERGE, options.flags & WB_FLAG_MERGE);
+
+	res = parse_opt(WB_KEY_STATS, NULL, &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_STATS, options.flags & WB_FLAG_STATS);
+
+	res = parse_opt(WB_KEY_TRACE, "run.trace", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("run.trace", options.trace_file);
+
+	res = parse_opt(WB_KEY_METRICS, "wb.prom", &options);
+	TEST_ASSERT_EQUAL_INT(0, res);
+	TEST_ASSERT_EQUAL_STRING("wb.prom", options.metrics_file);
 }
 
 /* Main */
@@ -452,6 +708,17 @@ int main(int argc, char *argv[]) {
 	RUN_TEST(test_parseOpt_color_invalid, __LINE__);
 	RUN_TEST(test_parseOpt_collection_valid, __LINE__);
 	RUN_TEST(test_parseOpt_collection_invalid, __LINE__);
+	RUN_TEST(test_parseOpt_jobs_valid, __LINE__);
+	RUN_TEST(test_parseOpt_jobs_invalid, __LINE__);
+	RUN_TEST(test_parseOpt_watchInterval_valid, __LINE__);
+	RUN_TEST(test_parseOpt_watchInterval_invalid, __LINE__);
+	RUN_TEST(test_parseOpt_shard_valid, __LINE__);
+	RUN_TEST(test_parseOpt_shard_invalid, __LINE__);
+	RUN_TEST(test_parseOpt_baseUrl_valid, __LINE__);
+	RUN_TEST(test_parseOpt_baseUrl_invalid, __LINE__);
+	RUN_TEST(test_parseOpt_stream, __LINE__);
+	RUN_TEST(test_parseOpt_deadline, __LINE__);
+	RUN_TEST(test_parseOpt_fastScan, __LINE__);
 	RUN_TEST(test_parseOpt_imageNum_valid, __LINE__);
 	RUN_TEST(test_parseOpt_imageNum_invalid, __LINE__);
 	RUN_TEST(test_parseOpt_password_valid, __LINE__);
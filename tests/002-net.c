@@ -20,10 +20,24 @@
 #include <string.h>
 #include "unity.h"
 #include "types.h"
+#include "mem.c"
+#include "histogram.c"
+#include "stats.c"
+#include "trace.c"
+#include "str_list.c"
 #include "net.c"
+#include "../bench/replay.c"
+
+/* Every test talks to a local server replaying the bench fixtures */
+static struct replay_server *server;
+static char url[256];
 
 /* Unity set up and tear down */
 void setUp() {
+	struct replay_faults none;
+
+	memset(&none, 0, sizeof(none));
+	replay_set_faults(server, &none);
 	net_init();
 }
 
@@ -35,22 +49,51 @@ void tearDown() {
 void wb_error(const char *format, ...) {
 }
 
-void wb_list_free(struct wb_str_list *list) {
+/* Helpers */
+const char *
+server_url(const char *path) {
+	snprintf(url, sizeof(url), "%s%s", replay_base_url(server), path);
+	return url;
+}
+
+void *
+fetch_pages(void *arg) {
+	char *res;
+	int i, *failures = (int *) arg;
+
+	for (i = 0; i < 5; i++) {
+		res = net_get_response(server_url("/wallpaper/1"), NULL, NULL, 0);
+		if (res == NULL) {
+			__sync_fetch_and_add(failures, 1);
+		}
+		free(res);
+	}
+
+	return NULL;
+}
+
+void *
+cancel_later(void *arg) {
+	usleep(100000);
+	net_cancel();
+	return NULL;
 }
 
 /* Tests */
 void test_netGetResponse_validUrl() {
 	char *res;
 
-	res = net_get_response("www.google.com", NULL, NULL, 0);
+	res = net_get_response(server_url("/wallpaper/7"), NULL, NULL, 0);
 	TEST_ASSERT_NOT_NULL(res);
+	TEST_ASSERT_NOT_NULL(strstr(res, "wallpaper-7"));
 	free(res);
 }
 
 void test_netGetResponse_invalidUrl() {
 	char *res;
 
-	res = net_get_response("invalid.test.url", NULL, NULL, 0);
+	/* Nothing listens on port 1 */
+	res = net_get_response("http://127.0.0.1:1/", NULL, NULL, 0);
 	TEST_ASSERT_NULL(res);
 }
 
@@ -58,34 +101,212 @@ void test_netGetResponse_cookies() {
 	char *res;
 	struct wb_str_list *cookies = NULL;
 
-	res = net_get_response("www.google.com", NULL, &cookies, 0);
+	res = net_get_response(server_url("/user/login"), NULL, &cookies, 0);
 	TEST_ASSERT_NULL(cookies);
 	free(res);
 
-	res = net_get_response("www.google.com", NULL, &cookies, 1);
+	/* The login redirects, its cookie is kept without following it */
+	res = net_get_response(server_url("/user/do_login"), "username=a", &cookies, 1);
+	TEST_ASSERT_NOT_NULL(res);
+	TEST_ASSERT_EQUAL_STRING("", res);
 	TEST_ASSERT_NOT_NULL(cookies);
 	free(res);
+
+	res = net_get_response(server_url("/echo"), NULL, &cookies, 0);
+	TEST_ASSERT_NOT_NULL(res);
+	TEST_ASSERT_NOT_NULL(strstr(res, "wb_session=replay"));
+	free(res);
+	wb_list_free(cookies);
 }
 
 void test_netGetResponse_post() {
 	char *res_nopost, *res_post;
 
-	res_nopost = net_get_response("https://duckduckgo.com", NULL, NULL, 0);
-	res_post = net_get_response("https://duckduckgo.com", "q=test", NULL, 0);
+	res_nopost = net_get_response(server_url("/echo"), NULL, NULL, 0);
+	res_post = net_get_response(server_url("/echo"), "q=test", NULL, 0);
 	TEST_ASSERT_NOT_NULL(res_nopost);
 	TEST_ASSERT_NOT_NULL(res_post);
-	TEST_ASSERT_TRUE(strcmp(res_nopost, res_post) != 0);
+	TEST_ASSERT_TRUE(strncmp(res_nopost, "GET /echo", 9) == 0);
+	TEST_ASSERT_TRUE(strncmp(res_post, "POST /echo", 10) == 0);
 	free(res_nopost);
 	free(res_post);
 }
 
+void test_netGetResponse_gzip() {
+	char *res;
+
+	wb_stats_enable();
+	res = net_get_response(server_url("/wallpaper/5"), NULL, NULL, 0);
+	TEST_ASSERT_NOT_NULL(res);
+	TEST_ASSERT_NOT_NULL(strstr(res, "wallpaper-5"));
+
+	/* Less came over the wire than the page has */
+	TEST_ASSERT_TRUE(wb_stats_counter(WB_STATS_BYTES_RECEIVED) < strlen(res));
+	free(res);
+	wb_stats_free();
+}
+
+void test_netRequest_notModified() {
+	struct net_validators validators = {NULL, NULL};
+	int not_modified;
+	char *res;
+
+	res = net_request(server_url("/wallpaper/3"), NULL, NULL, 0, &validators, &not_modified);
+	TEST_ASSERT_NOT_NULL(res);
+	TEST_ASSERT_EQUAL_INT(0, not_modified);
+	TEST_ASSERT_EQUAL_STRING("\"3\"", validators.etag);
+	free(res);
+
+	res = net_request(server_url("/wallpaper/3"), NULL, NULL, 0, &validators, &not_modified);
+	TEST_ASSERT_NULL(res);
+	TEST_ASSERT_EQUAL_INT(1, not_modified);
+	TEST_ASSERT_EQUAL_STRING("\"3\"", validators.etag);
+	net_validators_free(&validators);
+}
+
+void test_netGetResponse_serverErrors() {
+	struct replay_faults faults;
+	unsigned long requests;
+	char *res;
+	int i;
+
+	memset(&faults, 0, sizeof(faults));
+	faults.error_every = 2;
+
+	faults.error_status = 429;
+	replay_set_faults(server, &faults);
+	requests = replay_requests(server);
+	for (i = 1; i <= 4; i++) {
+		res = net_get_response(server_url("/wallpaper/1"), NULL, NULL, 0);
+		if ((requests + i) % 2 == 0) {
+			TEST_ASSERT_NULL(res);
+		} else {
+			TEST_ASSERT_NOT_NULL(res);
+		}
+		free(res);
+	}
+
+	faults.error_status = 503;
+	faults.error_every = 1;
+	replay_set_faults(server, &faults);
+	TEST_ASSERT_NULL(net_get_response(server_url("/wallpaper/1"), NULL, NULL, 0));
+}
+
+void test_netGetResponse_slowServer() {
+	struct replay_faults faults;
+	char *fast, *slow;
+	double start;
+
+	fast = net_get_response(server_url("/wallpaper/9"), NULL, NULL, 0);
+	TEST_ASSERT_NOT_NULL(fast);
+
+	memset(&faults, 0, sizeof(faults));
+	faults.latency_ms = 100;
+	faults.jitter_ms = 20;
+	faults.drip_bytes = 64;
+	faults.drip_ms = 1;
+	replay_set_faults(server, &faults);
+
+	start = wb_stats_now();
+	slow = net_get_response(server_url("/wallpaper/9"), NULL, NULL, 0);
+	TEST_ASSERT_TRUE(wb_stats_now() - start >= 0.1);
+	TEST_ASSERT_NOT_NULL(slow);
+	TEST_ASSERT_EQUAL_STRING(fast, slow);
+	free(fast);
+	free(slow);
+}
+
+void test_netGetResponse_deadline() {
+	struct replay_faults faults;
+	char *res;
+	double start;
+
+	memset(&faults, 0, sizeof(faults));
+	faults.latency_ms = 2000;
+	replay_set_faults(server, &faults);
+
+	/* A slow request is cut short at the deadline */
+	start = wb_stats_now();
+	net_set_deadline(start + 0.2);
+	res = net_get_response(server_url("/wallpaper/3"), NULL, NULL, 0);
+	TEST_ASSERT_NULL(res);
+	TEST_ASSERT_TRUE(wb_stats_now() - start < 1);
+
+	/* Nothing is started after it */
+	net_set_deadline(wb_stats_now() - 1);
+	TEST_ASSERT_EQUAL_INT(0, net_timeout_ms());
+	TEST_ASSERT_NULL(net_get_response(server_url("/wallpaper/3"), NULL, NULL, 0));
+
+	net_set_deadline(0);
+	TEST_ASSERT_EQUAL_INT(NET_TIMEOUT_MS, net_timeout_ms());
+}
+
+void test_netGetResponse_cancel() {
+	struct replay_faults faults;
+	pthread_t canceller;
+	char *res;
+	double start;
+
+	memset(&faults, 0, sizeof(faults));
+	faults.latency_ms = 3000;
+	replay_set_faults(server, &faults);
+
+	/* A running request is aborted */
+	start = wb_stats_now();
+	pthread_create(&canceller, NULL, cancel_later, NULL);
+	res = net_get_response(server_url("/wallpaper/5"), NULL, NULL, 0);
+	pthread_join(canceller, NULL);
+	TEST_ASSERT_NULL(res);
+	TEST_ASSERT_TRUE(net_cancelled());
+	TEST_ASSERT_TRUE(wb_stats_now() - start < 1.5);
+
+	/* Nothing is started after it */
+	TEST_ASSERT_NULL(net_get_response(server_url("/wallpaper/5"), NULL, NULL, 0));
+
+	net_cancel_requested = 0;
+}
+
+void test_netGetResponse_threads() {
+	pthread_t threads[8];
+	unsigned long requests;
+	int i, failures = 0;
+
+	requests = replay_requests(server);
+	for (i = 0; i < 8; i++) {
+		pthread_create(&threads[i], NULL, fetch_pages, &failures);
+	}
+	for (i = 0; i < 8; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	TEST_ASSERT_EQUAL_INT(0, failures);
+	TEST_ASSERT_EQUAL_INT(40, replay_requests(server) - requests);
+}
+
 /* Main */
 int main(int argc, char *argv[]) {
+	int failures;
+
+	server = replay_start("../bench/fixtures", 100);
+	if (server == NULL) {
+		return 1;
+	}
+
 	Unity.TestFile=__FILE__;
 	UnityBegin();
 	RUN_TEST(test_netGetResponse_validUrl, __LINE__);
 	RUN_TEST(test_netGetResponse_invalidUrl, __LINE__);
 	RUN_TEST(test_netGetResponse_cookies, __LINE__);
 	RUN_TEST(test_netGetResponse_post, __LINE__);
-	return UnityEnd();
+	RUN_TEST(test_netGetResponse_gzip, __LINE__);
+	RUN_TEST(test_netRequest_notModified, __LINE__);
+	RUN_TEST(test_netGetResponse_serverErrors, __LINE__);
+	RUN_TEST(test_netGetResponse_slowServer, __LINE__);
+	RUN_TEST(test_netGetResponse_deadline, __LINE__);
+	RUN_TEST(test_netGetResponse_cancel, __LINE__);
+	RUN_TEST(test_netGetResponse_threads, __LINE__);
+	failures = UnityEnd();
+
+	replay_stop(server);
+	return failures;
 }
@@ -21,6 +21,11 @@
 #include <string.h>
 
 #include "unity.h"
+#include "mem.c"
+#include "histogram.c"
+#include "stats.c"
+#include "error.c"
+#include "trace.c"
 #include "xml.c"
 
 /* Unity set up and tear down */
@@ -69,6 +74,32 @@ void test_convertHtmlToXml_invalid() {
 	free(res);
 }
 
+void test_convertHtmlToXml_outgrowsBuffer() {
+	char html[1024];
+	char *res;
+	int i, paragraphs;
+
+	/* Every "<p>x" grows to "<p>x</p>\n", so the XML is much longer than the HTML */
+	html[0] = '\0';
+	for (i = 0; i < 200; i++) {
+		strcat(html, "<p>x");
+	}
+
+	res = convert_html_to_xml(html);
+	TEST_ASSERT_NOT_NULL(res);
+
+	paragraphs = 0;
+	for (i = 0; res[i] != '\0'; i++) {
+		if (strncmp(res + i, "<p>x</p>", 8) == 0) {
+			paragraphs++;
+		}
+	}
+
+	TEST_ASSERT_EQUAL_INT(200, paragraphs);
+	TEST_ASSERT_EQUAL_STRING("</body>\n</html>\n", res + strlen(res) - strlen("</body>\n</html>\n"));
+	free(res);
+}
+
 void test_netGetResponseAsXml() {
 	char *res;
 
@@ -83,6 +114,7 @@ int main(int argc, char *argv[]) {
 	UnityBegin();
 	RUN_TEST(test_convertHtmlToXml_valid, __LINE__);
 	RUN_TEST(test_convertHtmlToXml_invalid, __LINE__);
+	RUN_TEST(test_convertHtmlToXml_outgrowsBuffer, __LINE__);
 	RUN_TEST(test_netGetResponseAsXml, __LINE__);
 	return UnityEnd();
 }
@@ -17,8 +17,16 @@
  * along with wb.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include "unity.h"
 #include "str_list.h"
+#include "arena.c"
+#include "mem.c"
+#include "histogram.c"
+#include "stats.c"
+#include "error.c"
+#include "trace.c"
 #include "xpath.c"
 
 /* Unity set up and tear down */
@@ -37,6 +45,12 @@ struct wb_str_list *wb_list_append(struct wb_str_list *list, const char *str) {
 	return NULL;
 }
 
+struct wb_str_list *wb_list_append_n(struct wb_str_list *list, const char *str, size_t length) {
+	TEST_ASSERT_EQUAL_INT(4, length);
+	TEST_ASSERT_EQUAL_INT(0, strncmp("test", str, length));
+	return NULL;
+}
+
 struct wb_str_list *wb_list_prepend(struct wb_str_list *list, const char *str) {
 	TEST_ASSERT_EQUAL_STRING("test", str);
 	return NULL;
@@ -57,10 +71,79 @@ void test_xpathEvalExpr() {
 	);
 }
 
+void test_xpathEvalExpr_reusesParserContext() {
+	xmlParserCtxtPtr ctxt;
+
+	ctxt = xpath_get_parser_context();
+	TEST_ASSERT_NOT_NULL(ctxt);
+
+	/* A failed parse must not poison the context for the next one */
+	TEST_ASSERT_NULL(xpath_parse_doc("<root><broken></root>"));
+
+	xpath_eval_expr(
+		"<root><node attr=\"test\" /></root>",
+		"//node/@attr",
+		NULL
+	);
+
+	TEST_ASSERT_TRUE(ctxt == xpath_get_parser_context());
+}
+
+void test_xpathEvalViews() {
+	struct wb_xpath_result *result;
+	const char *xml = "<root><node attr=\"one\" /><node attr=\"tw&amp;o\" /><node /></root>";
+
+	result = xpath_eval_views(xml, "//node/@attr", NULL);
+	TEST_ASSERT_NOT_NULL(result);
+	TEST_ASSERT_EQUAL_INT(2, result->count);
+
+	TEST_ASSERT_EQUAL_INT(3, result->views[0].length);
+	TEST_ASSERT_EQUAL_INT(0, strncmp("one", result->views[0].str, 3));
+	TEST_ASSERT_EQUAL_INT(4, result->views[1].length);
+	TEST_ASSERT_EQUAL_INT(0, strncmp("tw&o", result->views[1].str, 4));
+
+	/* A plain attribute value is viewed in place, not copied */
+	TEST_ASSERT_TRUE(result->owned == NULL || result->owned[0] == NULL);
+
+	xpath_result_free(result);
+
+	/* Mixed content is assembled into a string owned by the result */
+	result = xpath_eval_views("<root><p>a<b>b</b>c</p></root>", "//p", NULL);
+	TEST_ASSERT_NOT_NULL(result);
+	TEST_ASSERT_EQUAL_INT(1, result->count);
+	TEST_ASSERT_EQUAL_INT(2, result->views[0].length);
+	TEST_ASSERT_EQUAL_INT(0, strncmp("ac", result->views[0].str, 2));
+	TEST_ASSERT_NOT_NULL(result->owned);
+	xpath_result_free(result);
+
+	result = xpath_eval_views(xml, "//missing/@attr", NULL);
+	TEST_ASSERT_NOT_NULL(result);
+	TEST_ASSERT_EQUAL_INT(0, result->count);
+	xpath_result_free(result);
+}
+
+void test_xpathEvalFields() {
+	const char *expressions[] = {"//node/@attr", "//missing", "/root/node[1]/@attr"};
+	struct wb_str_list *results[3];
+
+	TEST_ASSERT_EQUAL_INT(0, xpath_eval_fields(
+		"<root><node attr=\"test\" /><node attr=\"test\" /></root>",
+		expressions, 3, NULL, results));
+
+	TEST_ASSERT_EQUAL_INT(-1, xpath_eval_fields("<root><broken></root>",
+		expressions, 3, NULL, results));
+	TEST_ASSERT_NULL(results[0]);
+	TEST_ASSERT_NULL(results[1]);
+	TEST_ASSERT_NULL(results[2]);
+}
+
 /* Main */
 int main(int argc, char *argv[]) {
 	Unity.TestFile=__FILE__;
 	UnityBegin();
 	RUN_TEST(test_xpathEvalExpr, __LINE__);
+	RUN_TEST(test_xpathEvalExpr_reusesParserContext, __LINE__);
+	RUN_TEST(test_xpathEvalViews, __LINE__);
+	RUN_TEST(test_xpathEvalFields, __LINE__);
 	return UnityEnd();
 }
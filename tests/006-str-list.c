@@ -23,6 +23,7 @@
 
 #include "unity.h"
 #include "str_list.h"
+#include "mem.c"
 #include "str_list.c"
 
 /* Unity set up and tear down */
@@ -81,11 +82,38 @@ void test_wbListPrepend() {
 	wb_list_free(list);
 }
 
+void test_wbListAppendN() {
+	struct wb_str_list *list = NULL;
+	struct wb_str_list *list_element;
+	struct wb_str_view view;
+	char *copy;
+
+	list = wb_list_append_n(list, "teststr1 and more", 8);
+	list = wb_list_append_nocopy(list, strdup("teststr2"));
+
+	list_element = list;
+	TEST_ASSERT_EQUAL_STRING("teststr1", list_element->str);
+	list_element = list_element->next;
+	TEST_ASSERT_EQUAL_STRING("teststr2", list_element->str);
+	TEST_ASSERT_NULL(list_element->next);
+	TEST_ASSERT_EQUAL_INT(2, wb_list_length(list));
+	TEST_ASSERT_EQUAL_INT(0, wb_list_length(NULL));
+
+	view.str = "teststr3 and more";
+	view.length = 8;
+	copy = wb_str_view_dup(&view);
+	TEST_ASSERT_EQUAL_STRING("teststr3", copy);
+
+	free(copy);
+	wb_list_free(list);
+}
+
 /* Main */
 int main(int argc, char *argv[]) {
 	Unity.TestFile=__FILE__;
 	UnityBegin();
 	RUN_TEST(test_wbListAppend, __LINE__);
 	RUN_TEST(test_wbListPrepend, __LINE__);
+	RUN_TEST(test_wbListAppendN, __LINE__);
 	return UnityEnd();
 }
@@ -30,6 +30,20 @@ void resetOptions() {
 	options.password = "";
 	options.images = 20;
 	options.images_per_page = 20;
+	options.jobs = 0;
+	options.batch_file = NULL;
+	options.serve_socket = NULL;
+	options.watch_interval = 0;
+	options.index_file = NULL;
+	options.checkpoint_file = NULL;
+	options.shard_index = 0;
+	options.shard_count = 0;
+	options.trace_file = NULL;
+	options.metrics_file = NULL;
+	options.base_url = NULL;
+	options.stream = 0;
+	options.deadline_ms = 0;
+	options.fast_scan = 0;
 
 	options.query = NULL;
 	options.color = -1;
@@ -154,6 +168,91 @@ void test_wbGenerateQuery_collection() {
 	}
 }
 
+void test_wbQueryPageUrl() {
+	struct wb_query *query;
+	char *page_url;
+
+	resetOptions();
+	options.query = "100%d%s";
+
+	query = wb_generate_query(&options);
+
+	TEST_ASSERT_NOT_NULL(query);
+
+	if (query != NULL) {
+		page_url = (char *) malloc(wb_query_page_url_size(query));
+
+		TEST_ASSERT_EQUAL_INT(strlen(query->url) - 1, wb_query_page_url(query, 0, page_url));
+		TEST_ASSERT_EQUAL_STRING("http://wallbase.cc/search/index/0?section=wallpapers&q=100%d%s&res_opt=eqeq&res=0x0&order_mode=desc&order=relevance&thpp=20&purity=111&board=123&aspect=0.00", page_url);
+
+		wb_query_page_url(query, 1234567890, page_url);
+		TEST_ASSERT_EQUAL_STRING("http://wallbase.cc/search/index/1234567890?section=wallpapers&q=100%d%s&res_opt=eqeq&res=0x0&order_mode=desc&order=relevance&thpp=20&purity=111&board=123&aspect=0.00", page_url);
+
+		free(page_url);
+		wb_query_free(query);
+	}
+
+	resetOptions();
+	options.collection_id = 1234;
+
+	query = wb_generate_query(&options);
+
+	TEST_ASSERT_NOT_NULL(query);
+
+	if (query != NULL) {
+		page_url = (char *) malloc(wb_query_page_url_size(query));
+
+		wb_query_page_url(query, 40, page_url);
+		TEST_ASSERT_EQUAL_STRING("http://wallbase.cc/collection/1234/40?section=wallpapers&res_opt=eqeq&res=0x0&thpp=20&purity=111&board=123&aspect=0.00", page_url);
+
+		free(page_url);
+		wb_query_free(query);
+	}
+
+	/* Another server */
+	resetOptions();
+	wb_query_set_base_url("http://127.0.0.1:8080");
+
+	query = wb_generate_query(&options);
+	wb_query_set_base_url(NULL);
+
+	TEST_ASSERT_NOT_NULL(query);
+
+	if (query != NULL) {
+		page_url = (char *) malloc(wb_query_page_url_size(query));
+
+		wb_query_page_url(query, 20, page_url);
+		TEST_ASSERT_EQUAL_STRING("http://127.0.0.1:8080/search/index/20?section=wallpapers&res_opt=eqeq&res=0x0&order_mode=desc&order=relevance&thpp=20&purity=111&board=123&aspect=0.00", page_url);
+
+		free(page_url);
+		wb_query_free(query);
+	}
+}
+
+void test_wbPlanPages() {
+	struct wb_plan plan;
+
+	wb_plan_pages(20, 0, &plan);
+	TEST_ASSERT_EQUAL_INT(20, plan.images_per_page);
+	TEST_ASSERT_EQUAL_INT(1, plan.page_count);
+	TEST_ASSERT_EQUAL_INT(20, plan.last_page_images);
+
+	wb_plan_pages(64, 0, &plan);
+	TEST_ASSERT_EQUAL_INT(32, plan.images_per_page);
+	TEST_ASSERT_EQUAL_INT(2, plan.page_count);
+	TEST_ASSERT_EQUAL_INT(32, plan.last_page_images);
+
+	wb_plan_pages(1000, 0, &plan);
+	TEST_ASSERT_EQUAL_INT(60, plan.images_per_page);
+	TEST_ASSERT_EQUAL_INT(17, plan.page_count);
+	TEST_ASSERT_EQUAL_INT(40, plan.last_page_images);
+
+	wb_plan_pages(50, 20, &plan);
+	TEST_ASSERT_EQUAL_INT(20, plan.images_per_page);
+	TEST_ASSERT_EQUAL_INT(3, plan.page_count);
+	TEST_ASSERT_EQUAL_INT(10, plan.last_page_images);
+}
+
 /* Main */
 int main(int argc, char *argv[]) {
 	Unity.TestFile=__FILE__;
@@ -162,5 +261,7 @@ int main(int argc, char *argv[]) {
 	RUN_TEST(test_wbGenerateQuery_toplist, __LINE__);
 	RUN_TEST(test_wbGenerateQuery_random, __LINE__);
 	RUN_TEST(test_wbGenerateQuery_collection, __LINE__);
+	RUN_TEST(test_wbQueryPageUrl, __LINE__);
+	RUN_TEST(test_wbPlanPages, __LINE__);
 	return UnityEnd();
 }
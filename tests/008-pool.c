@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+
+#include "unity.h"
+#include "pool.c"
+
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static int counter;
+static struct wb_pool *test_pool;
+
+/* Unity set up and tear down */
+void setUp() {
+	counter = 0;
+}
+
+void tearDown() {
+}
+
+/* Tasks */
+void increment_task(void *arg) {
+	pthread_mutex_lock(&counter_lock);
+	counter++;
+	pthread_mutex_unlock(&counter_lock);
+}
+
+void spawning_task(void *arg) {
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		wb_pool_submit(test_pool, increment_task, NULL);
+	}
+}
+
+void slot_task(void *arg) {
+	int *slot = (int *) arg;
+	*slot = *slot * 2;
+}
+
+/* Tests */
+void test_wbPool_runsAllTasks() {
+	int i;
+
+	test_pool = wb_pool_new(4);
+	TEST_ASSERT_NOT_NULL(test_pool);
+
+	/* More tasks than the initial deque capacity */
+	for (i = 0; i < 1000; i++) {
+		TEST_ASSERT_EQUAL_INT(0, wb_pool_submit(test_pool, increment_task, NULL));
+	}
+
+	wb_pool_wait(test_pool);
+	TEST_ASSERT_EQUAL_INT(1000, counter);
+
+	wb_pool_free(test_pool);
+}
+
+void test_wbPool_nestedSubmit() {
+	int i;
+
+	test_pool = wb_pool_new(3);
+	TEST_ASSERT_NOT_NULL(test_pool);
+
+	for (i = 0; i < 20; i++) {
+		wb_pool_submit(test_pool, spawning_task, NULL);
+	}
+
+	wb_pool_wait(test_pool);
+	TEST_ASSERT_EQUAL_INT(200, counter);
+
+	wb_pool_free(test_pool);
+}
+
+void test_wbPool_reuseAfterWait() {
+	int slots[100];
+	int i, round;
+
+	test_pool = wb_pool_new(2);
+	TEST_ASSERT_NOT_NULL(test_pool);
+
+	for (round = 0; round < 3; round++) {
+		for (i = 0; i < 100; i++) {
+			slots[i] = i;
+			wb_pool_submit(test_pool, slot_task, &slots[i]);
+		}
+
+		wb_pool_wait(test_pool);
+
+		for (i = 0; i < 100; i++) {
+			TEST_ASSERT_EQUAL_INT(i * 2, slots[i]);
+		}
+	}
+
+	wb_pool_free(test_pool);
+}
+
+void test_wbPool_defaultWorkers() {
+	TEST_ASSERT_TRUE(wb_pool_default_workers() >= 1);
+
+	test_pool = wb_pool_new(0);
+	TEST_ASSERT_NOT_NULL(test_pool);
+	TEST_ASSERT_EQUAL_INT(wb_pool_default_workers(), test_pool->worker_count);
+	wb_pool_free(test_pool);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbPool_runsAllTasks, __LINE__);
+	RUN_TEST(test_wbPool_nestedSubmit, __LINE__);
+	RUN_TEST(test_wbPool_reuseAfterWait, __LINE__);
+	RUN_TEST(test_wbPool_defaultWorkers, __LINE__);
+	return UnityEnd();
+}
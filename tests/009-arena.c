@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "unity.h"
+#include "mem.c"
+#include "str_list.c"
+#include "arena.c"
+#include "histogram.c"
+#include "stats.c"
+#include "error.c"
+#include "trace.c"
+#include "xpath.c"
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Tests */
+void test_wbArena_alloc() {
+	struct wb_arena *arena;
+	char *a, *b;
+
+	arena = wb_arena_new(64);
+	TEST_ASSERT_NOT_NULL(arena);
+
+	a = (char *) wb_arena_alloc(arena, 10);
+	b = (char *) wb_arena_alloc(arena, 10);
+	TEST_ASSERT_NOT_NULL(a);
+	TEST_ASSERT_NOT_NULL(b);
+	TEST_ASSERT_EQUAL_INT(0, ((size_t) a) % 16);
+	TEST_ASSERT_EQUAL_INT(0, ((size_t) b) % 16);
+	TEST_ASSERT_TRUE(b >= a + 10);
+
+	/* Bigger than a chunk */
+	a = (char *) wb_arena_alloc(arena, 1000);
+	TEST_ASSERT_NOT_NULL(a);
+	memset(a, 'x', 1000);
+
+	wb_arena_free(arena);
+}
+
+void test_wbArena_reset() {
+	struct wb_arena *arena;
+	char *first, *again;
+	int i;
+
+	arena = wb_arena_new(256);
+	first = (char *) wb_arena_alloc(arena, 16);
+	for (i = 0; i < 100; i++) {
+		wb_arena_alloc(arena, 48);
+	}
+	wb_arena_alloc(arena, 4096);
+
+	/* The first chunk is reused after a reset, the oversized one is freed */
+	wb_arena_reset(arena);
+	again = (char *) wb_arena_alloc(arena, 16);
+	TEST_ASSERT_TRUE(first == again);
+
+	wb_arena_free(arena);
+}
+
+void test_xpathEvalExpr_arenaMode() {
+	struct wb_str_list *results;
+	int i;
+
+	for (i = 0; i < 50; i++) {
+		results = xpath_eval_expr(
+			"<root><node attr=\"one\" /><node attr=\"t&amp;wo\" /></root>",
+			"//node/@attr",
+			NULL
+		);
+
+		TEST_ASSERT_NOT_NULL(results);
+		TEST_ASSERT_EQUAL_STRING("one", results->str);
+		TEST_ASSERT_NOT_NULL(results->next);
+		TEST_ASSERT_EQUAL_STRING("t&wo", results->next->str);
+		TEST_ASSERT_NULL(results->next->next);
+		wb_list_free(results);
+	}
+
+	TEST_ASSERT_NULL(xpath_eval_expr("<root><broken></root>", "//node/@attr", NULL));
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	int res;
+
+	/* The hooks must be in place before libxml2 allocates anything */
+	xpath_enable_arena();
+	xpath_init();
+
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbArena_alloc, __LINE__);
+	RUN_TEST(test_wbArena_reset, __LINE__);
+	RUN_TEST(test_xpathEvalExpr_arenaMode, __LINE__);
+	res = UnityEnd();
+
+	xpath_cleanup();
+	return res;
+}
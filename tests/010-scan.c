@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "scan.h"
+#include "scan.c"
+#include "arena.c"
+#include "mem.c"
+#include "histogram.c"
+#include "stats.c"
+#include "error.c"
+#include "trace.c"
+#include "str_list.c"
+#include "xml.c"
+#include "xpath.c"
+
+/* Test data */
+static const char *TEST_PAGE =
+	"<!DOCTYPE html>\n"
+	"<html><head><title>a &lt; b</title>\n"
+	"<script>var s = '<img class=\"wall\" src=\"script\">';</script></head>\n"
+	"<body><!-- <img class=\"wall\" src=\"comment\"> -->\n"
+	"<div class='thumb' data-x=\"a > b\"><img src='thumb.jpg' class='thumb'>\n"
+	"<IMG CLASS=\"wall stage1\" alt=x SRC=\"http://example.com/wallpaper-1.jpg\" />\n"
+	"</div></body></html>\n";
+
+/* The XPath expression the scanner stands in for */
+static const char *XPATH_IMAGE_URL = "//img[contains(@class,'wall')]/@src";
+
+/* Recorded pages, with their placeholders filled in */
+static const char *FIXTURES[] = {
+	"../bench/fixtures/detail.html", "../bench/fixtures/listing.html",
+	"../bench/fixtures/login.html"
+};
+
+/* Image pages the fast path must agree with the DOM on */
+static const char *EDGE_CASES[] = {
+	"<img class=\"wall\" src=\"http://example.com/a b.jpg\">",
+	"<img class=\"wall\" src=\"http://example.com/a<b.jpg\">",
+	"<img class=\"wall\" src=\"http://example.com/a>b.jpg\">",
+	"<img class=\"wall\" src=\"http://example.com/a\\b.jpg\">",
+	"<img class=\"wall\" src=\"\">",
+	"<img class=\"wall\" src>",
+	"<img class=\"wall\" src=\"a.jpg\" src=\"b.jpg\">",
+	"<img class=\"wall\" class=\"thumb\" src=\"a.jpg\">",
+	"<img class=\"wall\" src=\"a.jpg?x=1&amp;y=2\">",
+	"<img class='wall' src='a.jpg'>",
+	"<img class=wall src=a.jpg>",
+	"<IMG CLASS=\"Wall wallpaper\" SRC=\"a.jpg\">",
+	"<img class=\" wall \" src=\"a.jpg\"><img class=\"thumb\" src=\"b.jpg\">",
+	"<img class=\"wall\" src=\"a.jpg\"><img class=\"wall\" src=\"b.jpg\">",
+	"<!-- <img class=\"wall\" src=\"a.jpg\"> --><img class=\"wall\" src=\"b.jpg\">",
+	"<script>'<img class=\"wall\" src=\"a.jpg\">'</script><img class=\"wall\" src=\"b.jpg\">",
+	"<textarea><img class=\"wall\" src=\"a.jpg\"></textarea>",
+	"<img class=\"wall\" alt=\"a > b\" src=\"a.jpg\">",
+	"<img class=\"wall\" src=\"a.jpg\"/>",
+	"<img class=\"wall\" src=\"a\tb.jpg\">"
+};
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Mocks */
+void net_init() {
+}
+
+void net_cleanup() {
+}
+
+char *net_get_response(const char *url, const char *post_data, struct wb_str_list **cookies, int update_cookies) {
+	return NULL;
+}
+
+/* Helpers */
+int scan(const char *html, struct wb_str_view *view) {
+	return scan_wall_image_url(html, strlen(html), view);
+}
+
+/* Reads a fixture and fills in its placeholders like the replay server */
+char *read_fixture(const char *path) {
+	char buffer[65536], *html, *out;
+	size_t length;
+	FILE *file;
+
+	file = fopen(path, "r");
+	TEST_ASSERT_NOT_NULL_MESSAGE(file, path);
+	length = fread(buffer, 1, sizeof(buffer) - 1, file);
+	fclose(file);
+	buffer[length] = '\0';
+
+	html = (char *) malloc(length * 2 + 1);
+	out = html;
+	for (length = 0; buffer[length] != '\0'; length++) {
+		if (strncmp(buffer + length, "@BASE@", 6) == 0) {
+			out += sprintf(out, "http://wallbase.cc");
+			length += 5;
+		} else if (strncmp(buffer + length, "@ID@", 4) == 0) {
+			out += sprintf(out, "1234");
+			length += 3;
+		} else {
+			*out++ = buffer[length];
+		}
+	}
+	*out = '\0';
+
+	return html;
+}
+
+/* The result the parse workers get without the fast path, like
+   wb_eval_single_result() */
+char *dom_wall_image_url(const char *html) {
+	struct wb_xpath_result *results;
+	char *xml_data, *str = NULL;
+
+	xml_data = convert_html_to_xml(html);
+	TEST_ASSERT_NOT_NULL(xml_data);
+
+	results = xpath_eval_views(xml_data, XPATH_IMAGE_URL, NULL);
+	if (results != NULL) {
+		if (results->count == 1) {
+			str = wb_str_view_dup(&results->views[0]);
+		}
+		xpath_result_free(results);
+	}
+	free(xml_data);
+
+	return str;
+}
+
+/* The fast path must be unsure or find what the DOM finds */
+int assert_scan_matches_dom(const char *html) {
+	struct wb_str_view view;
+	char *expected;
+	int res;
+
+	res = scan(html, &view);
+	if (res == WB_SCAN_AMBIGUOUS) {
+		return res;
+	}
+
+	expected = dom_wall_image_url(html);
+	if (res == WB_SCAN_NOT_FOUND) {
+		TEST_ASSERT_NULL_MESSAGE(expected, html);
+	} else {
+		TEST_ASSERT_NOT_NULL_MESSAGE(expected, html);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(strlen(expected), view.length, html);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(0, strncmp(expected, view.str, view.length), html);
+	}
+	free(expected);
+
+	return res;
+}
+
+/* Tests */
+void test_scanFindByte() {
+	char buffer[100];
+	int i;
+
+	memset(buffer, 'a', sizeof(buffer));
+	for (i = 0; i < (int) sizeof(buffer); i++) {
+		buffer[i] = '<';
+		TEST_ASSERT_EQUAL_PTR(buffer + i, scan_find_byte(buffer, buffer + sizeof(buffer), '<'));
+		TEST_ASSERT_NULL(scan_find_byte(buffer, buffer + i, '<'));
+		buffer[i] = 'a';
+	}
+}
+
+void test_scanWallImageUrl_found() {
+	struct wb_str_view view;
+
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_FOUND, scan(TEST_PAGE, &view));
+	TEST_ASSERT_EQUAL_INT(strlen("http://example.com/wallpaper-1.jpg"), view.length);
+	TEST_ASSERT_EQUAL_INT(0, strncmp("http://example.com/wallpaper-1.jpg", view.str, view.length));
+}
+
+void test_scanWallImageUrl_notFound() {
+	struct wb_str_view view;
+
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_NOT_FOUND, scan("<p>No images</p>", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_NOT_FOUND, scan("<img class=\"wall\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_NOT_FOUND, scan("<img class=\"thumb\" src=\"a\">", &view));
+}
+
+void test_scanWallImageUrl_ambiguous() {
+	struct wb_str_view view;
+
+	/* Entities must be decoded */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a?b&amp;c\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"w&#97;ll\" src=\"a\">", &view));
+	/* Duplicate attributes */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a\" src=\"b\">", &view));
+	/* More than one match */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a\"><img class=\"wall\" src=\"b\">", &view));
+	/* Unterminated markup */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a\"><!-- ", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<script><img class=\"wall\" src=\"a\">", &view));
+	/* Markup tidy parses, but browsers do not */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<title><img class=\"wall\" src=\"a\"></title>", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<textarea><img class=\"wall\" src=\"a\"></textarea>", &view));
+	/* Odd quoting */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=wall\"x src=\"a\">", &view));
+	/* Non-ASCII and whitespace in the value */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"\xc4\x85.jpg\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a\nb\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a b.jpg\">", &view));
+	/* Characters tidy escapes in URIs */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a<b.jpg\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a>b.jpg\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a\\b.jpg\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"a'b.jpg\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src='a\"b.jpg'>", &view));
+	/* Empty values */
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src=\"\">", &view));
+	TEST_ASSERT_EQUAL_INT(WB_SCAN_AMBIGUOUS, scan("<img class=\"wall\" src>", &view));
+}
+
+void test_scanWallImageUrl_matchesDom() {
+	char *html;
+	int i;
+
+	xpath_init();
+
+	/* The recorded image page takes the fast path */
+	for (i = 0; i < (int) (sizeof(FIXTURES) / sizeof(FIXTURES[0])); i++) {
+		html = read_fixture(FIXTURES[i]);
+		if (i == 0) {
+			TEST_ASSERT_EQUAL_INT(WB_SCAN_FOUND, assert_scan_matches_dom(html));
+		} else {
+			assert_scan_matches_dom(html);
+		}
+		free(html);
+	}
+
+	for (i = 0; i < (int) (sizeof(EDGE_CASES) / sizeof(EDGE_CASES[0])); i++) {
+		assert_scan_matches_dom(EDGE_CASES[i]);
+	}
+
+	xpath_cleanup();
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_scanFindByte, __LINE__);
+	RUN_TEST(test_scanWallImageUrl_found, __LINE__);
+	RUN_TEST(test_scanWallImageUrl_notFound, __LINE__);
+	RUN_TEST(test_scanWallImageUrl_ambiguous, __LINE__);
+	RUN_TEST(test_scanWallImageUrl_matchesDom, __LINE__);
+	return UnityEnd();
+}
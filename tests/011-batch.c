@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "types.h"
+#include "error.h"
+#include "args.c"
+#include "mem.c"
+#include "str_list.c"
+#include "batch.c"
+
+struct options options;
+
+/* Functions that return to a known state */
+void resetOptions() {
+	options.username = "";
+	options.password = "";
+	options.images = 20;
+	options.images_per_page = 20;
+	options.jobs = 0;
+	options.batch_file = NULL;
+	options.serve_socket = NULL;
+	options.watch_interval = 0;
+	options.index_file = NULL;
+	options.checkpoint_file = NULL;
+	options.shard_index = 0;
+	options.shard_count = 0;
+	options.trace_file = NULL;
+	options.metrics_file = NULL;
+	options.base_url = NULL;
+	options.stream = 0;
+	options.deadline_ms = 0;
+	options.fast_scan = 0;
+
+	options.query = NULL;
+	options.color = -1;
+	options.toplist = WB_TOPLIST_NONE;
+	options.collection_id = -1;
+
+	options.res_x = 0;
+	options.res_y = 0;
+	options.res_opt = WB_RES_EXACTLY;
+	options.aspect_ratio = 0;
+
+	options.flags = 0;
+	options.purity = 0;
+	options.boards = 0;
+
+	options.sort_by = WB_SORT_DATE;
+	options.sort_order = WB_SORT_DESCENDING;
+}
+
+/* Writes a batch file and returns its path */
+char *writeBatchFile(const char *contents) {
+	static char path[] = "/tmp/wb-batch-XXXXXX";
+	int fd;
+
+	strcpy(path, "/tmp/wb-batch-XXXXXX");
+	fd = mkstemp(path);
+	write(fd, contents, strlen(contents));
+	close(fd);
+
+	return path;
+}
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Mock functions */
+void wb_error(const char *format, ...) {
+}
+
+void wb_error_no_prefix(const char *format, ...) {
+}
+
+/* Tests */
+void test_batchSplitLine() {
+	char line[] = "  -q 'two words' -n\\ 5 \"a \\\"b\\\"\"\n";
+	char *argv[20];
+	int argc;
+
+	argc = batch_split_line(line, argv);
+	TEST_ASSERT_EQUAL_INT(5, argc);
+	TEST_ASSERT_EQUAL_STRING("wb", argv[0]);
+	TEST_ASSERT_EQUAL_STRING("-q", argv[1]);
+	TEST_ASSERT_EQUAL_STRING("two words", argv[2]);
+	TEST_ASSERT_EQUAL_STRING("-n 5", argv[3]);
+	TEST_ASSERT_EQUAL_STRING("a \"b\"", argv[4]);
+	TEST_ASSERT_NULL(argv[5]);
+}
+
+void test_batchSplitLine_unterminatedQuote() {
+	char line[] = "-q 'two words";
+	char *argv[20];
+
+	TEST_ASSERT_EQUAL_INT(-1, batch_split_line(line, argv));
+}
+
+void test_wbBatchRead() {
+	struct wb_batch *batch;
+	char *path;
+
+	resetOptions();
+	options.flags |= WB_FLAG_VERBOSE;
+
+	path = writeBatchFile("# Saved searches\n-q cats -n 40\n\n  \n-t 1w -S\n--query='big dogs'");
+	batch = wb_batch_read(path, &options);
+	unlink(path);
+
+	TEST_ASSERT_NOT_NULL(batch);
+	TEST_ASSERT_EQUAL_INT(3, batch->count);
+
+	TEST_ASSERT_EQUAL_INT(2, batch->queries[0].line);
+	TEST_ASSERT_EQUAL_STRING("cats", batch->queries[0].options.query);
+	TEST_ASSERT_EQUAL_INT(40, batch->queries[0].options.images);
+	TEST_ASSERT_EQUAL_INT(WB_FLAG_VERBOSE, batch->queries[0].options.flags);
+
+	TEST_ASSERT_EQUAL_INT(5, batch->queries[1].line);
+	TEST_ASSERT_NULL(batch->queries[1].options.query);
+	TEST_ASSERT_EQUAL_INT(WB_TOPLIST_1W, batch->queries[1].options.toplist);
+	TEST_ASSERT_EQUAL_INT(WB_PURITY_SFW, batch->queries[1].options.purity);
+	TEST_ASSERT_EQUAL_INT(20, batch->queries[1].options.images);
+
+	TEST_ASSERT_EQUAL_INT(6, batch->queries[2].line);
+	TEST_ASSERT_EQUAL_STRING("big dogs", batch->queries[2].options.query);
+
+	wb_batch_free(batch);
+}
+
+void test_wbBatchRead_invalid() {
+	char *path;
+
+	resetOptions();
+
+	path = writeBatchFile("-q cats\n-n notanumber\n");
+	TEST_ASSERT_NULL(wb_batch_read(path, &options));
+	unlink(path);
+
+	path = writeBatchFile("-q cats\n--batch other");
+	TEST_ASSERT_NULL(wb_batch_read(path, &options));
+	unlink(path);
+
+	path = writeBatchFile("-q cats --shard 1/2\n");
+	TEST_ASSERT_NULL(wb_batch_read(path, &options));
+	unlink(path);
+
+	TEST_ASSERT_NULL(wb_batch_read("/nonexistent/batch", &options));
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_batchSplitLine, __LINE__);
+	RUN_TEST(test_batchSplitLine_unterminatedQuote, __LINE__);
+	RUN_TEST(test_wbBatchRead, __LINE__);
+	RUN_TEST(test_wbBatchRead_invalid, __LINE__);
+	return UnityEnd();
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "unity.h"
+#include "types.h"
+#include "error.h"
+#include "args.c"
+#include "mem.c"
+#include "str_list.c"
+#include "batch.c"
+#include "histogram.c"
+#include "metrics.c"
+#include "serve.c"
+
+static const char *TEST_SOCKET = "/tmp/wb-test-serve.sock";
+
+struct options options;
+
+/* Functions that return to a known state */
+void resetOptions() {
+	options.username = "";
+	options.password = "";
+	options.images = 20;
+	options.images_per_page = 20;
+	options.jobs = 0;
+	options.batch_file = NULL;
+	options.serve_socket = NULL;
+	options.watch_interval = 0;
+	options.index_file = NULL;
+	options.checkpoint_file = NULL;
+	options.shard_index = 0;
+	options.shard_count = 0;
+	options.trace_file = NULL;
+	options.metrics_file = NULL;
+	options.base_url = NULL;
+	options.stream = 0;
+	options.deadline_ms = 0;
+	options.fast_scan = 0;
+
+	options.query = NULL;
+	options.color = -1;
+	options.toplist = WB_TOPLIST_NONE;
+	options.collection_id = -1;
+
+	options.res_x = 0;
+	options.res_y = 0;
+	options.res_opt = WB_RES_EXACTLY;
+	options.aspect_ratio = 0;
+
+	options.flags = 0;
+	options.purity = 0;
+	options.boards = 0;
+
+	options.sort_by = WB_SORT_DATE;
+	options.sort_order = WB_SORT_DESCENDING;
+}
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Mock functions */
+void wb_error(const char *format, ...) {
+}
+
+void wb_error_no_prefix(const char *format, ...) {
+}
+
+/* Writes one URL per image, fails for the query "fail" */
+int serveQuery(struct options *options, FILE *out, void *arg) {
+	int i;
+
+	if (options->query != NULL && strcmp(options->query, "fail") == 0) {
+		return -1;
+	}
+
+	for (i = 0; i < options->images; i++) {
+		fprintf(out, "http://example.com/%s/%d\n", options->query, i);
+	}
+
+	return 0;
+}
+
+void *runServer(void *arg) {
+	wb_serve(TEST_SOCKET, &options, serveQuery, NULL);
+	return NULL;
+}
+
+FILE *connectToServer() {
+	struct sockaddr_un address;
+	int fd, tries;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, TEST_SOCKET);
+
+	for (tries = 0; tries < 100; tries++) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0) {
+			return fdopen(fd, "r+");
+		}
+		close(fd);
+		usleep(10000);
+	}
+
+	return NULL;
+}
+
+void readLine(FILE *stream, char *line, int size) {
+	if (fgets(line, size, stream) == NULL) {
+		line[0] = '\0';
+	}
+}
+
+/* Tests */
+void test_wbServe() {
+	char line[256];
+	FILE *stream;
+
+	stream = connectToServer();
+	TEST_ASSERT_NOT_NULL(stream);
+
+	/* Several requests on one connection */
+	fputs("-q cats -n 2\n", stream);
+	fflush(stream);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("http://example.com/cats/0\n", line);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("http://example.com/cats/1\n", line);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("OK\n", line);
+
+	fputs("\n-n invalid\n", stream);
+	fflush(stream);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("ERROR invalid options\n", line);
+
+	fputs("--query=fail\n", stream);
+	fflush(stream);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("ERROR query failed\n", line);
+
+	fputs("-q 'two words' -n 1\n", stream);
+	fflush(stream);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("http://example.com/two words/0\n", line);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("OK\n", line);
+
+	/* Metrics instead of a query */
+	wb_metrics_record_request(WB_METRICS_LOGIN, 0.2);
+	fputs("metrics\n", stream);
+	fflush(stream);
+	readLine(stream, line, sizeof(line));
+	TEST_ASSERT_EQUAL_STRING("# HELP wb_request_duration_seconds Time taken by wallbase.cc requests.\n",
+		line);
+	do {
+		readLine(stream, line, sizeof(line));
+	} while (line[0] != '\0' && strncmp(line, "wb_request_duration_seconds_count{endpoint=\"login\"}", 51) != 0);
+	TEST_ASSERT_EQUAL_STRING("wb_request_duration_seconds_count{endpoint=\"login\"} 1\n", line);
+	do {
+		readLine(stream, line, sizeof(line));
+	} while (line[0] != '\0' && strcmp(line, "OK\n") != 0);
+	TEST_ASSERT_EQUAL_STRING("OK\n", line);
+
+	fclose(stream);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	pthread_t server;
+
+	resetOptions();
+	wb_metrics_enable();
+	pthread_create(&server, NULL, runServer, NULL);
+
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbServe, __LINE__);
+	unlink(TEST_SOCKET);
+	return UnityEnd();
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "seen.h"
+#include "seen.c"
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Tests */
+void test_wbSeen_addAndContains() {
+	struct wb_seen *seen;
+
+	seen = wb_seen_new();
+	TEST_ASSERT_NOT_NULL(seen);
+
+	TEST_ASSERT_EQUAL_INT(0, wb_seen_contains(seen, "2886140"));
+	TEST_ASSERT_EQUAL_INT(1, wb_seen_add(seen, "2886140"));
+	TEST_ASSERT_EQUAL_INT(1, wb_seen_contains(seen, "2886140"));
+	TEST_ASSERT_EQUAL_INT(0, wb_seen_add(seen, "2886140"));
+	TEST_ASSERT_EQUAL_INT(0, wb_seen_contains(seen, "288614"));
+	TEST_ASSERT_EQUAL_INT(1, seen->count);
+
+	wb_seen_free(seen);
+}
+
+void test_wbSeen_grows() {
+	struct wb_seen *seen;
+	char key[16];
+	int i;
+
+	seen = wb_seen_new();
+	TEST_ASSERT_NOT_NULL(seen);
+
+	for (i = 0; i < 10000; i++) {
+		sprintf(key, "%d", i);
+		TEST_ASSERT_EQUAL_INT(1, wb_seen_add(seen, key));
+	}
+
+	TEST_ASSERT_EQUAL_INT(10000, seen->count);
+	TEST_ASSERT_TRUE(seen->capacity >= 20000);
+
+	for (i = 0; i < 10000; i++) {
+		sprintf(key, "%d", i);
+		TEST_ASSERT_EQUAL_INT(1, wb_seen_contains(seen, key));
+	}
+	TEST_ASSERT_EQUAL_INT(0, wb_seen_contains(seen, "10000"));
+
+	wb_seen_free(seen);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbSeen_addAndContains, __LINE__);
+	RUN_TEST(test_wbSeen_grows, __LINE__);
+	return UnityEnd();
+}
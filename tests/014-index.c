@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "types.h"
+#include "error.h"
+#include "mem.c"
+#include "str_list.c"
+#include "index.c"
+
+struct options options;
+static char path[] = "/tmp/wb-index-XXXXXX";
+
+/* Functions that return to a known state */
+void resetOptions() {
+	options.username = "";
+	options.password = "";
+	options.images = 20;
+	options.images_per_page = 20;
+	options.jobs = 0;
+	options.batch_file = NULL;
+	options.serve_socket = NULL;
+	options.watch_interval = 0;
+	options.index_file = NULL;
+	options.checkpoint_file = NULL;
+	options.shard_index = 0;
+	options.shard_count = 0;
+	options.trace_file = NULL;
+	options.metrics_file = NULL;
+	options.base_url = NULL;
+	options.stream = 0;
+	options.deadline_ms = 0;
+	options.fast_scan = 0;
+
+	options.query = NULL;
+	options.color = -1;
+	options.toplist = WB_TOPLIST_NONE;
+	options.collection_id = -1;
+
+	options.res_x = 0;
+	options.res_y = 0;
+	options.res_opt = WB_RES_EXACTLY;
+	options.aspect_ratio = 0;
+
+	options.flags = WB_FLAG_OFFLINE;
+	options.purity = 0;
+	options.boards = 0;
+
+	options.sort_by = WB_SORT_DATE;
+	options.sort_order = WB_SORT_DESCENDING;
+}
+
+/* Fills in an index entry */
+void setEntry(struct wb_index_entry *entry, unsigned int id, char *image_url,
+	int res_x, int res_y, int purity, int board, int color, int favorites, char *tags) {
+
+	entry->id = id;
+	entry->image_url = image_url;
+	entry->res_x = res_x;
+	entry->res_y = res_y;
+	entry->purity = purity;
+	entry->board = board;
+	entry->color = color;
+	entry->favorites = favorites;
+	entry->fetched = 1000 + id;
+	entry->tags = tags;
+}
+
+/* Unity set up and tear down */
+void setUp() {
+	int fd;
+
+	strcpy(path, "/tmp/wb-index-XXXXXX");
+	fd = mkstemp(path);
+	close(fd);
+	resetOptions();
+}
+
+void tearDown() {
+	unlink(path);
+}
+
+/* Mock functions */
+void wb_error(const char *format, ...) {
+}
+
+/* Tests */
+void test_wbIndex_appendAndLoad() {
+	struct wb_index_entry entries[3];
+	struct wb_index *index;
+	FILE *file;
+
+	setEntry(&entries[0], 1, "http://a/rozne/wallpaper-1.jpg", 1920, 1080,
+		WB_PURITY_SFW, WB_BOARD_GENERAL, 0x336699, 10, "sky,blue\tsky");
+	setEntry(&entries[1], 2, "http://a/manga-anime/wallpaper-2.jpg", 1280, 1024,
+		WB_PURITY_SKETCHY, WB_BOARD_ANIME, -1, 3, NULL);
+	TEST_ASSERT_EQUAL_INT(0, wb_index_append(path, entries, 2));
+
+	/* A broken line is skipped, a later line replaces an earlier one */
+	file = fopen(path, "a");
+	fputs("garbage\n", file);
+	fclose(file);
+
+	setEntry(&entries[2], 1, "http://a/rozne/wallpaper-1.png", 2560, 1440,
+		WB_PURITY_SFW, WB_BOARD_GENERAL, 0x336699, 12, "sky");
+	TEST_ASSERT_EQUAL_INT(0, wb_index_append(path, &entries[2], 1));
+
+	index = wb_index_load(path);
+	TEST_ASSERT_NOT_NULL(index);
+	TEST_ASSERT_EQUAL_INT(2, index->count);
+
+	TEST_ASSERT_EQUAL_INT(1, index->entries[0].id);
+	TEST_ASSERT_EQUAL_STRING("http://a/rozne/wallpaper-1.png", index->entries[0].image_url);
+	TEST_ASSERT_EQUAL_INT(2560, index->entries[0].res_x);
+	TEST_ASSERT_EQUAL_INT(1440, index->entries[0].res_y);
+	TEST_ASSERT_EQUAL_INT(12, index->entries[0].favorites);
+	TEST_ASSERT_EQUAL_INT(1001, (int) index->entries[0].fetched);
+
+	TEST_ASSERT_EQUAL_INT(2, index->entries[1].id);
+	TEST_ASSERT_EQUAL_INT(WB_PURITY_SKETCHY, index->entries[1].purity);
+	TEST_ASSERT_EQUAL_INT(WB_BOARD_ANIME, index->entries[1].board);
+	TEST_ASSERT_EQUAL_INT(-1, index->entries[1].color);
+	TEST_ASSERT_EQUAL_STRING("", index->entries[1].tags);
+
+	/* Entries without a color or tags are not in those indexes */
+	TEST_ASSERT_EQUAL_INT(1, index->by_color.count);
+	TEST_ASSERT_EQUAL_INT(1, index->by_tag.count);
+
+	wb_index_free(index);
+
+	TEST_ASSERT_NULL(wb_index_load("/tmp/wb-index-missing"));
+}
+
+void test_wbIndex_query() {
+	struct wb_index_entry entries[5];
+	struct wb_str_list *urls;
+	struct wb_index *index;
+
+	setEntry(&entries[0], 1, "one", 1920, 1080, WB_PURITY_SFW, WB_BOARD_GENERAL,
+		0x336699, 10, "Blue Sky,sea");
+	setEntry(&entries[1], 2, "two", 2560, 1440, WB_PURITY_SKETCHY, WB_BOARD_ANIME,
+		0x336699, 30, "sky,sky");
+	setEntry(&entries[2], 3, "three", 1280, 1024, WB_PURITY_NSFW, WB_BOARD_HIGHRES,
+		0xffffff, 20, "forest");
+	setEntry(&entries[3], 4, "four", 1920, 1200, WB_PURITY_SFW, WB_BOARD_ANIME,
+		-1, 5, "");
+	setEntry(&entries[4], 5, "five", 1920, 1080, WB_PURITY_SKETCHY, WB_BOARD_GENERAL,
+		0x000000, 1, "blue");
+	TEST_ASSERT_EQUAL_INT(0, wb_index_append(path, entries, 5));
+
+	index = wb_index_load(path);
+	TEST_ASSERT_NOT_NULL(index);
+
+	/* Newest first by default */
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(5, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("five", urls->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.res_x = 1920;
+	options.res_y = 1080;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(2, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("five", urls->str);
+	TEST_ASSERT_EQUAL_STRING("one", urls->next->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.res_x = 1920;
+	options.res_y = 1100;
+	options.res_opt = WB_RES_AT_LEAST;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(2, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("four", urls->str);
+	TEST_ASSERT_EQUAL_STRING("two", urls->next->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.aspect_ratio = 16.0 / 9;
+	options.sort_by = WB_SORT_FAVORITES;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(3, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("two", urls->str);
+	TEST_ASSERT_EQUAL_STRING("one", urls->next->str);
+	TEST_ASSERT_EQUAL_STRING("five", urls->next->next->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.color = 0x336699;
+	options.purity = WB_PURITY_SFW;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(1, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("one", urls->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.purity = WB_PURITY_SFW | WB_PURITY_NSFW;
+	options.boards = WB_BOARD_ANIME | WB_BOARD_HIGHRES;
+	options.sort_order = WB_SORT_ASCENDING;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(2, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("three", urls->str);
+	TEST_ASSERT_EQUAL_STRING("four", urls->next->str);
+	wb_list_free(urls);
+
+	/* Every word must be a tag word, in any case */
+	resetOptions();
+	options.query = "SKY blue";
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(1, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("one", urls->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.query = "sky";
+	options.images = 1;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(1, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("two", urls->str);
+	wb_list_free(urls);
+
+	resetOptions();
+	options.query = "desert";
+	TEST_ASSERT_NULL(wb_index_query(index, &options));
+
+	resetOptions();
+	options.collection_id = 33521;
+	TEST_ASSERT_NULL(wb_index_query(index, &options));
+
+	wb_index_free(index);
+}
+
+void test_wbIndex_manyEntries() {
+	struct wb_index_entry *entries;
+	struct wb_str_list *urls, *url;
+	struct wb_index *index;
+	char (*image_urls)[16];
+	int i, count;
+
+	count = 100000;
+	entries = (struct wb_index_entry *) malloc(count * sizeof(struct wb_index_entry));
+	image_urls = malloc(count * sizeof(*image_urls));
+	TEST_ASSERT_NOT_NULL(entries);
+	TEST_ASSERT_NOT_NULL(image_urls);
+
+	for (i = 0; i < count; i++) {
+		sprintf(image_urls[i], "%d", i + 1);
+		setEntry(&entries[i], i + 1, image_urls[i], 1000 + i % 1000, 1000 + i % 7,
+			1 << (i % 3), 1 << (i % 2), i % 4096, i % 100, (i % 10 == 0) ? "ten" : "other");
+	}
+	TEST_ASSERT_EQUAL_INT(0, wb_index_append(path, entries, count));
+	free(entries);
+	free(image_urls);
+
+	index = wb_index_load(path);
+	TEST_ASSERT_NOT_NULL(index);
+	TEST_ASSERT_EQUAL_INT(count, index->count);
+
+	/* The secondary indexes are sorted */
+	for (i = 1; i < index->by_resolution.count; i++) {
+		TEST_ASSERT_TRUE(index->by_resolution.keys[i - 1].key <= index->by_resolution.keys[i].key);
+	}
+	for (i = 1; i < index->by_tag.count; i++) {
+		TEST_ASSERT_TRUE(index->by_tag.keys[i - 1].key <= index->by_tag.keys[i].key);
+	}
+
+	/* i % 1000 == 5 and i % 7 == 3: one in every 7000 entries */
+	options.res_x = 1005;
+	options.res_y = 1003;
+	options.images = 1000;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(14, wb_list_length(urls));
+	for (url = urls; url != NULL; url = url->next) {
+		i = atoi(url->str) - 1;
+		TEST_ASSERT_EQUAL_INT(5, i % 1000);
+		TEST_ASSERT_EQUAL_INT(3, i % 7);
+	}
+	wb_list_free(urls);
+
+	resetOptions();
+	options.query = "ten";
+	options.color = 0;
+	options.images = 1000;
+	urls = wb_index_query(index, &options);
+	TEST_ASSERT_EQUAL_INT(count / 20480 + 1, wb_list_length(urls));
+	wb_list_free(urls);
+
+	wb_index_free(index);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbIndex_appendAndLoad, __LINE__);
+	RUN_TEST(test_wbIndex_query, __LINE__);
+	RUN_TEST(test_wbIndex_manyEntries, __LINE__);
+	return UnityEnd();
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "error.h"
+#include "mem.c"
+#include "str_list.c"
+#include "checkpoint.c"
+
+static char path[] = "/tmp/wb-checkpoint-XXXXXX";
+
+/* Unity set up and tear down */
+void setUp() {
+	int fd;
+
+	strcpy(path, "/tmp/wb-checkpoint-XXXXXX");
+	fd = mkstemp(path);
+	close(fd);
+}
+
+void tearDown() {
+	unlink(path);
+}
+
+/* Mock functions */
+void wb_error(const char *format, ...) {
+}
+
+/* Tests */
+void test_wbCheckpoint_resume() {
+	struct wb_checkpoint *checkpoint;
+	const struct wb_checkpoint_page *page;
+	struct wb_str_list *urls = NULL;
+	FILE *file;
+
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sky", 0);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+
+	urls = wb_list_append(urls, "http://wallbase.cc/wallpaper/1");
+	urls = wb_list_append(urls, "http://wallbase.cc/wallpaper/2");
+	wb_checkpoint_add_page(checkpoint, 32, urls);
+	wb_checkpoint_add_page(checkpoint, 0, NULL);
+	wb_checkpoint_add_image(checkpoint, "http://wallbase.cc/wallpaper/2", "http://img/2.jpg");
+	wb_checkpoint_add_image(checkpoint, "http://wallbase.cc/wallpaper/1", "http://img/1.jpg");
+	TEST_ASSERT_EQUAL_INT(0, wb_checkpoint_sync(checkpoint));
+	wb_checkpoint_close(checkpoint);
+	wb_list_free(urls);
+
+	/* A line cut short by a crash is ignored */
+	file = fopen(path, "a");
+	fputs("I\thttp://wallbase.cc/wallpaper/3\thttp://img/3", file);
+	fclose(file);
+
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sky", 1);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+	TEST_ASSERT_EQUAL_INT(2, checkpoint->page_count);
+	TEST_ASSERT_EQUAL_INT(2, checkpoint->image_count);
+
+	page = wb_checkpoint_find_page(checkpoint, 32);
+	TEST_ASSERT_NOT_NULL(page);
+	TEST_ASSERT_EQUAL_INT(2, wb_list_length(page->urls));
+	TEST_ASSERT_EQUAL_STRING("http://wallbase.cc/wallpaper/1", page->urls->str);
+	TEST_ASSERT_EQUAL_STRING("http://wallbase.cc/wallpaper/2", page->urls->next->str);
+
+	page = wb_checkpoint_find_page(checkpoint, 0);
+	TEST_ASSERT_NOT_NULL(page);
+	TEST_ASSERT_NULL(page->urls);
+	TEST_ASSERT_NULL(wb_checkpoint_find_page(checkpoint, 64));
+
+	TEST_ASSERT_EQUAL_STRING("http://img/1.jpg",
+		wb_checkpoint_find_image(checkpoint, "http://wallbase.cc/wallpaper/1"));
+	TEST_ASSERT_EQUAL_STRING("http://img/2.jpg",
+		wb_checkpoint_find_image(checkpoint, "http://wallbase.cc/wallpaper/2"));
+	TEST_ASSERT_NULL(wb_checkpoint_find_image(checkpoint, "http://wallbase.cc/wallpaper/3"));
+
+	/* The resumed run keeps appending to the same journal */
+	wb_checkpoint_add_image(checkpoint, "http://wallbase.cc/wallpaper/4", "http://img/4.jpg");
+	wb_checkpoint_close(checkpoint);
+
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sky", 1);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+	TEST_ASSERT_EQUAL_STRING("http://img/4.jpg",
+		wb_checkpoint_find_image(checkpoint, "http://wallbase.cc/wallpaper/4"));
+	wb_checkpoint_close(checkpoint);
+}
+
+void test_wbCheckpoint_otherQuery() {
+	struct wb_checkpoint *checkpoint;
+
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sky", 0);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+	wb_checkpoint_add_image(checkpoint, "http://wallbase.cc/wallpaper/1", "http://img/1.jpg");
+	wb_checkpoint_close(checkpoint);
+
+	TEST_ASSERT_NULL(wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sea", 1));
+
+	/* Without resuming, the journal starts over */
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sea", 0);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+	TEST_ASSERT_EQUAL_INT(0, checkpoint->image_count);
+	wb_checkpoint_close(checkpoint);
+
+	checkpoint = wb_checkpoint_open(path, "http://wallbase.cc/search/0\tq=sea", 1);
+	TEST_ASSERT_NOT_NULL(checkpoint);
+	TEST_ASSERT_EQUAL_INT(0, checkpoint->image_count);
+	wb_checkpoint_close(checkpoint);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbCheckpoint_resume, __LINE__);
+	RUN_TEST(test_wbCheckpoint_otherQuery, __LINE__);
+	return UnityEnd();
+}
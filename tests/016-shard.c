@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "error.h"
+#include "mem.c"
+#include "str_list.c"
+#include "seen.c"
+#include "shard.c"
+
+static char first[] = "/tmp/wb-shard-XXXXXX";
+static char second[] = "/tmp/wb-shard-XXXXXX";
+
+/* Helper functions */
+void writeShardOutput(char *path, const char *contents) {
+	int fd;
+
+	strcpy(path, "/tmp/wb-shard-XXXXXX");
+	fd = mkstemp(path);
+	write(fd, contents, strlen(contents));
+	close(fd);
+}
+
+/* Unity set up and tear down */
+void setUp() {
+}
+
+void tearDown() {
+}
+
+/* Mock functions */
+void wb_error(const char *format, ...) {
+}
+
+/* Tests */
+void test_wbShardOwnsPage() {
+	TEST_ASSERT_EQUAL_INT(1, wb_shard_owns_page(0, 0, 5));
+	TEST_ASSERT_EQUAL_INT(1, wb_shard_owns_page(0, 3, 0));
+	TEST_ASSERT_EQUAL_INT(0, wb_shard_owns_page(0, 3, 1));
+	TEST_ASSERT_EQUAL_INT(1, wb_shard_owns_page(1, 3, 4));
+	TEST_ASSERT_EQUAL_INT(1, wb_shard_owns_page(2, 3, 5));
+}
+
+void test_wbShardMerge() {
+	struct wb_str_list *urls;
+	char *paths[2];
+	char *line;
+
+	line = wb_shard_line(32, "http://img/a.jpg");
+	TEST_ASSERT_EQUAL_STRING("32\thttp://img/a.jpg", line);
+	free(line);
+
+	/* Pages 0 and 2 in one shard, page 1 in the other. Image c moved
+	   from the second page to the third while the shards ran. */
+	writeShardOutput(first, "0\thttp://img/a.jpg\n1\thttp://img/b.jpg\n"
+		"4\thttp://img/c.jpg\n5\thttp://img/f.jpg\nnot a position\n6\thttp://img/g");
+	writeShardOutput(second, "2\thttp://img/c.jpg\n3\thttp://img/d.jpg\n");
+	paths[0] = first;
+	paths[1] = second;
+
+	urls = wb_shard_merge(paths, 2);
+	unlink(first);
+	unlink(second);
+
+	TEST_ASSERT_EQUAL_INT(5, wb_list_length(urls));
+	TEST_ASSERT_EQUAL_STRING("http://img/a.jpg", urls->str);
+	TEST_ASSERT_EQUAL_STRING("http://img/b.jpg", urls->next->str);
+	TEST_ASSERT_EQUAL_STRING("http://img/c.jpg", urls->next->next->str);
+	TEST_ASSERT_EQUAL_STRING("http://img/d.jpg", urls->next->next->next->str);
+	TEST_ASSERT_EQUAL_STRING("http://img/f.jpg", urls->next->next->next->next->str);
+	wb_list_free(urls);
+
+	paths[0] = "/nonexistent/shard";
+	TEST_ASSERT_NULL(wb_shard_merge(paths, 1));
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbShardOwnsPage, __LINE__);
+	RUN_TEST(test_wbShardMerge, __LINE__);
+	return UnityEnd();
+}
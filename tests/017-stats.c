@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "histogram.c"
+#include "stats.c"
+
+/* Unity set up and tear down */
+void setUp() {
+	wb_stats_enable();
+}
+
+void tearDown() {
+	wb_stats_free();
+}
+
+/* Tests */
+void test_wbStatsPercentile() {
+	int i;
+
+	/* Recorded out of order, 1 ms to 200 ms */
+	for (i = 200; i >= 1; i--) {
+		wb_stats_record(WB_STATS_XPATH, i / 1000.0);
+	}
+
+	/* Percentiles are read from histogram buckets, which keep
+	   values within 3% */
+	TEST_ASSERT_EQUAL_INT(200, stats_phases[WB_STATS_XPATH].count);
+	TEST_ASSERT_FLOAT_WITHIN(0.100 * 0.03, 0.100, wb_stats_percentile(WB_STATS_XPATH, 50));
+	TEST_ASSERT_FLOAT_WITHIN(0.190 * 0.03, 0.190, wb_stats_percentile(WB_STATS_XPATH, 95));
+	TEST_ASSERT_FLOAT_WITHIN(0.198 * 0.03, 0.198, wb_stats_percentile(WB_STATS_XPATH, 99));
+	TEST_ASSERT_FLOAT_WITHIN(0.200 * 0.03, 0.200, wb_stats_percentile(WB_STATS_XPATH, 100));
+
+	wb_stats_record(WB_STATS_TIDY, 0.5);
+	TEST_ASSERT_FLOAT_WITHIN(0.5 * 0.03, 0.5, wb_stats_percentile(WB_STATS_TIDY, 99));
+	TEST_ASSERT_EQUAL_FLOAT(0, wb_stats_percentile(WB_STATS_CONNECT, 50));
+}
+
+void test_wbStatsCount() {
+	wb_stats_count(WB_STATS_REQUESTS, 1);
+	wb_stats_count(WB_STATS_REQUESTS, 1);
+	wb_stats_count(WB_STATS_BYTES_RECEIVED, 4096);
+	TEST_ASSERT_EQUAL_INT(2, wb_stats_counter(WB_STATS_REQUESTS));
+	TEST_ASSERT_EQUAL_INT(4096, wb_stats_counter(WB_STATS_BYTES_RECEIVED));
+
+	/* Nothing is recorded while stats are off */
+	wb_stats_free();
+	wb_stats_count(WB_STATS_REQUESTS, 1);
+	wb_stats_record(WB_STATS_TOTAL, 1);
+	TEST_ASSERT_EQUAL_INT(0, wb_stats_counter(WB_STATS_REQUESTS));
+	TEST_ASSERT_EQUAL_INT(0, stats_phases[WB_STATS_TOTAL].count);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbStatsPercentile, __LINE__);
+	RUN_TEST(test_wbStatsCount, __LINE__);
+	return UnityEnd();
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "error.c"
+#include "histogram.c"
+#include "stats.c"
+#include "trace.c"
+
+static char trace_path[] = "/tmp/wb-trace-XXXXXX";
+
+/* Reads the whole trace */
+char *
+read_trace() {
+	static char buffer[4096];
+	FILE *file;
+	size_t size;
+
+	file = fopen(trace_path, "r");
+	TEST_ASSERT_NOT_NULL(file);
+	size = fread(buffer, 1, sizeof(buffer) - 1, file);
+	buffer[size] = '\0';
+	fclose(file);
+
+	return buffer;
+}
+
+/* Unity set up and tear down */
+void setUp() {
+	strcpy(trace_path, "/tmp/wb-trace-XXXXXX");
+	close(mkstemp(trace_path));
+}
+
+void tearDown() {
+	wb_trace_close();
+	remove(trace_path);
+}
+
+/* Tests */
+void test_wbTraceSpan() {
+	char *trace;
+	double start;
+
+	TEST_ASSERT_EQUAL_INT(0, wb_trace_open(trace_path));
+
+	start = wb_stats_now();
+	wb_trace_span("download", "net", start, start + 0.25, "http://x/?q=\"a\\b\"");
+
+	wb_trace_set_url("http://x/1");
+	wb_trace_span("parse", "parse", start, start + 0.001, NULL);
+	wb_trace_set_url(NULL);
+	wb_trace_span("login", "net", start, start, NULL);
+	wb_trace_close();
+
+	trace = read_trace();
+	TEST_ASSERT_EQUAL_INT(0, strncmp(trace,
+		"[\n{\"name\":\"download\",\"cat\":\"net\",\"ph\":\"X\",", 42));
+	TEST_ASSERT_NOT_NULL(strstr(trace, "\"dur\":250000.0,"));
+	TEST_ASSERT_NOT_NULL(strstr(trace, "\"args\":{\"url\":\"http://x/?q=\\\"a\\\\b\\\"\"}},\n"));
+	TEST_ASSERT_NOT_NULL(strstr(trace, "\"dur\":1000.0,"));
+	TEST_ASSERT_NOT_NULL(strstr(trace, "\"args\":{\"url\":\"http://x/1\"}},\n{\"name\":\"login\""));
+	TEST_ASSERT_NOT_NULL(strstr(trace, "\"dur\":0.0,"));
+	TEST_ASSERT_NULL(strstr(strstr(trace, "login"), "args"));
+	TEST_ASSERT_EQUAL_STRING("}\n]\n", trace + strlen(trace) - 4);
+}
+
+void test_wbTraceDisabled() {
+	wb_trace_span("download", "net", 0, 1, "http://x/");
+	TEST_ASSERT_EQUAL_INT(0, wb_trace_enabled);
+
+	TEST_ASSERT_EQUAL_INT(-1, wb_trace_open("/nonexistent/wb.trace"));
+	TEST_ASSERT_EQUAL_INT(0, wb_trace_enabled);
+
+	/* An empty trace is still a valid array */
+	TEST_ASSERT_EQUAL_INT(0, wb_trace_open(trace_path));
+	wb_trace_close();
+	TEST_ASSERT_EQUAL_STRING("[\n\n]\n", read_trace());
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbTraceSpan, __LINE__);
+	RUN_TEST(test_wbTraceDisabled, __LINE__);
+	return UnityEnd();
+}
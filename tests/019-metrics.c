@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "error.c"
+#include "histogram.c"
+#include "metrics.c"
+
+/* Unity set up and tear down */
+void setUp() {
+	wb_metrics_enable();
+}
+
+void tearDown() {
+	wb_metrics_reset();
+}
+
+/* Tests */
+void test_wbHistogramBucket() {
+	struct wb_histogram *histogram;
+	unsigned long value;
+	int bucket;
+
+	/* Small values are exact */
+	TEST_ASSERT_EQUAL_INT(0, wb_histogram_bucket(0));
+	TEST_ASSERT_EQUAL_INT(63, wb_histogram_bucket(63));
+	TEST_ASSERT_EQUAL_INT(64, wb_histogram_bucket(64));
+	TEST_ASSERT_EQUAL_INT(64, wb_histogram_bucket(65));
+	TEST_ASSERT_EQUAL_INT(96, wb_histogram_bucket(128));
+	TEST_ASSERT_EQUAL_INT(WB_HISTOGRAM_BUCKETS - 1, wb_histogram_bucket(~0UL));
+
+	/* Every value is in the bucket it maps to, within about 3% */
+	for (value = 1; value < (1UL << 36); value += value / 7 + 1) {
+		bucket = wb_histogram_bucket(value);
+		TEST_ASSERT_TRUE(value <= wb_histogram_bucket_max(bucket));
+		TEST_ASSERT_TRUE(bucket == 0 || value > wb_histogram_bucket_max(bucket - 1));
+		TEST_ASSERT_TRUE(wb_histogram_bucket_max(bucket) - value <= value / 32);
+	}
+
+	histogram = (struct wb_histogram *) calloc(1, sizeof(struct wb_histogram));
+	wb_histogram_record(histogram, 10);
+	wb_histogram_record(histogram, 1000);
+	wb_histogram_record(histogram, 1000000);
+	TEST_ASSERT_EQUAL_INT(3, histogram->count);
+	TEST_ASSERT_EQUAL_INT(1001010, histogram->sum);
+	TEST_ASSERT_EQUAL_INT(0, wb_histogram_count_upto(histogram, 9));
+	TEST_ASSERT_EQUAL_INT(2, wb_histogram_count_upto(histogram, 1023));
+	TEST_ASSERT_EQUAL_INT(3, wb_histogram_count_upto(histogram, 2000000));
+	free(histogram);
+}
+
+void test_wbMetricsWrite() {
+	char path[] = "/tmp/wb-metrics-XXXXXX";
+	char buffer[8192];
+	FILE *file;
+	size_t size;
+
+	wb_metrics_record_request(WB_METRICS_LISTING, 0.003);
+	wb_metrics_record_request(WB_METRICS_LISTING, 0.2);
+	wb_metrics_record_parse(0.0005);
+
+	close(mkstemp(path));
+	TEST_ASSERT_EQUAL_INT(0, wb_metrics_dump(path));
+
+	file = fopen(path, "r");
+	TEST_ASSERT_NOT_NULL(file);
+	size = fread(buffer, 1, sizeof(buffer) - 1, file);
+	buffer[size] = '\0';
+	fclose(file);
+	remove(path);
+
+	TEST_ASSERT_NOT_NULL(strstr(buffer, "# TYPE wb_request_duration_seconds histogram\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer,
+		"wb_request_duration_seconds_bucket{endpoint=\"listing\",le=\"0.0025\"} 0\n"
+		"wb_request_duration_seconds_bucket{endpoint=\"listing\",le=\"0.005\"} 1\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer,
+		"wb_request_duration_seconds_bucket{endpoint=\"listing\",le=\"0.1\"} 1\n"
+		"wb_request_duration_seconds_bucket{endpoint=\"listing\",le=\"0.25\"} 2\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer,
+		"wb_request_duration_seconds_bucket{endpoint=\"listing\",le=\"+Inf\"} 2\n"
+		"wb_request_duration_seconds_sum{endpoint=\"listing\"} 0.203000\n"
+		"wb_request_duration_seconds_count{endpoint=\"listing\"} 2\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer,
+		"wb_request_duration_seconds_count{endpoint=\"login\"} 0\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer,
+		"wb_parse_duration_seconds_bucket{le=\"0.001\"} 1\n"));
+	TEST_ASSERT_NOT_NULL(strstr(buffer, "wb_parse_duration_seconds_count{} 1\n"));
+
+	/* Nothing is recorded while metrics are off */
+	wb_metrics_reset();
+	wb_metrics_record_parse(1);
+	TEST_ASSERT_EQUAL_INT(0, metrics_parse.count);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbHistogramBucket, __LINE__);
+	RUN_TEST(test_wbMetricsWrite, __LINE__);
+	return UnityEnd();
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 Mantas Norvaiša
+ *
+ * This file is part of wb.
+ * 
+ * wb is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with wb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "mem.c"
+#include "str_list.c"
+
+/* Unity set up and tear down */
+void setUp() {
+	wb_mem_enable();
+}
+
+void tearDown() {
+	wb_mem_reset();
+}
+
+/* Tests */
+void test_wbMemAllocations() {
+	struct wb_mem_usage usage;
+	char *block, *copy;
+
+	block = (char *) wb_mem_malloc(WB_MEM_CURL, 1000);
+	copy = wb_mem_strdup(WB_MEM_CURL, "cookie");
+	wb_mem_usage(WB_MEM_CURL, &usage);
+	TEST_ASSERT_EQUAL_INT(2, usage.allocations);
+	TEST_ASSERT_EQUAL_INT(wb_mem_size(block) + wb_mem_size(copy), usage.current);
+
+	/* Growing a block raises the peak, freeing it keeps it */
+	block = (char *) wb_mem_realloc(WB_MEM_CURL, block, 100000);
+	wb_mem_usage(WB_MEM_CURL, &usage);
+	TEST_ASSERT_EQUAL_INT(wb_mem_size(block) + wb_mem_size(copy), usage.current);
+	TEST_ASSERT_EQUAL_INT(usage.current, usage.peak);
+
+	wb_mem_free(WB_MEM_CURL, block);
+	wb_mem_free(WB_MEM_CURL, copy);
+	wb_mem_usage(WB_MEM_CURL, &usage);
+	TEST_ASSERT_EQUAL_INT(0, usage.current);
+	TEST_ASSERT_TRUE(usage.peak >= 100000);
+	TEST_ASSERT_EQUAL_INT(3, usage.allocations);
+
+	/* Other subsystems are untouched */
+	wb_mem_usage(WB_MEM_TIDY, &usage);
+	TEST_ASSERT_EQUAL_INT(0, usage.peak);
+}
+
+void test_wbMemStrList() {
+	struct wb_mem_usage usage;
+	struct wb_str_list *list = NULL;
+
+	list = wb_list_append(list, "http://wallbase.cc/wallpaper/1");
+	list = wb_list_append_nocopy(list, strdup("http://wallbase.cc/wallpaper/2"));
+	wb_mem_usage(WB_MEM_STR_LIST, &usage);
+	TEST_ASSERT_EQUAL_INT(2, usage.allocations);
+	TEST_ASSERT_TRUE(usage.current > 2 * 30);
+
+	wb_list_free(list);
+	wb_mem_usage(WB_MEM_STR_LIST, &usage);
+	TEST_ASSERT_EQUAL_INT(0, usage.current);
+
+	/* Nothing is accounted while accounting is off */
+	wb_mem_reset();
+	list = wb_list_append(NULL, "x");
+	wb_mem_usage(WB_MEM_STR_LIST, &usage);
+	TEST_ASSERT_EQUAL_INT(0, usage.allocations);
+	wb_list_free(list);
+}
+
+/* Main */
+int main(int argc, char *argv[]) {
+	Unity.TestFile=__FILE__;
+	UnityBegin();
+	RUN_TEST(test_wbMemAllocations, __LINE__);
+	RUN_TEST(test_wbMemStrList, __LINE__);
+	return UnityEnd();
+}